@@ -0,0 +1,321 @@
+/*
+    attitude_study.cpp: Cost and accuracy of each Estimator attitude policy
+
+    Same rate profile as quat_study (the gyro channels of ../data/tf2.csv,
+    Catmull-Rom between log samples, also scaled up x20 for something like
+    an ascent with roll). The true attitude is integrated from it in double,
+    starting tilted and off in heading, and the IMU readings are made from
+    it: gyro with a constant bias and white noise at 500 Hz, accel plus
+    noise at 500 Hz, mag as the B_E field plus noise at 100 Hz. The accel
+    reads gravity on the pad and under the chute, but thrust and then drag
+    along the rocket's axis in between, the way a real one does, so a
+    filter that trusts it in flight gets pulled off.
+    Each policy runs behind a BasicEstimator with the StateDeterminer's
+    sigmas, so it sees exactly what it would in flight (preintegrated
+    predicts every GNC_PREDICT_PERIOD_US).
+
+    Each policy is run with the AttitudeCore gates (|a| ~ g, chi-square)
+    and without. Reported: time per sample on each channel from the
+    estimator's own accounting (ns on the host, cycles on the ESP32), the
+    accel time on the pad and in flight separately, the share of accel
+    samples rejected, and the attitude error against the truth every 50 ms
+    once the first SETTLE_S have passed: rms over the whole run, max in
+    flight (launch to FLIGHT_S after it) and at the end, in degrees.
+
+    Build and run with `make attstudy` (-O2).
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "altitude.h"
+#include "StateDetermination.h"
+
+using gnc::Quatf;
+using gnc::Vector3f;
+
+static const int TIME_INDEX = 1;
+static const int GYRO_INDEX = 16; // x, y, z follow
+
+static const double DEG_TO_RAD = M_PI / 180.0;
+static const int IMU_PERIOD_US = 2000;
+static const int MAG_DIVIDER = 5;   // mag every 5th imu sample
+static const int REF_SUBSTEPS = 4;  // RK4 steps per imu sample for the truth
+static const int CHECK_EVERY = 25;  // imu samples between error checks
+static const double SETTLE_S = 5.0;
+
+// flight profile, times from the start of the log
+static const double LAUNCH_S = 20.0;
+static const double BURN_S = 3.0;    // thrust along body z
+static const double FLIGHT_S = 15.0; // then drag along body z until the chute
+static const double THRUST_G = 8.0;
+static const double DRAG_G = 0.3;
+
+// sensor errors
+static const float GYRO_BIAS[3] = {0.005f, -0.003f, 0.004f}; // rad/s
+static const float GYRO_NOISE = 0.003f;                      // rad/s
+static const float ACCEL_NOISE = 0.3f;                       // m/s^2
+static const float MAG_NOISE = 0.02f;                        // of the unit field
+
+struct rate_log
+{
+    std::vector<double> t;    // s, from the first sample
+    std::vector<double> w[3]; // rad/s
+};
+
+static bool load_log(const char *path, rate_log &log)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        return false;
+
+    std::string line;
+    std::getline(file, line); // header
+    double t0 = -1.0;
+    while (std::getline(file, line))
+    {
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, ','))
+            fields.push_back(field);
+        if ((int)fields.size() <= GYRO_INDEX + 2)
+            continue;
+
+        double t = std::stod(fields[TIME_INDEX]) / 1000.0;
+        if (t0 < 0.0)
+            t0 = t;
+        // the logger repeats a timestamp now and then, the spline needs them increasing
+        if (!log.t.empty() && t - t0 <= log.t.back())
+            continue;
+        log.t.push_back(t - t0);
+        for (int i = 0; i < 3; i++)
+            log.w[i].push_back(std::stod(fields[GYRO_INDEX + i]) * DEG_TO_RAD);
+    }
+    return log.t.size() > 4;
+}
+
+// Catmull-Rom through the log samples, clamped at the ends
+static void rate_at(const rate_log &log, double t, double scale, double w[3])
+{
+    int n = (int)log.t.size();
+    int k = 0, hi = n - 1;
+    while (hi - k > 1)
+    {
+        int mid = (k + hi) / 2;
+        if (log.t[mid] <= t)
+            k = mid;
+        else
+            hi = mid;
+    }
+    double u = (t - log.t[k]) / (log.t[k + 1] - log.t[k]);
+    u = u < 0.0 ? 0.0 : (u > 1.0 ? 1.0 : u);
+    int k0 = k > 0 ? k - 1 : 0;
+    int k3 = k + 2 < n ? k + 2 : n - 1;
+
+    for (int i = 0; i < 3; i++)
+    {
+        double p0 = log.w[i][k0], p1 = log.w[i][k], p2 = log.w[i][k + 1], p3 = log.w[i][k3];
+        w[i] = scale * 0.5 * (2.0 * p1 + (p2 - p0) * u + (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) * u * u +
+                              (3.0 * (p1 - p2) + p3 - p0) * u * u * u);
+    }
+}
+
+struct quatd
+{
+    double w, x, y, z;
+};
+
+static quatd rate_d(const quatd &q, const double w[3])
+{
+    return quatd{0.5 * (-q.x * w[0] - q.y * w[1] - q.z * w[2]),
+                 0.5 * (q.w * w[0] + q.y * w[2] - q.z * w[1]),
+                 0.5 * (q.w * w[1] - q.x * w[2] + q.z * w[0]),
+                 0.5 * (q.w * w[2] + q.x * w[1] - q.y * w[0])};
+}
+
+static quatd axpy_d(const quatd &q, double s, const quatd &d)
+{
+    return quatd{q.w + s * d.w, q.x + s * d.x, q.y + s * d.y, q.z + s * d.z};
+}
+
+static quatd rk4_d(const rate_log &log, double scale, quatd q, double t, double dt)
+{
+    double w0[3], wm[3], w1[3];
+    rate_at(log, t, scale, w0);
+    rate_at(log, t + 0.5 * dt, scale, wm);
+    rate_at(log, t + dt, scale, w1);
+    quatd k1 = rate_d(q, w0);
+    quatd k2 = rate_d(axpy_d(q, 0.5 * dt, k1), wm);
+    quatd k3 = rate_d(axpy_d(q, 0.5 * dt, k2), wm);
+    quatd k4 = rate_d(axpy_d(q, dt, k3), w1);
+    q = axpy_d(q, dt / 6.0, quatd{k1.w + 2.0 * (k2.w + k3.w) + k4.w,
+                                  k1.x + 2.0 * (k2.x + k3.x) + k4.x,
+                                  k1.y + 2.0 * (k2.y + k3.y) + k4.y,
+                                  k1.z + 2.0 * (k2.z + k3.z) + k4.z});
+    double n = sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    return quatd{q.w / n, q.x / n, q.y / n, q.z / n};
+}
+
+// R(q)^T v, earth to body
+static void rotate_inverse_d(const quatd &q, const double v[3], double out[3])
+{
+    double xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    double xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    double wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    out[0] = (1.0 - 2.0 * (yy + zz)) * v[0] + 2.0 * (xy + wz) * v[1] + 2.0 * (xz - wy) * v[2];
+    out[1] = 2.0 * (xy - wz) * v[0] + (1.0 - 2.0 * (xx + zz)) * v[1] + 2.0 * (yz + wx) * v[2];
+    out[2] = 2.0 * (xz + wy) * v[0] + 2.0 * (yz - wx) * v[1] + (1.0 - 2.0 * (xx + yy)) * v[2];
+}
+
+// from the vector part of r^-1 * q, see quat_study
+static double angle_between(const Quatf &q, const quatd &r)
+{
+    double n = sqrt((double)q.w * q.w + (double)q.x * q.x + (double)q.y * q.y + (double)q.z * q.z);
+    double x = (r.w * q.x - r.x * q.w - r.y * q.z + r.z * q.y) / n;
+    double y = (r.w * q.y + r.x * q.z - r.y * q.w - r.z * q.x) / n;
+    double z = (r.w * q.z - r.x * q.y + r.y * q.x - r.z * q.w) / n;
+    double s = sqrt(x * x + y * y + z * z);
+    return 2.0 * asin(s > 1.0 ? 1.0 : s);
+}
+
+struct policy_result
+{
+    uint32_t gyro_ns, accel_ns, mag_ns;
+    uint32_t accel_pad_ns, accel_flight_ns;
+    double rejected; // share of accel samples
+    double rms, flight_max, final_error; // rad
+};
+
+template <class AttitudePolicy>
+static policy_result run(const rate_log &log, double scale, bool gated)
+{
+    BasicEstimator<AttitudePolicy> est(SIGMA_ACCEL, SIGMA_GYRO, SIGMA_BARO, ACCEL_THRESHOLD);
+    if (!gated)
+        est.getAttitudeFilter().setGates(0.f, 0.f);
+    std::mt19937 rng(7);
+    std::normal_distribution<float> normal(0.f, 1.f);
+
+    // yawed 30 deg then tilted 10, the filters all start at identity
+    double half_tilt = 5.0 * DEG_TO_RAD, half_yaw = 15.0 * DEG_TO_RAD;
+    quatd truth{cos(half_tilt) * cos(half_yaw), sin(half_tilt) * cos(half_yaw),
+                sin(half_tilt) * sin(half_yaw), cos(half_tilt) * sin(half_yaw)};
+
+    const double gravity[3] = {0.0, 0.0, GRAVITY};
+    const double field[3] = {Bx, By, Bz};
+    double dt = IMU_PERIOD_US * 1e-6;
+    int samples = (int)(log.t.back() / dt);
+
+    int launch_k = (int)(LAUNCH_S / dt), burnout_k = (int)((LAUNCH_S + BURN_S) / dt);
+    int chute_k = (int)((LAUNCH_S + FLIGHT_S) / dt);
+    gnc::cpu_stats accel_pad{}, accel_flight{};
+
+    double sum = 0.0;
+    int checks = 0;
+    policy_result result{};
+    for (int k = 1; k <= samples; k++)
+    {
+        if (k == launch_k || k == chute_k)
+        {
+            // accel time per phase, the totals are added back at the end
+            estimator_cpu_stats cpu = est.getCpuStats();
+            (k == launch_k ? accel_pad : accel_flight) = cpu.accel;
+        }
+
+        double t = (k - 1) * dt;
+        for (int s = 0; s < REF_SUBSTEPS; s++)
+            truth = rk4_d(log, scale, truth, t + s * dt / REF_SUBSTEPS, dt / REF_SUBSTEPS);
+
+        double w[3], a[3], m[3];
+        rate_at(log, t + dt, scale, w);
+        rotate_inverse_d(truth, gravity, a);
+        rotate_inverse_d(truth, field, m);
+        if (k >= launch_k && k < chute_k)
+        {
+            a[0] = a[1] = 0.0;
+            a[2] = (k < burnout_k ? THRUST_G : -DRAG_G) * GRAVITY;
+        }
+
+        float gyro[3], accel[3], mag[3];
+        for (int i = 0; i < 3; i++)
+        {
+            gyro[i] = (float)w[i] + GYRO_BIAS[i] + GYRO_NOISE * normal(rng);
+            accel[i] = (float)a[i] + ACCEL_NOISE * normal(rng);
+            mag[i] = (float)m[i] + MAG_NOISE * normal(rng);
+        }
+
+        uint32_t t_us = (uint32_t)k * IMU_PERIOD_US;
+        est.addGyro(gyro, t_us);
+        est.addAccel(accel, t_us);
+        if (k % MAG_DIVIDER == 0)
+            est.addMag(mag, t_us);
+
+        if (k % CHECK_EVERY == 0 && k * dt >= SETTLE_S)
+        {
+            double err = angle_between(est.getAttitudeFilter().getQuaternion(), truth);
+            sum += err * err;
+            checks++;
+            if (k >= launch_k && k < chute_k && err > result.flight_max)
+                result.flight_max = err;
+            result.final_error = err;
+        }
+    }
+
+    estimator_cpu_stats cpu = est.getCpuStats();
+    result.gyro_ns = cpu.gyro.mean();
+    result.accel_ns = cpu.accel.mean();
+    result.mag_ns = cpu.mag.mean();
+    result.accel_pad_ns = accel_pad.mean();
+    // the stats are cumulative, so flight is what was added between the two snapshots
+    gnc::cpu_stats flight{accel_flight.calls - accel_pad.calls, 0, accel_flight.total - accel_pad.total};
+    result.accel_flight_ns = flight.mean();
+    const update_counts &accel = est.getAttitudeFilter().getUpdateStats().accel;
+    result.rejected = (double)(accel.off_gravity + accel.gated) / cpu.accel.calls;
+    result.rms = checks > 0 ? sqrt(sum / checks) : 0.0;
+    return result;
+}
+
+template <class AttitudePolicy>
+static void report(const char *name, const rate_log &log, double scale)
+{
+    for (int gated = 1; gated >= 0; gated--)
+    {
+        policy_result r = run<AttitudePolicy>(log, scale, gated);
+        // per second at these rates
+        double us_per_s = (r.gyro_ns + r.accel_ns) * (1e6 / IMU_PERIOD_US) / 1000.0 +
+                          r.mag_ns * (1e6 / IMU_PERIOD_US / MAG_DIVIDER) / 1000.0;
+        printf("%-9s %-5s %5u %5u %5u %5u %5.0f %5.1f%%  %7.2f %7.2f %7.2f\n", name, gated ? "gated" : "off",
+               r.gyro_ns, r.accel_pad_ns, r.accel_flight_ns, r.mag_ns, us_per_s, r.rejected * 100.0,
+               r.rms / DEG_TO_RAD, r.flight_max / DEG_TO_RAD, r.final_error / DEG_TO_RAD);
+    }
+}
+
+int main()
+{
+    rate_log log;
+    if (!load_log("../data/tf2.csv", log))
+    {
+        fprintf(stderr, "couldn't read ../data/tf2.csv\n");
+        return 1;
+    }
+
+    const double scales[] = {1.0, 20.0};
+    for (double scale : scales)
+    {
+        printf("\ntf2 gyro x%.0f, %.0f s, imu %d Hz, mag %d Hz\n", scale, log.t.back(), 1000000 / IMU_PERIOD_US,
+               1000000 / IMU_PERIOD_US / MAG_DIVIDER);
+        printf("                ns/sample: accel pad/flight       accel    error (deg)\n");
+        printf("policy    gates  gyro   pad  flt   mag  us/s  reject      rms  flt max   final\n");
+        report<ExtendedKalmanFilter>("ekf", log, scale);
+        report<UDExtendedKalmanFilter>("ekf-ud", log, scale);
+        report<AttitudeBiasMEKF>("mekf", log, scale);
+        report<MahonyFilter>("mahony", log, scale);
+        report<MadgwickFilter>("madgwick", log, scale);
+    }
+
+    return 0;
+}
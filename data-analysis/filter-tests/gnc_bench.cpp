@@ -0,0 +1,1081 @@
+/*
+    gnc_bench.cpp: Timing and accuracy checks for the gnc math kernels
+
+    - EKF covariance kernels, hand rolled loops vs gnc::Matrix. The "loops"
+      versions are the memset + triple loop code the EKF used before it moved
+      onto matrix.h, kept here verbatim-ish so the comparison stays honest.
+    - fastmath.h, sweeps every approximation against libm in double and fails
+      (non-zero exit) if any of the documented error bounds is exceeded, then
+      times each one against the float libm call it replaces.
+    - Estimator scheduling, lockstep vs multi-rate sensor updates on a
+      synthetic pitch oscillation: CPU per flight second and attitude error.
+    - Late altitude samples, fused at arrival as if current vs replayed from
+      the estimator's history ring, with the worst case catch-up cost.
+    - Gyro pre-integration, attitude drift and predict cost under coning
+      motion for a 1 kHz predict vs a 100 Hz predict from accumulated deltas.
+    - ZUPT detector, the old scan-the-window loop vs gnc::QuietDetector, and
+      a check that both give the same answer on every sample.
+    - Apogee predictor on a simulated quadratic drag coast: time and altitude
+      error ahead of apogee, learned drag vs plain ballistic.
+    - Mag calibration on a synthetic hard/soft-iron distorted field, turned
+      about like an airframe being handled: samples to converge, what's left
+      of the distortion, and the per-sample cost.
+    - Pad bias estimation over a simulated half hour on the pad warming up
+      in the sun with the rocket handled now and then: gyro / accel bias
+      error at launch vs the bench calibration.
+    - UD factored EKF covariance (udfactor.h) against the plain P, per
+      predict and per 3-axis update, and how far apart the two P are after
+      a few thousand steps of the same inputs.
+
+    Build and run with `make bench` (-O2), numbers are ns per call on the host.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "filters.h"
+#include "altitude.h"
+#include "apogee.h"
+#include "magcal.h"
+#include "padbias.h"
+
+using gnc::Matrix;
+using gnc::SymMatrix;
+
+static const int ITERATIONS = 2000000;
+
+// results get folded in here so the optimizer can't drop the work
+static volatile float sink;
+
+// ------------------------------------------------------------------
+// hand rolled versions
+// ------------------------------------------------------------------
+
+static void loops_predict(float P[4][4], const float F[4][4], float q)
+{
+    float tmp[4][4];
+    memset(tmp, 0, sizeof(tmp));
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            for (int k = 0; k < 4; k++)
+                tmp[r][c] += F[r][k] * P[k][c];
+
+    float PPred[4][4];
+    memset(PPred, 0, sizeof(PPred));
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            for (int k = 0; k < 4; k++)
+                PPred[r][c] += tmp[r][k] * F[c][k];
+
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            PPred[r][c] += (r == c) ? q : 0.f;
+
+    memcpy(P, PPred, sizeof(PPred));
+}
+
+static bool loops_invert3x3(float inv[3][3], const float a[3][3])
+{
+    float c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+    float c01 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+    float c02 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+    float det = a[0][0] * c00 + a[0][1] * c01 + a[0][2] * c02;
+    if (fabsf(det) < 1e-12f)
+        return false;
+    float s = 1.f / det;
+    inv[0][0] = s * c00;
+    inv[1][0] = s * c01;
+    inv[2][0] = s * c02;
+    inv[0][1] = s * (a[0][2] * a[2][1] - a[0][1] * a[2][2]);
+    inv[1][1] = s * (a[0][0] * a[2][2] - a[0][2] * a[2][0]);
+    inv[2][1] = s * (a[0][1] * a[2][0] - a[0][0] * a[2][1]);
+    inv[0][2] = s * (a[0][1] * a[1][2] - a[0][2] * a[1][1]);
+    inv[1][2] = s * (a[0][2] * a[1][0] - a[0][0] * a[1][2]);
+    inv[2][2] = s * (a[0][0] * a[1][1] - a[0][1] * a[1][0]);
+    return true;
+}
+
+static void loops_update(float P[4][4], float x[4], const float H[3][4], const float R[3][3], const float y[3])
+{
+    float tmp3x4[3][4];
+    memset(tmp3x4, 0, sizeof(tmp3x4));
+    for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 4; c++)
+            for (int k = 0; k < 4; k++)
+                tmp3x4[r][c] += H[r][k] * P[k][c];
+
+    float S[3][3];
+    memset(S, 0, sizeof(S));
+    for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 3; c++)
+            for (int k = 0; k < 4; k++)
+                S[r][c] += tmp3x4[r][k] * H[c][k];
+    for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 3; c++)
+            S[r][c] += R[r][c];
+
+    float tmp4x3[4][3];
+    memset(tmp4x3, 0, sizeof(tmp4x3));
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 3; c++)
+            for (int k = 0; k < 4; k++)
+                tmp4x3[r][c] += P[r][k] * H[c][k];
+
+    float Sinv[3][3];
+    if (!loops_invert3x3(Sinv, S))
+        return;
+
+    float K[4][3];
+    memset(K, 0, sizeof(K));
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 3; c++)
+            for (int k = 0; k < 3; k++)
+                K[r][c] += tmp4x3[r][k] * Sinv[k][c];
+
+    for (int i = 0; i < 4; i++)
+        x[i] += K[i][0] * y[0] + K[i][1] * y[1] + K[i][2] * y[2];
+
+    float tmp4x4[4][4];
+    memset(tmp4x4, 0, sizeof(tmp4x4));
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            for (int k = 0; k < 3; k++)
+                tmp4x4[r][c] += K[r][k] * H[k][c];
+
+    float IminusKH[4][4];
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            IminusKH[r][c] = (r == c ? 1.f : 0.f) - tmp4x4[r][c];
+
+    float PUpdated[4][4];
+    memset(PUpdated, 0, sizeof(PUpdated));
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            for (int k = 0; k < 4; k++)
+                PUpdated[r][c] += IminusKH[r][k] * P[k][c];
+    memcpy(P, PUpdated, sizeof(PUpdated));
+}
+
+// ------------------------------------------------------------------
+// gnc::Matrix versions, same math as ExtendedKalmanFilter
+// ------------------------------------------------------------------
+
+static void matrix_predict(SymMatrix<4> &P, const Matrix<4, 4> &F, float q)
+{
+    P = gnc::sandwich(F, P);
+    P.addDiagonal(q);
+}
+
+static void matrix_update(SymMatrix<4> &P, gnc::Vector<4> &x, const Matrix<3, 4> &H,
+                          const SymMatrix<3> &R, const gnc::Vector3f &y)
+{
+    Matrix<4, 3> PHt = gnc::multABt(static_cast<const Matrix<4, 4> &>(P), H);
+    Matrix<3, 3> S = H * PHt + R;
+    Matrix<3, 3> Sinv;
+    if (!gnc::inverse(S, Sinv))
+        return;
+    Matrix<4, 3> K = PHt * Sinv;
+    x += K * y;
+    P -= gnc::symmetricABt(K, PHt);
+}
+
+// ------------------------------------------------------------------
+
+template <typename Fn>
+static double time_ns(Fn fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+        fn(i);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / ITERATIONS;
+}
+
+// smallest angle between two headings, so +pi and -pi count as equal
+static double angle_err(double a, double b)
+{
+    double d = fabs(a - b);
+    return d > M_PI ? 2.0 * M_PI - d : d;
+}
+
+static bool check_bound(const char *name, double err, double bound)
+{
+    bool ok = err < bound;
+    printf("%-16s max err %10.3g   bound %8.3g   %s\n", name, err, bound, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+// sweep each fastmath kernel over its whole input range, bounds match fastmath.h
+static bool fastmath_sweep()
+{
+    double e_inv_sqrt = 0.0;
+    double e_sqrt = 0.0;
+    for (float x = 1e-8f; x < 1e8f; x *= 1.0001f)
+    {
+        double ref = sqrt((double)x);
+        e_inv_sqrt = fmax(e_inv_sqrt, fabs(gnc::fast_inv_sqrtf(x) * ref - 1.0));
+        e_sqrt = fmax(e_sqrt, fabs(gnc::fast_sqrtf(x) / ref - 1.0));
+    }
+
+    double e_atan2 = 0.0;
+    for (int i = -2000; i <= 2000; i++)
+    {
+        for (int j = -2000; j <= 2000; j++)
+        {
+            float y = i * 1e-3f;
+            float x = j * 1e-3f;
+            e_atan2 = fmax(e_atan2, angle_err(gnc::fast_atan2f(y, x), atan2((double)y, (double)x)));
+        }
+    }
+
+    double e_asin = 0.0;
+    for (int i = -1000000; i <= 1000000; i++)
+    {
+        float x = i * 1e-6f;
+        e_asin = fmax(e_asin, fabs(gnc::fast_asinf(x) - asin((double)x)));
+    }
+
+    // random attitudes, the reference euler angles come from the same
+    // (normalized) quaternion in double
+    double e_norm = 0.0;
+    double e_roll_yaw = 0.0;
+    double e_pitch = 0.0;
+    std::mt19937 gen(1);
+    std::normal_distribution<float> dist(0.f, 1.f);
+    for (int i = 0; i < 1000000; i++)
+    {
+        gnc::Quatf q{dist(gen), dist(gen), dist(gen), dist(gen)};
+        gnc::fast_normalize(q);
+        double w = q.w, x = q.x, y = q.y, z = q.z;
+        e_norm = fmax(e_norm, fabs(sqrt(w * w + x * x + y * y + z * z) - 1.0));
+
+        float roll, pitch, yaw;
+        gnc::fast_euler(q, roll, pitch, yaw);
+        double sp = fmin(1.0, fmax(-1.0, 2.0 * (w * y - x * z)));
+        e_roll_yaw = fmax(e_roll_yaw, angle_err(roll, atan2(w * x + y * z, 0.5 - (x * x + y * y))));
+        e_roll_yaw = fmax(e_roll_yaw, angle_err(yaw, atan2(x * y + w * z, 0.5 - (y * y + z * z))));
+        e_pitch = fmax(e_pitch, fabs(pitch - asin(sp)));
+    }
+
+    bool ok = true;
+    ok &= check_bound("fast_inv_sqrtf", e_inv_sqrt, 5e-6);
+    ok &= check_bound("fast_sqrtf", e_sqrt, 5e-6);
+    ok &= check_bound("fast_atan2f", e_atan2, 1.2e-5);
+    ok &= check_bound("fast_asinf", e_asin, 8e-5);
+    ok &= check_bound("fast_normalize", e_norm, 5e-6);
+    ok &= check_bound("euler roll/yaw", e_roll_yaw, 5e-5);
+    ok &= check_bound("euler pitch", e_pitch, 8e-5);
+    return ok;
+}
+
+static void fastmath_timing()
+{
+    // a table of inputs so nothing can be constant folded
+    static const int TABLE = 1024;
+    static float a[TABLE];
+    static float b[TABLE];
+    static gnc::Quatf q[TABLE];
+    std::mt19937 gen(2);
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    for (int i = 0; i < TABLE; i++)
+    {
+        a[i] = dist(gen);
+        b[i] = dist(gen);
+        q[i] = gnc::Quatf{dist(gen), dist(gen), dist(gen), dist(gen)};
+    }
+
+    double libm_inv_sqrt = time_ns([&](int i)
+                                   { sink = 1.f / sqrtf(a[i & (TABLE - 1)] + 1.5f); });
+    double fast_inv_sqrt = time_ns([&](int i)
+                                   { sink = gnc::fast_inv_sqrtf(a[i & (TABLE - 1)] + 1.5f); });
+    double libm_atan2 = time_ns([&](int i)
+                                { sink = atan2f(a[i & (TABLE - 1)], b[i & (TABLE - 1)]); });
+    double fast_atan2 = time_ns([&](int i)
+                                { sink = gnc::fast_atan2f(a[i & (TABLE - 1)], b[i & (TABLE - 1)]); });
+    double libm_asin = time_ns([&](int i)
+                               { sink = asinf(a[i & (TABLE - 1)]); });
+    double fast_asin = time_ns([&](int i)
+                               { sink = gnc::fast_asinf(a[i & (TABLE - 1)]); });
+    double libm_euler = time_ns([&](int i)
+                                {
+                                    const gnc::Quatf &p = q[i & (TABLE - 1)];
+                                    float n = 1.f / sqrtf(p.norm2());
+                                    float w = p.w * n, x = p.x * n, y = p.y * n, z = p.z * n;
+                                    sink = atan2f(w * x + y * z, 0.5f - (x * x + y * y)) +
+                                           asinf(2.f * (w * y - x * z)) +
+                                           atan2f(x * y + w * z, 0.5f - (y * y + z * z)); });
+    double fast_euler = time_ns([&](int i)
+                                {
+                                    gnc::Quatf p = q[i & (TABLE - 1)];
+                                    gnc::fast_normalize(p);
+                                    float roll, pitch, yaw;
+                                    gnc::fast_euler(p, roll, pitch, yaw);
+                                    sink = roll + pitch + yaw; });
+
+    printf("kernel               libm (ns)   fastmath (ns)   speedup\n");
+    printf("inverse sqrt         %9.1f   %13.1f   %6.2fx\n", libm_inv_sqrt, fast_inv_sqrt, libm_inv_sqrt / fast_inv_sqrt);
+    printf("atan2                %9.1f   %13.1f   %6.2fx\n", libm_atan2, fast_atan2, libm_atan2 / fast_atan2);
+    printf("asin                 %9.1f   %13.1f   %6.2fx\n", libm_asin, fast_asin, libm_asin / fast_asin);
+    printf("normalize + euler    %9.1f   %13.1f   %6.2fx\n", libm_euler, fast_euler, libm_euler / fast_euler);
+}
+
+struct schedule_result
+{
+    double cpu_ns_per_s;
+    double rms_pitch_err;
+    estimator_cpu_stats cpu;
+};
+
+// Rocket pitching +-0.2 rad at 8 Hz for 10 s. Each sensor is sampled at its
+// own period (us), 0 means "same as the gyro". Pitch error is checked at 100 Hz
+static schedule_result run_schedule(uint32_t gyro_us, uint32_t accel_us, uint32_t mag_us, uint32_t baro_us)
+{
+    const float amp = 0.2f;
+    const float omega = 2.f * GNC_PI * 8.f;
+    const uint32_t duration_us = 10000000;
+    const uint32_t check_us = 10000;
+
+    Estimator est(0.5f, 0.05f, 0.5f, 0.1f);
+    double err2 = 0.0;
+    int checks = 0;
+
+    // run on the finest grid any sensor needs, everything here divides 1 ms
+    for (uint32_t t = 0; t <= duration_us; t += 1000)
+    {
+        float ts = t * 1e-6f;
+        float theta = amp * sinf(omega * ts);
+        gnc::Quatf q = gnc::Quatf::fromRotationVector(gnc::vec3(0.f, theta, 0.f));
+
+        if (t % gyro_us == 0)
+        {
+            // rate about body y, sampled instantaneously
+            const float gyro[3] = {0.f, amp * omega * cosf(omega * ts), 0.f};
+            est.addGyro(gyro, t);
+        }
+        if (t % accel_us == 0)
+        {
+            float accel[3];
+            q.rotateInverse(gnc::vec3(0.f, 0.f, GRAVITY)).copyTo(accel);
+            est.addAccel(accel, t);
+        }
+        if (t % mag_us == 0)
+        {
+            float mag[3];
+            q.rotateInverse(gnc::vec3<float>(Bx, By, Bz)).copyTo(mag);
+            est.addMag(mag, t);
+        }
+        if (t % baro_us == 0)
+            est.addBaro(100.f, t);
+
+        if (t % check_us == 0 && t > 1000000)
+        {
+            float err = est.getEstimates().angles.pitch - theta;
+            err2 += err * err;
+            checks++;
+        }
+    }
+
+    schedule_result r;
+    r.cpu = est.getCpuStats();
+    double total = (double)r.cpu.gyro.total + r.cpu.accel.total + r.cpu.mag.total + r.cpu.baro.total;
+    r.cpu_ns_per_s = total / (duration_us * 1e-6);
+    r.rms_pitch_err = sqrt(err2 / checks);
+    return r;
+}
+
+static void print_schedule(const char *name, const schedule_result &r)
+{
+    printf("%-26s %9.0f  %10.2e   %6u %6u %6u %6u\n", name, r.cpu_ns_per_s / 1000.0, r.rms_pitch_err,
+           r.cpu.gyro.mean(), r.cpu.accel.mean(), r.cpu.mag.mean(), r.cpu.baro.mean());
+}
+
+static void estimator_schedules()
+{
+    printf("schedule                   us cpu/s   rms pitch   mean ns: gyro  accel    mag   baro\n");
+    print_schedule("lockstep 100 Hz", run_schedule(10000, 10000, 10000, 10000));
+    print_schedule("lockstep 1 kHz", run_schedule(1000, 1000, 1000, 1000));
+    print_schedule("multi-rate 1k/1k/100/50", run_schedule(1000, 1000, 10000, 20000));
+    print_schedule("multi-rate 1k/100/100/50", run_schedule(1000, 10000, 10000, 20000));
+}
+
+static const int DELAY_CHECKS = 1400;
+
+struct delay_result
+{
+    float altitude[DELAY_CHECKS]; // estimate every 10 ms from t = 1 s
+    delayed_fusion_stats stats;
+};
+
+// 3 s boost at 5 g then coast, level attitude, accel at 1 kHz. Altitude
+// samples every period_us, each one delivered delay_us after it was taken
+// and stamped either with when it was taken or when it arrived
+static void run_delay(uint32_t period_us, uint32_t delay_us, bool true_timestamps, delay_result &r)
+{
+    const uint32_t duration_us = 15000000;
+    const uint32_t burn_us = 3000000;
+    const float boost = 5.f * GRAVITY;
+    const float gyro[3] = {0.f, 0.f, 0.f};
+    const float mag[3] = {Bx, By, Bz};
+
+    Estimator est(0.5f, 0.05f, 0.5f, 0.1f);
+    int checks = 0;
+
+    auto truth_alt = [&](uint32_t t)
+    {
+        float ts = t * 1e-6f;
+        float tb = burn_us * 1e-6f;
+        if (t <= burn_us)
+            return 0.5f * boost * ts * ts;
+        float c = ts - tb;
+        return 0.5f * boost * tb * tb + boost * tb * c - 0.5f * GRAVITY * c * c;
+    };
+
+    // sample times of the altitude readings still in flight
+    uint32_t pending[64];
+    int pending_count = 0;
+
+    for (uint32_t t = 0; t <= duration_us; t += 1000)
+    {
+        // specific force, what a level accelerometer reads (nothing in coast)
+        float accel[3] = {0.f, 0.f, t <= burn_us ? GRAVITY + boost : 0.f};
+        est.addGyro(gyro, t);
+        est.addAccel(accel, t);
+        if (t % 10000 == 0)
+            est.addMag(mag, t);
+
+        if (t % period_us == 0)
+            pending[pending_count++] = t;
+        if (pending_count > 0 && t - pending[0] >= delay_us)
+        {
+            uint32_t taken = pending[0];
+            est.addBaro(truth_alt(taken), true_timestamps ? taken : t);
+            pending_count--;
+            for (int i = 0; i < pending_count; i++)
+                pending[i] = pending[i + 1];
+        }
+
+        if (t % 10000 == 0 && t > 1000000 && checks < DELAY_CHECKS)
+            r.altitude[checks++] = est.getEstimates().cf_results.altitude;
+    }
+
+    r.stats = est.getDelayStats();
+}
+
+static double rms_diff(const delay_result &a, const delay_result &b)
+{
+    double sum = 0.0;
+    for (int i = 0; i < DELAY_CHECKS; i++)
+        sum += (double)(a.altitude[i] - b.altitude[i]) * (a.altitude[i] - b.altitude[i]);
+    return sqrt(sum / DELAY_CHECKS);
+}
+
+static void delayed_fusion()
+{
+    struct
+    {
+        const char *name;
+        uint32_t period_us;
+        uint32_t delay_us;
+    } cases[] = {
+        {"baro 50 Hz, 20 ms late", 20000, 20000},
+        {"gps 10 Hz, 200 ms late", 100000, 200000},
+    };
+
+    // altitude error is measured against the same filter fed on time, so it
+    // only shows what the delay costs and not the filter's own tracking error
+    static delay_result on_time, naive, replay;
+    printf("case                      rms alt diff vs on time (m)  replay    max     worst replay ns\n");
+    printf("                             as current    replayed    samples  replayed   (mean)\n");
+    for (const auto &c : cases)
+    {
+        run_delay(c.period_us, 0, true, on_time);
+        run_delay(c.period_us, c.delay_us, false, naive);
+        run_delay(c.period_us, c.delay_us, true, replay);
+        printf("%-26s %10.3f %11.3f %11u %9u %8u (%u)\n", c.name, rms_diff(naive, on_time), rms_diff(replay, on_time),
+               replay.stats.late, replay.stats.max_replayed, replay.stats.catch_up.max, replay.stats.catch_up.mean());
+        if (replay.stats.overruns)
+            printf("  %u samples were older than the history ring\n", replay.stats.overruns);
+    }
+}
+
+// rotation vector of a unit quaternion (log map)
+static gnc::Vector<3, double> rotation_vector(const gnc::Quat<double> &q)
+{
+    double s = sqrt(q.x * q.x + q.y * q.y + q.z * q.z);
+    if (s < 1e-15)
+        return gnc::vec3(2.0 * q.x, 2.0 * q.y, 2.0 * q.z);
+    double angle = 2.0 * atan2(s, q.w);
+    return gnc::vec3(q.x, q.y, q.z) * (angle / s);
+}
+
+enum coning_mode
+{
+    CONING_PREDICT_1KHZ, // predict() on every sample
+    CONING_DELTA_1KHZ,   // predictDelta() on every sample
+    CONING_PREINT,       // ImuPreintegrator, predictDelta() at 100 Hz
+    CONING_SUMMED,       // plain sum of the samples, predictDelta() at 100 Hz
+};
+
+// Coning: the body's rotation vector sweeps a 0.1 rad cone at 5 Hz, which
+// gives a steady drift about the cone axis that only shows up if the
+// non-commuting part of the rotation is kept. Predict only, no updates.
+// Returns the attitude error (rad) after 10 s, cpu_ns is the predict cost
+// per second of motion. The gyro here reports the mean rate over each
+// sample, which is what predictDelta() assumes. predict() reads samples as
+// point rates and interpolates between them (quatprop.h), so it is a little
+// off on this input
+static double run_coning(coning_mode mode, double &cpu_ns)
+{
+    const double cone = 0.1;
+    const double rate = 2.0 * M_PI * 5.0;
+    const int imu_hz = 1000;
+    const int decimation = 10;
+    const int samples = 10 * imu_hz;
+    const float dt = 1.f / imu_hz;
+
+    auto truth = [&](int k)
+    {
+        double t = (double)k / imu_hz;
+        return gnc::Quat<double>::fromRotationVector(gnc::vec3(cone * cos(rate * t), cone * sin(rate * t), 0.0));
+    };
+
+    ExtendedKalmanFilter ekf(0.05f);
+    ImuPreintegrator preint;
+    float summed[3] = {0.f, 0.f, 0.f};
+    gnc::Quat<double> prev = truth(0);
+    // the filter starts at identity, so track the truth relative to its start
+    gnc::Quat<double> start = prev.conjugate();
+    uint64_t cycles = 0;
+
+    for (int k = 1; k <= samples; k++)
+    {
+        // what an ideal gyro would report: the mean rate over the sample
+        gnc::Quat<double> curr = truth(k);
+        gnc::Vector<3, double> inc = rotation_vector(prev.conjugate() * curr);
+        prev = curr;
+        const float gyro[3] = {(float)inc(0) / dt, (float)inc(1) / dt, (float)inc(2) / dt};
+
+        uint32_t t0 = gnc::cycle_count();
+        switch (mode)
+        {
+        case CONING_PREDICT_1KHZ:
+            ekf.predict(gyro, dt);
+            break;
+        case CONING_DELTA_1KHZ:
+        {
+            const float dtheta[3] = {gyro[0] * dt, gyro[1] * dt, gyro[2] * dt};
+            ekf.predictDelta(dtheta, dt);
+            break;
+        }
+        case CONING_PREINT:
+            preint.addSample(gyro, nullptr, dt);
+            if (preint.samples() == decimation)
+            {
+                imu_delta delta = preint.take();
+                float dtheta[3];
+                delta.dtheta.copyTo(dtheta);
+                ekf.predictDelta(dtheta, delta.dt);
+            }
+            break;
+        case CONING_SUMMED:
+            for (int i = 0; i < 3; i++)
+                summed[i] += gyro[i] * dt;
+            if (k % decimation == 0)
+            {
+                ekf.predictDelta(summed, decimation * dt);
+                summed[0] = summed[1] = summed[2] = 0.f;
+            }
+            break;
+        }
+        cycles += gnc::cycle_count() - t0;
+    }
+
+    cpu_ns = (double)cycles / (samples / imu_hz);
+
+    const State &q = ekf.getQuaternion();
+    gnc::Quat<double> est{q.w, q.x, q.y, q.z};
+    gnc::Quat<double> err = est.conjugate() * (start * prev);
+    return gnc::norm(rotation_vector(err));
+}
+
+static void preintegration()
+{
+    const char *names[] = {"predict 1 kHz", "predictDelta 1 kHz", "preintegrated, 100 Hz", "summed gyro, 100 Hz"};
+    printf("coning 0.1 rad @ 5 Hz, 10 s     drift (deg)   predict us/s\n");
+    for (int mode = CONING_PREDICT_1KHZ; mode <= CONING_SUMMED; mode++)
+    {
+        double cpu_ns;
+        double err = run_coning((coning_mode)mode, cpu_ns);
+        printf("%-30s %12.4f %14.1f\n", names[mode], err * 180.0 / M_PI, cpu_ns / 1000.0);
+    }
+}
+
+// ------------------------------------------------------------------
+// zero-velocity detector
+// ------------------------------------------------------------------
+
+// what ComplementaryFilter::applyZUPT did before quiet.h
+template <int N>
+struct scan_zupt
+{
+    float ring[N] = {};
+    int idx = 0;
+
+    bool add(float accel, float threshold)
+    {
+        ring[idx] = accel;
+        idx = (idx + 1) % N;
+        for (int k = 0; k < N; k++)
+            if (fabsf(ring[k]) > threshold)
+                return false;
+        return true;
+    }
+};
+
+template <int N>
+static void zupt_window()
+{
+    const float threshold = 0.1f;
+    // pad noise with the odd bump, so the answer flips both ways
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.f, 0.03f);
+    static float stream[4096];
+    for (int i = 0; i < 4096; i++)
+        stream[i] = noise(rng) + ((i % 700) < 20 ? 0.5f : 0.f);
+
+    scan_zupt<N> scan;
+    gnc::QuietDetector<N> quiet(N, threshold);
+    int mismatches = 0;
+    for (int i = 0; i < 4096; i++)
+        mismatches += scan.add(stream[i], threshold) != quiet.add(stream[i]);
+
+    double scan_ns = time_ns([&](int i)
+                             { sink = scan.add(stream[i & 4095], threshold); });
+    double quiet_ns = time_ns([&](int i)
+                              { sink = quiet.add(stream[i & 4095]); });
+    printf("window %-3d %16.1f %13.1f   %6.2fx   %d\n", N, scan_ns, quiet_ns, scan_ns / quiet_ns, mismatches);
+}
+
+static void zupt_detector()
+{
+    printf("zupt        scan (ns)   quiet.h (ns)   speedup   mismatches\n");
+    zupt_window<32>();
+    zupt_window<64>();
+}
+
+// ------------------------------------------------------------------
+// apogee predictor
+// ------------------------------------------------------------------
+
+// coast from burnout with dv/dt = -g - k v^2, predictor fed at 100 Hz with
+// the true altitude and velocity and the accel with optional noise. Prints
+// the prediction error at a few lead times before the true apogee
+static void apogee_case(const char *name, float accel_noise, bool learn)
+{
+    const double g = GRAVITY, k = 3e-4, dt = 0.01;
+    const int sub = 10;
+
+    // true apogee from a fine RK4 run
+    auto deriv = [&](double v)
+    { return -g - k * v * fabs(v); };
+    std::vector<double> h_track, v_track;
+    double h = 500.0, v = 220.0;
+    while (v > 0.0)
+    {
+        h_track.push_back(h);
+        v_track.push_back(v);
+        for (int s = 0; s < sub; s++)
+        {
+            double ds = dt / sub;
+            double k1v = deriv(v), k1h = v;
+            double k2v = deriv(v + 0.5 * ds * k1v), k2h = v + 0.5 * ds * k1v;
+            double k3v = deriv(v + 0.5 * ds * k2v), k3h = v + 0.5 * ds * k2v;
+            double k4v = deriv(v + ds * k3v), k4h = v + ds * k3v;
+            h += ds / 6.0 * (k1h + 2.0 * k2h + 2.0 * k3h + k4h);
+            v += ds / 6.0 * (k1v + 2.0 * k2v + 2.0 * k3v + k4v);
+        }
+    }
+    // last step overshot v = 0, close enough to interpolate the crossing
+    size_t n = v_track.size();
+    double frac = v_track[n - 1] / (v_track[n - 1] - v);
+    double t_apogee = (n - 1 + frac) * dt;
+    double h_apogee = h_track[n - 1] + 0.5 * v_track[n - 1] * frac * dt;
+
+    const double leads[] = {10.0, 5.0, 2.0, 1.0, 0.5};
+    ApogeePredictor predictor;
+    std::mt19937 rng(3);
+    std::normal_distribution<float> noise(0.f, accel_noise);
+    printf("%-22s", name);
+    int next = 0;
+    for (size_t i = 0; i < n && next < 5; i++)
+    {
+        float a = (float)deriv(v_track[i]) + (accel_noise > 0.f ? noise(rng) : 0.f);
+        apogee_prediction p = predictor.update((float)h_track[i], (float)v_track[i], a, learn);
+        double t_left = t_apogee - i * dt;
+        if (t_left <= leads[next])
+        {
+            printf("  %+6.0f ms %+6.1f m", (p.time_to_apogee - t_left) * 1000.0, p.altitude - h_apogee);
+            next++;
+        }
+    }
+    printf("\n");
+}
+
+static void apogee_predictor()
+{
+    printf("%-22s%20s%20s%20s%20s%20s\n", "apogee error, k 3e-4", "10 s before", "5 s", "2 s", "1 s", "0.5 s");
+    apogee_case("ballistic (k = 0)", 0.f, false);
+    apogee_case("learned k", 0.f, true);
+    apogee_case("learned k, 0.5 m/s^2", 0.5f, true);
+
+    ApogeePredictor predictor;
+    double ns = time_ns([&](int i)
+                        { sink = predictor.update(1000.f, 80.f + (i & 63), -12.f, true).time_to_apogee; });
+    printf("update: %.1f ns\n", ns);
+}
+
+// ------------------------------------------------------------------
+// mag calibration
+// ------------------------------------------------------------------
+
+// raw = W * field + bias, |field| = 50 uT, field direction in the body
+// wandering like an airframe being picked up and turned over. With
+// one_axis it only turns about body z (e.g. rolled on a rail), which
+// doesn't pin down the ellipsoid and must not pass as converged
+static void magcal_case(const char *name, bool one_axis, float noise_ut)
+{
+    const double W[3][3] = {{1.10, 0.06, -0.03}, {0.02, 0.93, 0.05}, {-0.04, 0.03, 1.02}};
+    const double bias[3] = {25.0, -12.0, 40.0};
+    const double field = 50.0;
+
+    std::mt19937 rng(11);
+    std::normal_distribution<double> step(0.0, 0.05);
+    std::normal_distribution<float> noise(0.f, noise_ut);
+    double d[3] = {0.3, -0.5, 0.8};
+    auto next_raw = [&](double truth[3], float raw[3])
+    {
+        if (one_axis)
+        {
+            double a = atan2(d[1], d[0]) + fabs(step(rng)) * 2.0;
+            d[0] = 0.8 * cos(a);
+            d[1] = 0.8 * sin(a);
+            d[2] = 0.6;
+        }
+        else
+        {
+            for (int i = 0; i < 3; i++)
+                d[i] += step(rng);
+            double n = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+            for (int i = 0; i < 3; i++)
+                d[i] /= n;
+        }
+        for (int r = 0; r < 3; r++)
+        {
+            truth[r] = field * d[r];
+            raw[r] = (float)(W[r][0] * field * d[0] + W[r][1] * field * d[1] + W[r][2] * field * d[2] +
+                             bias[r]) + noise(rng);
+        }
+    };
+
+    MagCalibrator cal;
+    double truth[3];
+    float raw[3];
+    int converged_at = -1;
+    for (int i = 0; i < 20000 && converged_at < 0; i++)
+    {
+        next_raw(truth, raw);
+        cal.add(raw);
+        if (cal.converged())
+            converged_at = i + 1;
+    }
+    const mag_calibration &c = cal.getCalibration();
+    double bias_err = sqrt((c.bias[0] - bias[0]) * (c.bias[0] - bias[0]) + (c.bias[1] - bias[1]) * (c.bias[1] - bias[1]) +
+                           (c.bias[2] - bias[2]) * (c.bias[2] - bias[2]));
+
+    // on fresh samples: corrected magnitude vs radius, and the angle of each
+    // sample to the first one vs the true angle (soft iron is only known up
+    // to a rotation, angles are what the attitude filter cares about)
+    auto angle = [](const double *a, const double *b)
+    {
+        double dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        double na = sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+        double nb = sqrt(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+        return acos(fmax(-1.0, fmin(1.0, dot / (na * nb))));
+    };
+    double mag_sq = 0.0, ang_sq = 0.0, ang_raw_sq = 0.0;
+    double first_truth[3] = {0.0, 0.0, 1.0}, first_out[3] = {0.0, 0.0, 1.0}, first_raw[3] = {0.0, 0.0, 1.0};
+    const int checks = 2000;
+    for (int i = 0; i <= checks; i++)
+    {
+        next_raw(truth, raw);
+        float out_f[3];
+        cal.correct(raw, out_f);
+        double out[3] = {out_f[0], out_f[1], out_f[2]}, r[3] = {raw[0], raw[1], raw[2]};
+        double n = sqrt(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+        mag_sq += (n / c.radius - 1.0) * (n / c.radius - 1.0);
+        if (i == 0)
+        {
+            memcpy(first_truth, truth, sizeof(first_truth));
+            memcpy(first_out, out, sizeof(first_out));
+            memcpy(first_raw, r, sizeof(first_raw));
+            continue;
+        }
+        double want = angle(truth, first_truth);
+        ang_sq += (angle(out, first_out) - want) * (angle(out, first_out) - want);
+        ang_raw_sq += (angle(r, first_raw) - want) * (angle(r, first_raw) - want);
+    }
+
+    char when[16];
+    if (converged_at > 0)
+        snprintf(when, sizeof(when), "%d", converged_at);
+    else
+        snprintf(when, sizeof(when), "no");
+    printf("%-22s %9s %9.2f %9.2f %11.2f%% %10.3f %10.3f\n", name, when, bias_err, c.axis_ratio,
+           100.0 * sqrt(mag_sq / (checks + 1)), sqrt(ang_raw_sq / checks) / M_PI * 180.0,
+           sqrt(ang_sq / checks) / M_PI * 180.0);
+}
+
+static void mag_calibration()
+{
+    printf("mag calibration        converged  |db| uT  axis ratio  |m| error  raw ang (deg)  cal ang (deg)\n");
+    magcal_case("tumbling, 0.5 uT", false, 0.5f);
+    magcal_case("tumbling, 2 uT", false, 2.f);
+    magcal_case("rolled about z only", true, 0.5f);
+
+    MagCalibrator cal;
+    float raw[64][3];
+    for (int i = 0; i < 64; i++)
+    {
+        raw[i][0] = 30.f + 50.f * cosf(i * 0.4f) * cosf(i * 0.13f);
+        raw[i][1] = -10.f + 50.f * sinf(i * 0.4f) * cosf(i * 0.13f);
+        raw[i][2] = 40.f + 50.f * sinf(i * 0.13f);
+    }
+    double ns = time_ns([&](int i)
+                        { cal.add(raw[i & 63]); sink = cal.getCalibration().radius; });
+    printf("add: %.1f ns (solve every %d samples included)\n", ns, MAGCAL_SOLVE_INTERVAL);
+}
+
+// ------------------------------------------------------------------
+// pad bias
+// ------------------------------------------------------------------
+
+// 100 Hz IMU on the pad, gravity along body +z, temperature 25 -> 35 C over
+// the run with the gyro bias following it. 20 s of handling every 5 min
+static void pad_bias_estimation()
+{
+    const int rate = 100, seconds = 1800;
+    const double k_temp[3] = {4e-4, -3e-4, 2e-4}; // rad/s per deg C
+    const double b25[3] = {0.004, -0.006, 0.002};  // what the bench calibration left
+    const double accel_bias = 0.15;                // m/s^2 along z
+
+    std::mt19937 rng(5);
+    std::normal_distribution<float> gyro_noise(0.f, 0.002f), accel_noise(0.f, 0.02f), jerk(0.f, 1.f);
+    PadBiasEstimator est;
+    double temp = 25.0, true_bias[3] = {0.0, 0.0, 0.0};
+    int still = 0;
+    for (int i = 0; i < rate * seconds; i++)
+    {
+        double t = (double)i / rate;
+        temp = 25.0 + 10.0 * t / seconds;
+        bool handled = fmod(t, 300.0) >= 280.0;
+        float gyro[3], accel[3];
+        for (int a = 0; a < 3; a++)
+        {
+            true_bias[a] = b25[a] + k_temp[a] * (temp - 25.0);
+            gyro[a] = (float)true_bias[a] + gyro_noise(rng) + (handled ? 0.3f * jerk(rng) : 0.f);
+            accel[a] = accel_noise(rng) + (handled ? jerk(rng) : 0.f);
+        }
+        accel[2] += (float)(GRAVITY + accel_bias);
+        still += est.add(gyro, accel, (float)(temp + 0.1 * gyro_noise(rng) / 0.002));
+    }
+
+    const pad_bias &b = est.getBias();
+    float at_launch[3];
+    est.gyroBiasAt((float)temp, at_launch);
+    auto err = [&](const float *g)
+    {
+        double e = 0.0;
+        for (int a = 0; a < 3; a++)
+            e += (g[a] - true_bias[a]) * (g[a] - true_bias[a]);
+        return sqrt(e) * 1000.0;
+    };
+    const float bench[3] = {(float)b25[0], (float)b25[1], (float)b25[2]};
+    printf("pad bias, %d min, 25 -> 35 C, %u segments, %.0f%% of samples still\n", seconds / 60, b.segments,
+           100.0 * still / (rate * seconds));
+    printf("gyro bias error at launch (mrad/s): bench cal %.2f, last segment %.2f, carried to launch temp %.2f\n",
+           err(bench), err(b.gyro), err(at_launch));
+    printf("accel bias along g: true %.3f, estimated %.3f m/s^2\n", accel_bias, b.accel[2]);
+
+    float gyro[64][3], accel[64][3];
+    for (int i = 0; i < 64; i++)
+        for (int a = 0; a < 3; a++)
+        {
+            gyro[i][a] = gyro_noise(rng);
+            accel[i][a] = accel_noise(rng) + (a == 2 ? GRAVITY : 0.f);
+        }
+    double ns = time_ns([&](int i)
+                        { sink = est.add(gyro[i & 63], accel[i & 63], 30.f); });
+    printf("add: %.1f ns\n", ns);
+}
+
+// same 3-axis update on the factors, one axis at a time as the EKF does it
+static void ud_update(gnc::UDFactor<4> &P, gnc::Vector<4> &x, const Matrix<3, 4> &H,
+                      const SymMatrix<3> &R, const gnc::Vector3f &y)
+{
+    gnc::Vector<4> dx = gnc::Vector<4>::zeros();
+    for (int i = 0; i < 3; i++)
+    {
+        gnc::Vector<4> h = H.block<1, 4>(i, 0).transpose();
+        gnc::Vector<4> k;
+        P.update(h, R[i][i], k);
+        dx += k * (y(i) - gnc::dot(h, dx));
+    }
+    x += dx;
+}
+
+static void ud_covariance(const Matrix<4, 4> &F, const Matrix<3, 4> &H, const SymMatrix<3> &R,
+                          const gnc::Vector3f &y, float q)
+{
+    SymMatrix<4> P = SymMatrix<4>::diagonal(0.1f);
+    gnc::UDFactor<4> U = gnc::UDFactor<4>::diagonal(0.1f);
+    double full_pred = time_ns([&](int)
+                               { matrix_predict(P, F, q); sink = P[1][2]; });
+    double ud_pred = time_ns([&](int)
+                             { U.propagate(F, q); sink = U.ud[1][2]; });
+
+    gnc::Vector<4> x = gnc::Vector<4>::zeros();
+    double full_upd = time_ns([&](int)
+                              {
+                                  SymMatrix<4> P0 = SymMatrix<4>::diagonal(0.1f);
+                                  matrix_update(P0, x, H, R, y);
+                                  sink = P0[0][1] + x(2); });
+    double ud_upd = time_ns([&](int)
+                            {
+                                gnc::UDFactor<4> U0 = gnc::UDFactor<4>::diagonal(0.1f);
+                                ud_update(U0, x, H, R, y);
+                                sink = U0.ud[0][1] + x(2); });
+
+    // both from the same start through the same predict / update cycle
+    P = SymMatrix<4>::diagonal(0.1f);
+    U = gnc::UDFactor<4>::diagonal(0.1f);
+    gnc::Vector<4> x_full = gnc::Vector<4>::zeros(), x_ud = gnc::Vector<4>::zeros();
+    const int steps = 5000;
+    for (int i = 0; i < steps; i++)
+    {
+        matrix_predict(P, F, q);
+        U.propagate(F, q);
+        matrix_update(P, x_full, H, R, y);
+        ud_update(U, x_ud, H, R, y);
+    }
+    SymMatrix<4> P_ud = U.covariance();
+    double diff = 0.0, scale = 0.0, dx = 0.0;
+    for (int r = 0; r < 4; r++)
+    {
+        dx = fmax(dx, fabs(x_full(r) - x_ud(r)));
+        for (int c = 0; c < 4; c++)
+        {
+            diff = fmax(diff, fabs(P[r][c] - P_ud[r][c]));
+            scale = fmax(scale, fabs(P[r][c]));
+        }
+    }
+
+    printf("covariance form      full P (ns)   UD (ns)   ratio\n");
+    printf("predict  FPF^T + Q   %11.1f   %7.1f   %5.2fx\n", full_pred, ud_pred, ud_pred / full_pred);
+    printf("update   3-axis      %11.1f   %7.1f   %5.2fx\n", full_upd, ud_upd, ud_upd / full_upd);
+    printf("after %d steps: max |P - UDU^T| %.2e of max |P| %.2e, max |dx| %.2e\n", steps, diff, scale, dx);
+}
+
+int main()
+{
+    // inputs roughly what the EKF sees mid flight
+    const float gyro[3] = {0.3f, -0.2f, 0.1f};
+    const float dt = 0.05f;
+    const Matrix<4, 4> F = Matrix<4, 4>::identity() +
+                           Matrix<4, 4>{{{0.f, -gyro[0], -gyro[1], -gyro[2]},
+                                         {gyro[0], 0.f, gyro[2], -gyro[1]},
+                                         {gyro[1], -gyro[2], 0.f, gyro[0]},
+                                         {gyro[2], gyro[1], -gyro[0], 0.f}}} *
+                               (0.5f * dt);
+    const Matrix<3, 4> H{{{-1.2f, 0.4f, -19.0f, 0.9f},
+                          {0.8f, 19.0f, 1.1f, -0.3f},
+                          {19.5f, -0.5f, 0.7f, 1.3f}}};
+    const SymMatrix<3> R = SymMatrix<3>::diagonal(0.25f);
+    const gnc::Vector3f y = gnc::vec3(0.05f, -0.02f, 0.01f);
+    const float q = 1e-5f;
+
+    float F_raw[4][4], H_raw[3][4], R_raw[3][3];
+    F.copyTo(&F_raw[0][0]);
+    H.copyTo(&H_raw[0][0]);
+    R.copyTo(&R_raw[0][0]);
+    const float y_raw[3] = {y(0), y(1), y(2)};
+
+    // predict
+    float P_raw[4][4];
+    SymMatrix<4> P = SymMatrix<4>::diagonal(0.1f);
+    P.copyTo(&P_raw[0][0]);
+    double loops_pred = time_ns([&](int)
+                                { loops_predict(P_raw, F_raw, q); sink = P_raw[1][2]; });
+    double matrix_pred = time_ns([&](int)
+                                 { matrix_predict(P, F, q); sink = P[1][2]; });
+
+    // update, P is reset every call so it doesn't collapse to zero
+    float x_raw[4] = {1.f, 0.f, 0.f, 0.f};
+    gnc::Vector<4> x = gnc::Vector<4>::zeros();
+    double loops_upd = time_ns([&](int)
+                               {
+                                   float P0[4][4];
+                                   SymMatrix<4>::diagonal(0.1f).copyTo(&P0[0][0]);
+                                   loops_update(P0, x_raw, H_raw, R_raw, y_raw);
+                                   sink = P0[0][1] + x_raw[2]; });
+    double matrix_upd = time_ns([&](int)
+                                {
+                                    SymMatrix<4> P0 = SymMatrix<4>::diagonal(0.1f);
+                                    matrix_update(P0, x, H, R, y);
+                                    sink = P0[0][1] + x(2); });
+
+    // sanity check that both paths agree on a single update
+    float P_check[4][4];
+    SymMatrix<4>::diagonal(0.1f).copyTo(&P_check[0][0]);
+    float x_check[4] = {0.f, 0.f, 0.f, 0.f};
+    loops_update(P_check, x_check, H_raw, R_raw, y_raw);
+    SymMatrix<4> P_m = SymMatrix<4>::diagonal(0.1f);
+    gnc::Vector<4> x_m = gnc::Vector<4>::zeros();
+    matrix_update(P_m, x_m, H, R, y);
+    float max_err = 0.f;
+    for (int r = 0; r < 4; r++)
+    {
+        max_err = fmaxf(max_err, fabsf(x_check[r] - x_m(r)));
+        for (int c = 0; c < 4; c++)
+            max_err = fmaxf(max_err, fabsf(P_check[r][c] - P_m[r][c]));
+    }
+
+    printf("kernel               loops (ns)   matrix.h (ns)   speedup\n");
+    printf("predict  FPF^T + Q   %10.1f   %13.1f   %6.2fx\n", loops_pred, matrix_pred, loops_pred / matrix_pred);
+    printf("update   3-axis      %10.1f   %13.1f   %6.2fx\n", loops_upd, matrix_upd, loops_upd / matrix_upd);
+    printf("max |loops - matrix| after one update: %g\n\n", max_err);
+
+    bool ok = fastmath_sweep();
+    printf("\n");
+    fastmath_timing();
+    printf("\n");
+    estimator_schedules();
+    printf("\n");
+    delayed_fusion();
+    printf("\n");
+    preintegration();
+    printf("\n");
+    zupt_detector();
+    printf("\n");
+    apogee_predictor();
+    printf("\n");
+    mag_calibration();
+    printf("\n");
+    pad_bias_estimation();
+    printf("\n");
+    ud_covariance(F, H, R, y, q);
+
+    return ok ? 0 : 1;
+}
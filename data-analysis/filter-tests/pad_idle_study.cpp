@@ -0,0 +1,317 @@
+/*
+    pad_idle_study.cpp: Long pad idle, plain vs UD factored EKF covariance
+
+    The rocket can sit on the pad for hours with the EKF running at the IMU
+    rate, which is the case where a float covariance goes bad: every update
+    takes P down a little more and P = (I - KH)P is a difference of nearly
+    equal numbers. Without the mag (disturbed by the pad, or left out) it
+    is worse, yaw isn't observed so its variance grows without bound while
+    the tilt's stays tiny, and the spread between them is what the rounding
+    has to survive.
+
+    tf2.csv only has a couple of seconds before ignition, so it is the
+    statistics of those that get replayed: the mean accel gives the
+    attitude on the pad, the mean gyro the bias, and the sample spread of
+    each channel the noise, drawn at 500 Hz (mag at 100 Hz) for as long as
+    asked. The mag is made from the attitude and the B_E field, since the
+    filters don't model the dip, with the log's relative noise.
+
+    Each filter form runs the same samples for each tuning, with and
+    without the mag. P is checked once a second by an LDL^T in double: a
+    check where it isn't positive definite, or where the tilt is off by
+    more than TILT_LIMIT_DEG, counts as diverged. Reported per hour of
+    idle, with when the first one happened, the smallest pivot seen
+    relative to the largest, the tilt error at the end, and the time per
+    sample (ns on the host, cycles on the ESP32).
+
+    Build and run with `make padstudy` (-O2), extra arguments through
+    PAD_ARGS, e.g. make padstudy PAD_ARGS="--hours 8"
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "filters.h"
+#include "cycles.h"
+#include "StateDetermination.h"
+
+using gnc::Quatf;
+using gnc::SymMatrix;
+using gnc::Vector3f;
+
+static const int STATE_INDEX = 0;
+static const int ACCEL_INDEX = 10; // x, y, z follow
+static const int MAG_INDEX = 13;
+static const int GYRO_INDEX = 16;
+
+static const double DEG_TO_RAD = M_PI / 180.0;
+static const float IMU_DT = 0.002f;
+static const int MAG_DIVIDER = 5;
+static const int CHECK_EVERY = 500; // imu samples, once a second
+static const double SETTLE_S = 60.0;
+static const double TILT_LIMIT_DEG = 5.0;
+
+// mean and sample std dev of each channel on the pad
+struct pad_stats
+{
+    double accel[3], accel_sd[3];
+    double gyro[3], gyro_sd[3];
+    double mag_sd; // relative to |B|
+};
+
+static bool load_pad(const char *path, pad_stats &s)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        return false;
+
+    // everything up to the first event row (ignition) is on the pad
+    std::vector<double> a[3], g[3], m[3];
+    std::string line;
+    std::getline(file, line); // header
+    while (std::getline(file, line))
+    {
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, ','))
+            fields.push_back(field);
+        if ((int)fields.size() <= GYRO_INDEX + 2)
+            continue;
+        if (!a[0].empty() && fields[STATE_INDEX] != "6")
+            break;
+        for (int i = 0; i < 3; i++)
+        {
+            a[i].push_back(std::stod(fields[ACCEL_INDEX + i]));
+            m[i].push_back(std::stod(fields[MAG_INDEX + i]));
+            g[i].push_back(std::stod(fields[GYRO_INDEX + i]) * DEG_TO_RAD);
+        }
+    }
+    int n = (int)a[0].size();
+    if (n < 10)
+        return false;
+
+    auto mean_sd = [n](const std::vector<double> &v, double &mean, double &sd)
+    {
+        mean = 0.0;
+        for (double x : v)
+            mean += x / n;
+        double ss = 0.0;
+        for (double x : v)
+            ss += (x - mean) * (x - mean);
+        sd = sqrt(ss / (n - 1));
+    };
+    double m_mean[3], m_sd[3], m_norm2 = 0.0, m_var = 0.0;
+    for (int i = 0; i < 3; i++)
+    {
+        mean_sd(a[i], s.accel[i], s.accel_sd[i]);
+        mean_sd(g[i], s.gyro[i], s.gyro_sd[i]);
+        mean_sd(m[i], m_mean[i], m_sd[i]);
+        m_norm2 += m_mean[i] * m_mean[i];
+        m_var += m_sd[i] * m_sd[i];
+    }
+    s.mag_sd = sqrt(m_var / 3.0 / m_norm2);
+    return true;
+}
+
+// attitude that reads the mean accel as gravity, with no yaw about earth z
+static Quatf pad_attitude(const pad_stats &s)
+{
+    // body frame gravity direction, R^T e_z = a / |a|, rotate e_z onto it
+    // and invert, so the quaternion rotates body into earth
+    Vector3f a = gnc::vec3((float)s.accel[0], (float)s.accel[1], (float)s.accel[2]);
+    gnc::fast_normalize(a);
+    Vector3f z = gnc::vec3(0.f, 0.f, 1.f);
+    Vector3f axis = gnc::cross(a, z);
+    float c = gnc::dot(a, z);
+    // half angle quaternion from the two vectors, fine away from a = -z
+    Quatf q{1.f + c, axis(0), axis(1), axis(2)};
+    gnc::fast_normalize(q);
+    return q;
+}
+
+static double tilt_error(const Quatf &q, const Quatf &truth)
+{
+    Vector3f up = q.rotateInverse(gnc::vec3(0.f, 0.f, 1.f));
+    Vector3f ref = truth.rotateInverse(gnc::vec3(0.f, 0.f, 1.f));
+    double c = gnc::dot(up, ref) / (gnc::norm(up) * gnc::norm(ref));
+    return acos(c > 1.0 ? 1.0 : (c < -1.0 ? -1.0 : c));
+}
+
+// smallest over largest pivot of P = L D L^T in double, <= 0 if P isn't
+// positive definite
+static double pivot_ratio(const SymMatrix<4> &p)
+{
+    double l[4][4] = {}, d[4];
+    for (int j = 0; j < 4; j++)
+    {
+        double s = p[j][j];
+        for (int k = 0; k < j; k++)
+            s -= l[j][k] * l[j][k] * d[k];
+        d[j] = s;
+        if (s <= 0.0)
+            return s;
+        for (int i = j + 1; i < 4; i++)
+        {
+            double t = p[i][j];
+            for (int k = 0; k < j; k++)
+                t -= l[i][k] * l[j][k] * d[k];
+            l[i][j] = t / s;
+        }
+    }
+    double lo = d[0], hi = d[0];
+    for (int j = 1; j < 4; j++)
+    {
+        lo = fmin(lo, d[j]);
+        hi = fmax(hi, d[j]);
+    }
+    return lo / hi;
+}
+
+struct tuning
+{
+    const char *name;
+    float gyro_noise, accel_noise, mag_noise;
+};
+
+struct idle_result
+{
+    long checks, diverged;
+    double first_s;   // -1 if never
+    double min_ratio; // smallest pivot ratio
+    double final_tilt;
+    bool finite;
+    uint32_t ns;
+};
+
+template <class Filter>
+static idle_result run(const pad_stats &pad, const tuning &tune, bool use_mag, double hours)
+{
+    Filter ekf(tune.gyro_noise, tune.accel_noise, tune.mag_noise);
+    Quatf truth = pad_attitude(pad);
+    Vector3f gravity = truth.rotateInverse(gnc::vec3(0.f, 0.f, GRAVITY));
+    Vector3f field = truth.rotateInverse(gnc::vec3<float>(Bx, By, Bz));
+
+    // same seed for every form, so they see the same samples
+    std::mt19937 rng(11);
+    std::normal_distribution<float> normal(0.f, 1.f);
+
+    long samples = (long)(hours * 3600.0 / IMU_DT);
+    idle_result r{0, 0, -1.0, 1.0, 0.0, true, 0};
+    gnc::cpu_stats cpu{};
+    for (long k = 1; k <= samples; k++)
+    {
+        float gyro[3], accel[3], mag[3];
+        for (int i = 0; i < 3; i++)
+        {
+            gyro[i] = (float)(pad.gyro[i] + pad.gyro_sd[i] * normal(rng));
+            accel[i] = gravity(i) + (float)pad.accel_sd[i] * normal(rng);
+            mag[i] = field(i) + (float)pad.mag_sd * normal(rng);
+        }
+
+        uint32_t start = gnc::cycle_count();
+        ekf.predict(gyro, IMU_DT);
+        ekf.updateAccel(accel);
+        if (use_mag && k % MAG_DIVIDER == 0)
+            ekf.updateMag(mag);
+        cpu.add(gnc::cycle_count() - start);
+
+        if (k % CHECK_EVERY != 0 || k * IMU_DT < SETTLE_S)
+            continue;
+        const Quatf &q = ekf.getQuaternion();
+        if (!std::isfinite(q.w) || !std::isfinite(q.x) || !std::isfinite(q.y) || !std::isfinite(q.z))
+        {
+            // nothing comes back from NaN, count the rest as diverged
+            r.finite = false;
+            long left = (samples - k) / CHECK_EVERY + 1;
+            r.checks += left;
+            r.diverged += left;
+            if (r.first_s < 0.0)
+                r.first_s = k * IMU_DT;
+            break;
+        }
+        double ratio = pivot_ratio(ekf.getCovariance());
+        double tilt = tilt_error(q, truth);
+        r.min_ratio = fmin(r.min_ratio, ratio);
+        r.final_tilt = tilt;
+        r.checks++;
+        if (ratio <= 0.0 || tilt > TILT_LIMIT_DEG * DEG_TO_RAD)
+        {
+            r.diverged++;
+            if (r.first_s < 0.0)
+                r.first_s = k * IMU_DT;
+        }
+    }
+    r.ns = cpu.mean();
+    return r;
+}
+
+template <class Filter>
+static void report(const char *form, const pad_stats &pad, const tuning &tune, bool use_mag, double hours)
+{
+    idle_result r = run<Filter>(pad, tune, use_mag, hours);
+    char first[16];
+    if (r.first_s < 0.0)
+        snprintf(first, sizeof(first), "never");
+    else
+        snprintf(first, sizeof(first), "%.2f h", r.first_s / 3600.0);
+    printf("%-8s %-4s %-5s %8.1f %8s %10.2e %8.2f %6u\n", tune.name, use_mag ? "yes" : "no", form,
+           r.diverged / hours, first, r.min_ratio, r.finite ? r.final_tilt / DEG_TO_RAD : NAN, r.ns);
+}
+
+int main(int argc, char **argv)
+{
+    double hours = 4.0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--hours") == 0 && i + 1 < argc)
+            hours = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--hours H]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    pad_stats pad;
+    if (!load_pad("../data/tf2.csv", pad))
+    {
+        fprintf(stderr, "couldn't read the pad samples from ../data/tf2.csv\n");
+        return 1;
+    }
+    printf("tf2 pad: accel sd %.3f %.3f %.3f m/s^2, gyro bias %.4f %.4f %.4f sd %.4f %.4f %.4f rad/s, "
+           "mag sd %.3f of |B|\n",
+           pad.accel_sd[0], pad.accel_sd[1], pad.accel_sd[2], pad.gyro[0], pad.gyro[1], pad.gyro[2],
+           pad.gyro_sd[0], pad.gyro_sd[1], pad.gyro_sd[2], pad.mag_sd);
+    printf("%.1f h idle, imu %d Hz, mag %d Hz, checked every second after %.0f s\n\n", hours,
+           (int)(1.f / IMU_DT + 0.5f), (int)(1.f / IMU_DT / MAG_DIVIDER + 0.5f), SETTLE_S);
+
+    // what the StateDeterminer runs with, the noise actually measured on
+    // the pad, and a stiff one that trusts every sensor well past that,
+    // the kind of tuning that gets tried when the attitude is too slow
+    auto rms = [](const double v[3]) { return (float)sqrt((v[0] * v[0] + v[1] * v[1] + v[2] * v[2]) / 3.0); };
+    const tuning tunings[] = {
+        {"flight", SIGMA_GYRO, 0.5f, 0.5f},
+        {"pad", rms(pad.gyro_sd), rms(pad.accel_sd), (float)pad.mag_sd},
+        {"stiff", 1e-4f, 3e-3f, 5e-3f},
+    };
+
+    printf("                       diverged    first  min pivot     tilt\n");
+    printf("tuning   mag  form       per h   check      ratio    (deg)  ns/sample\n");
+    for (const tuning &tune : tunings)
+    {
+        for (int use_mag = 1; use_mag >= 0; use_mag--)
+        {
+            report<ExtendedKalmanFilter>("full", pad, tune, use_mag, hours);
+            report<UDExtendedKalmanFilter>("ud", pad, tune, use_mag, hours);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,281 @@
+/*
+    quat_study.cpp: Attitude error vs predict step for the quaternion propagators
+
+    Takes the gyro channels of a recorded flight (../data/tf2.csv, logged in
+    deg/s at ~20 Hz), turns them into a smooth rate profile (Catmull-Rom
+    between log samples), and integrates that profile three ways at a range
+    of step sizes, each with the rate sampled at the step ends like a real
+    gyro would be. The reference is RK4 in double at 0.1 ms. Error is the
+    rotation angle between estimate and reference, taken every 50 ms.
+
+    The log is coarse and the flight was gentle (|w| mostly under 5 deg/s),
+    so the profile is also run scaled up to something like an ascent with
+    roll, where step size actually starts to matter.
+
+    Build and run with `make quatstudy` (-O2).
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "quatprop.h"
+
+using gnc::Quatf;
+using gnc::Vector3f;
+
+static const int TIME_INDEX = 1;
+static const int GYRO_INDEX = 16; // x, y, z follow
+
+static const double DEG_TO_RAD = M_PI / 180.0;
+static const double REF_DT = 1e-4;
+static const double CHECK_DT = 0.05;
+
+static volatile float sink;
+
+struct rate_log
+{
+    std::vector<double> t;         // s, from the first sample
+    std::vector<double> w[3];      // rad/s
+};
+
+static bool load_log(const char *path, rate_log &log)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        return false;
+
+    std::string line;
+    std::getline(file, line); // header
+    double t0 = -1.0;
+    while (std::getline(file, line))
+    {
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, ','))
+            fields.push_back(field);
+        if ((int)fields.size() <= GYRO_INDEX + 2)
+            continue;
+
+        double t = std::stod(fields[TIME_INDEX]) / 1000.0;
+        if (t0 < 0.0)
+            t0 = t;
+        // the logger repeats a timestamp now and then, the spline needs them increasing
+        if (!log.t.empty() && t - t0 <= log.t.back())
+            continue;
+        log.t.push_back(t - t0);
+        for (int i = 0; i < 3; i++)
+            log.w[i].push_back(std::stod(fields[GYRO_INDEX + i]) * DEG_TO_RAD);
+    }
+    return log.t.size() > 4;
+}
+
+// Catmull-Rom through the log samples, clamped at the ends
+static void rate_at(const rate_log &log, double t, double scale, double w[3])
+{
+    int n = (int)log.t.size();
+    int k = 0, hi = n - 1;
+    while (hi - k > 1)
+    {
+        int mid = (k + hi) / 2;
+        if (log.t[mid] <= t)
+            k = mid;
+        else
+            hi = mid;
+    }
+    double u = (t - log.t[k]) / (log.t[k + 1] - log.t[k]);
+    u = u < 0.0 ? 0.0 : (u > 1.0 ? 1.0 : u);
+    int k0 = k > 0 ? k - 1 : 0;
+    int k3 = k + 2 < n ? k + 2 : n - 1;
+
+    for (int i = 0; i < 3; i++)
+    {
+        double p0 = log.w[i][k0], p1 = log.w[i][k], p2 = log.w[i][k + 1], p3 = log.w[i][k3];
+        w[i] = scale * 0.5 * (2.0 * p1 + (p2 - p0) * u + (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) * u * u +
+                              (3.0 * (p1 - p2) + p3 - p0) * u * u * u);
+    }
+}
+
+struct quatd
+{
+    double w, x, y, z;
+};
+
+static quatd rate_d(const quatd &q, const double w[3])
+{
+    return quatd{0.5 * (-q.x * w[0] - q.y * w[1] - q.z * w[2]),
+                 0.5 * (q.w * w[0] + q.y * w[2] - q.z * w[1]),
+                 0.5 * (q.w * w[1] - q.x * w[2] + q.z * w[0]),
+                 0.5 * (q.w * w[2] + q.x * w[1] - q.y * w[0])};
+}
+
+static quatd axpy_d(const quatd &q, double s, const quatd &d)
+{
+    return quatd{q.w + s * d.w, q.x + s * d.x, q.y + s * d.y, q.z + s * d.z};
+}
+
+// reference attitude at every CHECK_DT
+static std::vector<quatd> reference(const rate_log &log, double scale, int checks)
+{
+    std::vector<quatd> out;
+    quatd q{1.0, 0.0, 0.0, 0.0};
+    out.push_back(q);
+    int per_check = (int)lround(CHECK_DT / REF_DT);
+    for (int c = 1; c < checks; c++)
+    {
+        for (int s = 0; s < per_check; s++)
+        {
+            double t = ((c - 1) * per_check + s) * REF_DT;
+            double w0[3], wm[3], w1[3];
+            rate_at(log, t, scale, w0);
+            rate_at(log, t + 0.5 * REF_DT, scale, wm);
+            rate_at(log, t + REF_DT, scale, w1);
+            quatd k1 = rate_d(q, w0);
+            quatd k2 = rate_d(axpy_d(q, 0.5 * REF_DT, k1), wm);
+            quatd k3 = rate_d(axpy_d(q, 0.5 * REF_DT, k2), wm);
+            quatd k4 = rate_d(axpy_d(q, REF_DT, k3), w1);
+            q = axpy_d(q, REF_DT / 6.0, quatd{k1.w + 2.0 * (k2.w + k3.w) + k4.w,
+                                              k1.x + 2.0 * (k2.x + k3.x) + k4.x,
+                                              k1.y + 2.0 * (k2.y + k3.y) + k4.y,
+                                              k1.z + 2.0 * (k2.z + k3.z) + k4.z});
+            double n = sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+            q = quatd{q.w / n, q.x / n, q.y / n, q.z / n};
+        }
+        out.push_back(q);
+    }
+    return out;
+}
+
+// from the vector part of r^-1 * q rather than acos(q . r), which has no
+// resolution near zero and would also see fast_normalize's norm error as angle
+static double angle_between(const Quatf &q, const quatd &r)
+{
+    double n = sqrt((double)q.w * q.w + (double)q.x * q.x + (double)q.y * q.y + (double)q.z * q.z);
+    double x = (r.w * q.x - r.x * q.w - r.y * q.z + r.z * q.y) / n;
+    double y = (r.w * q.y + r.x * q.z - r.y * q.w - r.z * q.x) / n;
+    double z = (r.w * q.z - r.x * q.y + r.y * q.x - r.z * q.w) / n;
+    double s = sqrt(x * x + y * y + z * z);
+    return 2.0 * asin(s > 1.0 ? 1.0 : s);
+}
+
+// attitude error in rad over the whole log for one method and step
+static void run(const rate_log &log, const std::vector<quatd> &ref, double scale,
+                int method, int dt_ms, double &rms, double &max)
+{
+    float dt = dt_ms * 1e-3f;
+    int per_check = (int)(CHECK_DT * 1000.0 + 0.5) / dt_ms;
+    Quatf q = Quatf::identity();
+    double w[3];
+    rate_at(log, 0.0, scale, w);
+    Vector3f prev = gnc::vec3((float)w[0], (float)w[1], (float)w[2]);
+
+    double sum = 0.0;
+    max = 0.0;
+    for (int c = 1; c < (int)ref.size(); c++)
+    {
+        for (int s = 0; s < per_check; s++)
+        {
+            // gyro sample at the end of the step
+            rate_at(log, ((c - 1) * per_check + s + 1) * dt_ms * 1e-3, scale, w);
+            Vector3f gyro = gnc::vec3((float)w[0], (float)w[1], (float)w[2]);
+            if (method == GNC_QUAT_EULER)
+                q = gnc::propagate_euler(q, gyro, dt);
+            else if (method == GNC_QUAT_EXP)
+                q = gnc::propagate_exp(q, prev, gyro, dt);
+            else
+                q = gnc::propagate_rk4(q, prev, gyro, dt);
+            prev = gyro;
+        }
+        double err = angle_between(q, ref[c]);
+        sum += err * err;
+        if (err > max)
+            max = err;
+    }
+    rms = sqrt(sum / (ref.size() - 1));
+}
+
+static double time_ns(int method)
+{
+    const int iterations = 2000000;
+    Quatf q = Quatf::identity();
+    Vector3f w0 = gnc::vec3(0.3f, -0.2f, 0.1f);
+    Vector3f w1 = gnc::vec3(0.31f, -0.19f, 0.12f);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        if (method == GNC_QUAT_EULER)
+            q = gnc::propagate_euler(q, w1, 0.01f);
+        else if (method == GNC_QUAT_EXP)
+            q = gnc::propagate_exp(q, w0, w1, 0.01f);
+        else
+            q = gnc::propagate_rk4(q, w0, w1, 0.01f);
+    }
+    auto end = std::chrono::steady_clock::now();
+    sink = q.x;
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+int main()
+{
+    rate_log log;
+    if (!load_log("../data/tf2.csv", log))
+    {
+        fprintf(stderr, "couldn't read ../data/tf2.csv\n");
+        return 1;
+    }
+    int checks = (int)(log.t.back() / CHECK_DT);
+
+    const char *names[] = {"euler", "exp", "rk4"};
+    const int steps[] = {1, 2, 5, 10, 25, 50};
+    const int nsteps = sizeof(steps) / sizeof(steps[0]);
+    const double scales[] = {1.0, 20.0};
+
+    double cost[3];
+    printf("propagate cost (ns/call): ");
+    for (int m = 0; m < 3; m++)
+    {
+        cost[m] = time_ns(m);
+        printf("%s %.1f  ", names[m], cost[m]);
+    }
+    printf("\n");
+
+    for (double scale : scales)
+    {
+        std::vector<quatd> ref = reference(log, scale, checks);
+        printf("\ntf2 gyro x%.0f, %.0f s         rms / max error (deg)\n", scale, log.t.back());
+        printf("dt (ms)  %22s %22s %22s\n", names[0], names[1], names[2]);
+
+        double rms[3][nsteps];
+        for (int i = 0; i < nsteps; i++)
+        {
+            printf("%7d ", steps[i]);
+            for (int m = 0; m < 3; m++)
+            {
+                double max;
+                run(log, ref, scale, m, steps[i], rms[m][i], max);
+                printf("   %9.2e / %9.2e", rms[m][i] / DEG_TO_RAD, max / DEG_TO_RAD);
+            }
+            printf("\n");
+        }
+
+        // largest step each method can take and still be as good as euler at 5 ms,
+        // and what that costs per second of flight
+        const int base = 2;
+        printf("to match euler @ %d ms: ", steps[base]);
+        for (int m = 0; m < 3; m++)
+        {
+            int best = 0;
+            for (int i = 0; i < nsteps; i++)
+                if (rms[m][i] <= rms[GNC_QUAT_EULER][base] * 1.001)
+                    best = i;
+            printf("%s %d ms (%.1f us/s)  ", names[m], steps[best], cost[m] * 1000.0 / steps[best] / 1000.0);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,495 @@
+/*
+    state_replay.cpp: Flight state detection replayed on recorded flights
+
+    Runs each log through StateDeterminer sample by sample and prints every
+    transition it made, with its debounce latency (trigger sample to firing
+    sample) and, for apogee, the latency against the reference trajectory
+    (first sample after the reference velocity drops to <= 0 and the time
+    of the reference's highest altitude), and when it decided it had landed.
+    Events the logger itself marked in the STATE column are listed
+    alongside. During coast the apogee prediction is printed once a second
+    against the reference apogee.
+    determineState() cost per call is timed too, and built with
+    -DGNC_PROFILE (make replay PROFILE=1) so is each estimator stage inside
+    it, min / mean / p99 / max. With --restart that covers both runs.
+
+    --restart MS simulates a reset MS ms into the log: the flight checkpoint
+    is taken, goes through a CRC'd byte copy like the RTC memory one, the
+    next --outage ms (default 300) of samples are dropped while the board
+    would be rebooting, and a fresh StateDeterminer is restored from it.
+    An uninterrupted one runs alongside to show how far the restarted one
+    is off afterwards.
+
+    --sim truth.csv replays a sensor log made up from a reference trajectory
+    (the RocketPy ones in sim_data have no log of their own), --seeds times
+    (default 20) with different sensor noise, printing only the apogee. Its
+    apogee is judged against the reference's highest altitude, which is what
+    the log was made from. With more than one log, any --sim or an
+    --apogee-limit the apogee errors are summed up per source (min / median
+    / p95 / max), and --apogee-limit MS fails the run (exit 1) if any apogee
+    was missed or off by more than MS.
+
+    Usage: ./state_replay [--restart MS [--outage MS]] [--sim truth.csv]...
+                          [--seeds N] [--apogee-limit MS] [log.csv truth.csv]...
+    Without log or --sim arguments it replays ../data/tf2.csv against
+    ../data/sim_data/tf2_sim.csv. `make replay` builds and runs it, extra
+    arguments go through REPLAY_ARGS. `make apogee` is the apogee timing
+    check over tf2 and the three sims.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "StateDetermination.h"
+#include "crc32.h"
+
+static const float DEG_TO_RAD = 0.01745329252f;
+
+// tf2.csv
+static const int LOG_EVENT_INDEX = 0;
+static const int LOG_TIME_INDEX = 1;
+static const int LOG_ALT_INDEX = 6;
+static const int LOG_ACCEL_INDEX = 10;
+static const int LOG_MAG_INDEX = 13;
+static const int LOG_GYRO_INDEX = 16;
+
+// sim_data/*.csv
+static const int TRUTH_TIME_INDEX = 0;
+static const int TRUTH_ALT_INDEX = 1;
+static const int TRUTH_VEL_INDEX = 2;
+
+static const char *state_names[] = {"POWER_ON", "LAUNCH_READY", "POWERED_FLIGHT", "BURNOUT", "COAST",
+                                    "APOGEE", "DROGUE_DEPLOYED", "MAIN_DEPLOY_ATTEMPT", "MAIN_DEPLOYED",
+                                    "RECOVERY"};
+
+// simulated reset, restart_ms < 0 for none
+static long restart_ms = -1;
+static long outage_ms = 300;
+// runs per --sim trajectory, each with its own sensor noise
+static int sim_seeds = 20;
+// --apogee-limit, the run fails if any apogee is further off than this. < 0 for no check
+static long apogee_limit_ms = -1;
+
+// what the StateDeterminer is fed, one row of a log
+struct log_sample
+{
+    uint32_t t;
+    float accel[3], gyro[3], mag[3], altitude;
+    std::string event;
+};
+
+struct truth_row
+{
+    uint32_t t;
+    float alt, vel;
+};
+
+// apogee detection error (detect_ms - reference) of each run, per source
+struct apogee_errors
+{
+    std::string source;
+    std::vector<long> ms;
+    int missed;
+};
+static std::vector<apogee_errors> apogee_summary;
+
+static std::vector<std::vector<std::string>> read_csv(const char *path)
+{
+    std::vector<std::vector<std::string>> rows;
+    std::ifstream file(path);
+    if (!file.is_open())
+        return rows;
+
+    std::string line;
+    std::getline(file, line); // header
+    while (std::getline(file, line))
+    {
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, ','))
+            fields.push_back(field);
+        rows.push_back(fields);
+    }
+    return rows;
+}
+
+static std::vector<log_sample> read_log(const char *path)
+{
+    std::vector<log_sample> log;
+    for (const auto &fields : read_csv(path))
+    {
+        if ((int)fields.size() <= LOG_GYRO_INDEX + 2)
+            continue;
+
+        log_sample s;
+        try
+        {
+            s.t = (uint32_t)std::stoul(fields[LOG_TIME_INDEX]);
+            s.altitude = std::stof(fields[LOG_ALT_INDEX]);
+            for (int i = 0; i < 3; i++)
+            {
+                s.accel[i] = std::stof(fields[LOG_ACCEL_INDEX + i]);
+                s.mag[i] = std::stof(fields[LOG_MAG_INDEX + i]);
+                s.gyro[i] = std::stof(fields[LOG_GYRO_INDEX + i]) * DEG_TO_RAD;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            continue;
+        }
+        s.event = fields[LOG_EVENT_INDEX];
+        log.push_back(s);
+    }
+    return log;
+}
+
+static std::vector<truth_row> read_truth(const char *path)
+{
+    std::vector<truth_row> truth;
+    for (const auto &row : read_csv(path))
+    {
+        try
+        {
+            truth.push_back(truth_row{(uint32_t)std::stoul(row[TRUTH_TIME_INDEX]), std::stof(row[TRUTH_ALT_INDEX]),
+                                      std::stof(row[TRUTH_VEL_INDEX])});
+        }
+        catch (const std::exception &e)
+        {
+            continue;
+        }
+    }
+    return truth;
+}
+
+// A log made up from a reference trajectory, for the sims that have no
+// sensor log of their own. Starts where the climb to the highest point
+// starts (walking back from it for as long as the altitude kept rising),
+// with 10 s on the pad ahead of that, and ends a minute after it. Baro is
+// the reference altitude, the accel the rocket standing on its tail the way
+// the tf2 IMU is mounted (-y up) reading the second difference of the
+// altitude plus g, with seeded gaussian noise on both. No attitude motion,
+// the mag is tf2's on the pad
+static std::vector<log_sample> synthesize(const std::vector<truth_row> &truth, unsigned seed)
+{
+    std::vector<log_sample> log;
+    if (truth.size() < 8)
+        return log;
+    size_t peak = 0;
+    for (size_t i = 0; i < truth.size(); i++)
+        if (truth[i].alt > truth[peak].alt)
+            peak = i;
+    size_t launch = peak;
+    while (launch > 2 && truth[launch - 1].alt < truth[launch].alt)
+        launch--;
+
+    std::mt19937 gen(seed);
+    std::normal_distribution<float> baro_noise(0.f, 0.3f), accel_noise(0.f, 0.2f), gyro_noise(0.f, 0.002f);
+    uint32_t step = truth[launch + 1].t - truth[launch].t;
+    if (step == 0)
+        step = 50;
+    auto sample = [&](uint32_t t, float alt, float accel) {
+        log_sample s;
+        s.t = t;
+        s.altitude = alt + baro_noise(gen);
+        s.accel[0] = accel_noise(gen);
+        s.accel[1] = -(accel + GRAVITY) + accel_noise(gen);
+        s.accel[2] = accel_noise(gen);
+        for (int i = 0; i < 3; i++)
+            s.gyro[i] = gyro_noise(gen);
+        s.mag[0] = 23.08f;
+        s.mag[1] = 61.43f;
+        s.mag[2] = 16.44f;
+        s.event = "0";
+        log.push_back(s);
+    };
+
+    for (uint32_t t = truth[launch].t - 10000; t < truth[launch].t; t += step)
+        sample(t, truth[launch].alt, 0.f);
+    for (size_t i = launch; i + 2 < truth.size() && truth[i].t <= truth[peak].t + 60000; i++)
+    {
+        // second difference over +-2 rows, the reference is smooth enough for it
+        size_t a = i >= launch + 2 ? i - 2 : launch, b = i + 2;
+        float dt1 = (truth[i].t - truth[a].t) * 0.001f, dt2 = (truth[b].t - truth[i].t) * 0.001f;
+        float accel = 0.f;
+        if (dt1 > 0.f && dt2 > 0.f)
+            accel = 2.f * ((truth[b].alt - truth[i].alt) / dt2 - (truth[i].alt - truth[a].alt) / dt1) / (dt1 + dt2);
+        sample(truth[i].t, truth[i].alt, accel);
+    }
+    return log;
+}
+
+// verbose prints every transition and event, otherwise only the apogee
+// line. The apogee error goes in errors either way, against the reference
+// v <= 0 or, with by_peak, its highest point. A synthesized log is made from
+// the reference altitude, so it is judged by the peak: the sim_data velocity
+// doesn't always agree with the altitude (tf2_sim.csv's crosses 0 1.7 s
+// before its altitude peaks)
+static bool replay(const char *name, const std::vector<log_sample> &log, const std::vector<truth_row> &truth,
+                   bool verbose, bool by_peak, apogee_errors &errors)
+{
+    if (log.empty() || truth.empty())
+    {
+        fprintf(stderr, "nothing to replay in %s\n", name);
+        return false;
+    }
+
+    // reference apogee, both ways. Its altitudes are from the pad already
+    uint32_t truth_cross = 0, truth_peak = 0;
+    float peak = -1e9f;
+    bool armed = false;
+    for (const auto &row : truth)
+    {
+        // only over what the log covers, the sim_data files have a long pad
+        // segment the reference filter drifted about in
+        if (row.t < log.front().t || row.t > log.back().t)
+            continue;
+        uint32_t t = row.t;
+        float alt = row.alt;
+        float vel = row.vel;
+        if (alt > peak)
+        {
+            peak = alt;
+            truth_peak = t;
+        }
+        if (vel > 20.f)
+            armed = true;
+        else if (armed && !truth_cross && vel <= 0.f)
+            truth_cross = t;
+    }
+
+    // sd is the one reporting. With a restart it is switched over to the
+    // restored one and the uninterrupted run is kept going as reference
+    StateDeterminer first, restored;
+    StateDeterminer *sd = &first;
+    gnc::cpu_stats cpu = {};
+#ifdef GNC_PROFILE
+    gnc::profiler().reset();
+#endif
+    uint32_t t0 = 0, last_print = 0;
+    // the checkpoint as it would sit in RTC memory, with its crc
+    uint8_t saved[sizeof(flight_checkpoint)];
+    uint32_t saved_crc = 0, saved_ms = 0;
+    bool have_checkpoint = false, resumed = false;
+    float max_alt_err = 0.f, max_vel_err = 0.f;
+    bool apogee_seen = false;
+    if (verbose)
+        printf("%s\n", name);
+    for (const log_sample &sample : log)
+    {
+        float accel[3], gyro[3], mag[3];
+        memcpy(accel, sample.accel, sizeof(accel));
+        memcpy(gyro, sample.gyro, sizeof(gyro));
+        memcpy(mag, sample.mag, sizeof(mag));
+        float altitude = sample.altitude;
+        uint32_t t = sample.t;
+        if (!t0)
+            t0 = t;
+
+        const std::string &event = sample.event;
+        if (verbose && event.find_first_not_of("0123456789") != std::string::npos)
+            printf("  %8.3f s  logger marked: %s\n", (t - t0) * 0.001f, event.c_str());
+
+        if (restart_ms >= 0 && !have_checkpoint && t - t0 >= (uint32_t)restart_ms)
+        {
+            flight_checkpoint cp = sd->getCheckpoint(t);
+            memcpy(saved, &cp, sizeof(cp));
+            saved_crc = gnc::crc32(saved, sizeof(saved));
+            saved_ms = t;
+            have_checkpoint = true;
+            printf("  %8.3f s  reset, checkpoint is %u bytes, in %s\n", (t - t0) * 0.001f,
+                   (unsigned)sizeof(cp), state_names[(int)cp.state]);
+        }
+        if (have_checkpoint && !resumed)
+        {
+            // the uninterrupted run carries on, the restarted one sees nothing
+            first.determineState(accel, gyro, mag, altitude, t);
+            if (t - saved_ms < (uint32_t)outage_ms)
+                continue;
+
+            if (gnc::crc32(saved, sizeof(saved)) != saved_crc)
+            {
+                fprintf(stderr, "checkpoint crc mismatch\n");
+                return false;
+            }
+            flight_checkpoint cp;
+            memcpy(&cp, saved, sizeof(cp));
+            uint32_t start = gnc::cycle_count();
+            restored.restoreCheckpoint(cp, t, (t - saved_ms) * 0.001f);
+            printf("  %8.3f s  resumed in %s after %u ms, restore took %u ns\n", (t - t0) * 0.001f,
+                   state_names[(int)restored.getState()], t - saved_ms, gnc::cycle_count() - start);
+            sd = &restored;
+            resumed = true;
+        }
+
+        rocket_state before = sd->getState();
+        bool was_armed = sd->isApogeeArmed();
+        bool was_landed = sd->hasLanded();
+        uint32_t start = gnc::cycle_count();
+        filter_estimates est = sd->determineState(accel, gyro, mag, altitude, t);
+        cpu.add(gnc::cycle_count() - start);
+
+        if (resumed)
+        {
+            filter_estimates ref = first.determineState(accel, gyro, mag, altitude, t);
+            max_alt_err = fmaxf(max_alt_err, fabsf(est.cf_results.altitude - ref.cf_results.altitude));
+            max_vel_err = fmaxf(max_vel_err, fabsf(est.cf_results.vertical_velocity - ref.cf_results.vertical_velocity));
+            if (first.getState() != sd->getState() && first.getTransitions().size() &&
+                first.getTransitions().newest().detect_ms == t)
+                printf("  %8.3f s  uninterrupted run went to %s\n", (t - t0) * 0.001f,
+                       state_names[(int)first.getState()]);
+        }
+
+        if (verbose && before == rocket_state::COAST_PHASE && sd->getState() == before &&
+            (t - t0) / 1000 != last_print)
+        {
+            last_print = (t - t0) / 1000;
+            apogee_prediction p = sd->getApogeePrediction();
+            printf("  %8.3f s  predicted apogee %7.1f m in %5.2f s, %+6.0f ms / %+6.1f m off the reference\n",
+                   (t - t0) * 0.001f, p.altitude, p.time_to_apogee,
+                   (double)t - truth_cross + p.time_to_apogee * 1000.0, p.altitude - peak);
+        }
+
+        if (verbose && sd->isApogeeArmed() && !was_armed)
+            printf("  %8.3f s  apogee armed, %+d ms vs reference v <= 0\n", (t - t0) * 0.001f,
+                   (int)((double)t - truth_cross));
+
+        if (verbose && sd->hasLanded() && !was_landed)
+            printf("  %8.3f s  landed, in %s\n", (t - t0) * 0.001f, state_names[(int)sd->getState()]);
+
+        if (sd->getState() != before)
+        {
+            const state_transition_event &e = sd->getTransitions().newest();
+            if (verbose)
+                printf("  %8.3f s  %s -> %s, debounce latency %u ms\n", (e.detect_ms - t0) * 0.001f,
+                       state_names[(int)e.from], state_names[(int)e.to], e.latency_ms());
+            if (e.to == rocket_state::APOGEE_PHASE && !apogee_seen)
+            {
+                apogee_seen = true;
+                errors.ms.push_back((long)(int32_t)(e.detect_ms - (by_peak ? truth_peak : truth_cross)));
+                printf("%s  apogee: %+d ms vs reference v <= 0, %+d ms vs reference peak\n",
+                       verbose ? "           " : name, (int)(e.detect_ms - truth_cross),
+                       (int)(e.detect_ms - truth_peak));
+            }
+        }
+    }
+    if (!apogee_seen)
+    {
+        errors.missed++;
+        printf("%s  apogee: never detected\n", verbose ? "           " : name);
+    }
+    if (!verbose)
+        return true;
+    if (resumed)
+        printf("  after the restart: altitude within %.2f m, velocity within %.2f m/s of the uninterrupted run\n",
+               max_alt_err, max_vel_err);
+    printf("  determineState: %u calls, mean %u ns, max %u ns\n", cpu.calls, cpu.mean(), cpu.max);
+#ifdef GNC_PROFILE
+    gnc::profile_report report = gnc::profiler().report();
+    printf("  stage        calls   min (ns)  mean (ns)   p99 (ns)   max (ns)\n");
+    for (int i = 0; i < (int)gnc::profile_stage::COUNT; i++)
+    {
+        const gnc::stage_summary &s = report.stage[i];
+        printf("  %-8s  %8u  %9u  %9u  %9u  %9u\n", gnc::profile_stage_name((gnc::profile_stage)i), s.calls,
+               s.min, s.mean, s.p99, s.max);
+    }
+#endif
+    printf("\n");
+    return true;
+}
+
+static std::string file_name(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+// apogee detection error per source over all its runs, and whether any of
+// it is past --apogee-limit
+static bool report_apogee()
+{
+    bool ok = true;
+    printf("apogee detection vs the reference (ms), v <= 0 for logs, the peak for synthetic ones\n");
+    printf("  %-26s %5s %6s %7s %7s %7s %7s %7s\n", "source", "runs", "missed", "min", "median", "p95", "max",
+           "max |e|");
+    for (apogee_errors &e : apogee_summary)
+    {
+        std::vector<long> ms = e.ms;
+        std::sort(ms.begin(), ms.end());
+        long worst = 0;
+        for (long v : ms)
+            worst = std::max(worst, std::labs(v));
+        if (ms.empty())
+            printf("  %-26s %5d %6d\n", e.source.c_str(), e.missed, e.missed);
+        else
+            printf("  %-26s %5d %6d %7ld %7ld %7ld %7ld %7ld\n", e.source.c_str(), (int)ms.size() + e.missed,
+                   e.missed, ms.front(), ms[ms.size() / 2], ms[(ms.size() * 95) / 100 < ms.size() ? (ms.size() * 95) / 100 : ms.size() - 1],
+                   ms.back(), worst);
+        if (apogee_limit_ms >= 0 && (e.missed > 0 || worst > apogee_limit_ms))
+            ok = false;
+    }
+    if (apogee_limit_ms >= 0)
+        printf("%s: every apogee within %ld ms of the reference\n", ok ? "PASS" : "FAIL", apogee_limit_ms);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<const char *> paths, sims;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--restart") && i + 1 < argc)
+            restart_ms = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--outage") && i + 1 < argc)
+            outage_ms = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--sim") && i + 1 < argc)
+            sims.push_back(argv[++i]);
+        else if (!strcmp(argv[i], "--seeds") && i + 1 < argc)
+            sim_seeds = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--apogee-limit") && i + 1 < argc)
+            apogee_limit_ms = atol(argv[++i]);
+        else
+            paths.push_back(argv[i]);
+    }
+
+    if (paths.empty() && sims.empty())
+    {
+        paths.push_back("../data/tf2.csv");
+        paths.push_back("../data/sim_data/tf2_sim.csv");
+    }
+    if (paths.size() % 2 != 0)
+    {
+        fprintf(stderr, "logs come in pairs: log.csv truth.csv\n");
+        return 1;
+    }
+    for (size_t i = 0; i < paths.size(); i += 2)
+    {
+        apogee_summary.push_back(apogee_errors{file_name(paths[i]), {}, 0});
+        if (!replay(paths[i], read_log(paths[i]), read_truth(paths[i + 1]), true, false, apogee_summary.back()))
+            return 1;
+    }
+    for (const char *sim : sims)
+    {
+        std::vector<truth_row> truth = read_truth(sim);
+        apogee_summary.push_back(apogee_errors{file_name(sim) + " synthetic", {}, 0});
+        for (int seed = 1; seed <= sim_seeds; seed++)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "  seed %3d", seed);
+            if (!replay(name, synthesize(truth, seed), truth, false, true, apogee_summary.back()))
+                return 1;
+        }
+    }
+
+    // one log on its own has nothing to sum up, unless it's being checked
+    if (apogee_summary.size() > 1 || !sims.empty() || apogee_limit_ms >= 0)
+        return report_apogee() ? 0 : 1;
+    return 0;
+}
@@ -0,0 +1,479 @@
+/*
+    tuner.cpp: Parameter sweep for the Estimator's noise sigmas and ZUPT threshold
+
+    Replays flight logs through the Estimator (lockstep, the way
+    StateDeterminer drives it) for every configuration in a grid or a random
+    sample of the search space, and scores each one against the reference
+    trajectory for that log:
+
+    - altitude and vertical velocity RMSE over the whole log
+    - apogee time error, apogee being the first time the vertical velocity
+      goes from above APOGEE_ARM_VEL to <= 0
+
+    The complementary filter only sees sigma_accel / sigma_baro, so with it
+    the grid ties along that ratio. The vertical KF (GNC_VERTICAL_KF) uses
+    both.
+
+    Configurations are independent so they run on every core, each worker
+    drains its own deque and steals from the others when it runs out.
+
+    Usage:
+      ./tuner [options] [log.csv truth.csv]...
+
+      --sigma-accel lo:hi:n   search range per parameter, n points log
+      --sigma-gyro lo:hi:n    spaced for the grid (n is ignored by --random)
+      --sigma-baro lo:hi:n
+      --threshold lo:hi:n
+      --random N              N log-uniform samples instead of the grid
+      --seed S                random seed (default 1)
+      --threads T             worker threads (default all cores)
+      --sort alt|vel|apogee   ranking (default alt)
+      --top K                 rows to print (default 10)
+      --csv FILE              write every configuration's scores to FILE
+
+    Without logs it runs ../data/tf2.csv against ../data/sim_data/tf2_sim.csv.
+    Logs use the tf2 column layout, truth files the sim_data one. Both are
+    matched up by timestamp and altitudes are taken relative to the first
+    sample. `make tune` builds and runs it with the defaults.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "altitude.h"
+#include "StateDetermination.h"
+
+static const float DEG_TO_RAD = 0.01745329252f;
+static const float APOGEE_ARM_VEL = 20.f; // m/s
+
+// tf2.csv
+static const int LOG_TIME_INDEX = 1;
+static const int LOG_ALT_INDEX = 6;
+static const int LOG_ACCEL_INDEX = 10; // then mag at 13, gyro at 16
+static const int LOG_MAG_INDEX = 13;
+static const int LOG_GYRO_INDEX = 16;
+
+// sim_data/*.csv
+static const int TRUTH_TIME_INDEX = 0;
+static const int TRUTH_ALT_INDEX = 1;
+static const int TRUTH_VEL_INDEX = 2;
+
+struct flight_sample
+{
+    uint32_t time; // ms
+    float accel[3];
+    float gyro[3]; // rad/s
+    float mag[3];
+    float altitude;
+    // reference trajectory at the same time
+    float truth_alt;
+    float truth_vel;
+};
+
+struct flight_log
+{
+    std::string name;
+    std::vector<flight_sample> samples;
+    uint32_t truth_apogee; // ms
+};
+
+struct param_range
+{
+    const char *name;
+    float lo, hi;
+    int n;
+};
+
+struct config
+{
+    float sigma_accel;
+    float sigma_gyro;
+    float sigma_baro;
+    float threshold;
+};
+
+struct score
+{
+    float alt_rmse;
+    float vel_rmse;
+    float apogee_err; // ms, mean over logs, huge if apogee was never seen
+};
+
+static std::vector<std::vector<std::string>> read_csv(const char *path)
+{
+    std::vector<std::vector<std::string>> rows;
+    std::ifstream file(path);
+    if (!file.is_open())
+        return rows;
+
+    std::string line;
+    std::getline(file, line); // header
+    while (std::getline(file, line))
+    {
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, ','))
+            fields.push_back(field);
+        rows.push_back(fields);
+    }
+    return rows;
+}
+
+static uint32_t find_apogee(const std::vector<flight_sample> &samples, const std::vector<float> &vel)
+{
+    bool armed = false;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        if (vel[i] > APOGEE_ARM_VEL)
+            armed = true;
+        else if (armed && vel[i] <= 0.f)
+            return samples[i].time;
+    }
+    return 0;
+}
+
+static bool load_flight(const char *log_path, const char *truth_path, flight_log &out)
+{
+    std::vector<std::vector<std::string>> log = read_csv(log_path);
+    std::vector<std::vector<std::string>> truth = read_csv(truth_path);
+    if (log.empty() || truth.empty())
+    {
+        fprintf(stderr, "couldn't read %s or %s\n", log_path, truth_path);
+        return false;
+    }
+
+    out.name = log_path;
+    out.samples.clear();
+    size_t t = 0;
+    float alt0 = 0.f, truth_alt0 = std::stof(truth[0][TRUTH_ALT_INDEX]);
+    for (const auto &fields : log)
+    {
+        if ((int)fields.size() <= LOG_GYRO_INDEX + 2)
+            continue;
+
+        flight_sample s;
+        try
+        {
+            s.time = (uint32_t)std::stoul(fields[LOG_TIME_INDEX]);
+            s.altitude = std::stof(fields[LOG_ALT_INDEX]);
+            for (int i = 0; i < 3; i++)
+            {
+                s.accel[i] = std::stof(fields[LOG_ACCEL_INDEX + i]);
+                s.mag[i] = std::stof(fields[LOG_MAG_INDEX + i]);
+                s.gyro[i] = std::stof(fields[LOG_GYRO_INDEX + i]) * DEG_TO_RAD;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            continue;
+        }
+
+        // truth row at or just before this sample
+        while (t + 1 < truth.size() && std::stoul(truth[t + 1][TRUTH_TIME_INDEX]) <= s.time)
+            t++;
+        s.truth_alt = std::stof(truth[t][TRUTH_ALT_INDEX]) - truth_alt0;
+        s.truth_vel = std::stof(truth[t][TRUTH_VEL_INDEX]);
+
+        if (out.samples.empty())
+            alt0 = s.altitude;
+        s.altitude -= alt0;
+        out.samples.push_back(s);
+    }
+
+    std::vector<float> vel;
+    for (const auto &s : out.samples)
+        vel.push_back(s.truth_vel);
+    out.truth_apogee = find_apogee(out.samples, vel);
+    return !out.samples.empty();
+}
+
+static score evaluate(const config &c, const std::vector<flight_log> &flights)
+{
+    double alt_sq = 0.0, vel_sq = 0.0, apogee = 0.0;
+    size_t n = 0;
+    std::vector<float> vel;
+
+    for (const auto &flight : flights)
+    {
+        Estimator estimator(c.sigma_accel, c.sigma_gyro, c.sigma_baro, c.threshold);
+        vel.clear();
+        for (const auto &s : flight.samples)
+        {
+            float accel[3] = {s.accel[0], s.accel[1], s.accel[2]};
+            float gyro[3] = {s.gyro[0], s.gyro[1], s.gyro[2]};
+            float mag[3] = {s.mag[0], s.mag[1], s.mag[2]};
+            estimator.estimate(accel, gyro, mag, s.altitude, s.time);
+
+            filter_estimates est = estimator.getEstimates();
+            float da = est.cf_results.altitude - s.truth_alt;
+            float dv = est.cf_results.vertical_velocity - s.truth_vel;
+            alt_sq += da * da;
+            vel_sq += dv * dv;
+            vel.push_back(est.cf_results.vertical_velocity);
+            n++;
+        }
+
+        uint32_t t = find_apogee(flight.samples, vel);
+        apogee += t ? fabs((double)t - (double)flight.truth_apogee) : 1e9;
+    }
+
+    return score{(float)sqrt(alt_sq / n), (float)sqrt(vel_sq / n), (float)(apogee / flights.size())};
+}
+
+// Each worker owns a deque of job indices and takes from its back, idle
+// workers steal from the front of someone else's. No jobs are added once
+// it starts, so a worker that finds every deque empty is done
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(int threads) : queues_(threads) {}
+
+    template <typename Fn>
+    void run(int jobs, Fn fn)
+    {
+        int threads = (int)queues_.size();
+        for (int i = 0; i < jobs; i++)
+            queues_[(int64_t)i * threads / jobs].jobs.push_back(i);
+
+        std::vector<std::thread> workers;
+        for (int w = 0; w < threads; w++)
+            workers.emplace_back([this, w, &fn]
+                                 {
+                                     int job;
+                                     while (next(w, job))
+                                         fn(job); });
+        for (auto &t : workers)
+            t.join();
+    }
+
+    int steals() const { return steals_; }
+
+private:
+    struct worker_queue
+    {
+        std::mutex lock;
+        std::deque<int> jobs;
+    };
+    std::vector<worker_queue> queues_;
+    std::atomic<int> steals_{0};
+
+    bool next(int w, int &job)
+    {
+        {
+            std::lock_guard<std::mutex> guard(queues_[w].lock);
+            if (!queues_[w].jobs.empty())
+            {
+                job = queues_[w].jobs.back();
+                queues_[w].jobs.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues_.size(); i++)
+        {
+            worker_queue &victim = queues_[(w + i) % queues_.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.jobs.empty())
+            {
+                job = victim.jobs.front();
+                victim.jobs.pop_front();
+                steals_++;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+static bool parse_range(const char *arg, param_range &r)
+{
+    float lo, hi;
+    int n;
+    if (sscanf(arg, "%f:%f:%d", &lo, &hi, &n) != 3 || lo <= 0.f || hi < lo || n < 1)
+    {
+        fprintf(stderr, "bad range '%s' for %s, want lo:hi:n with 0 < lo <= hi\n", arg, r.name);
+        return false;
+    }
+    r.lo = lo;
+    r.hi = hi;
+    r.n = n;
+    return true;
+}
+
+static float grid_point(const param_range &r, int i)
+{
+    if (r.n == 1)
+        return r.lo;
+    return r.lo * powf(r.hi / r.lo, (float)i / (r.n - 1));
+}
+
+int main(int argc, char **argv)
+{
+    param_range ranges[4] = {{"sigma-accel", 0.05f, 5.f, 8},
+                             {"sigma-gyro", 0.01f, 1.f, 4},
+                             {"sigma-baro", 0.1f, 10.f, 8},
+                             {"threshold", 0.02f, 2.f, 8}};
+    int random = 0;
+    unsigned seed = 1;
+    int threads = (int)std::thread::hardware_concurrency();
+    const char *sort_by = "alt";
+    int top = 10;
+    const char *csv_path = nullptr;
+    std::vector<const char *> paths;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        bool matched = false;
+        for (auto &r : ranges)
+            if (!strncmp(argv[i], "--", 2) && !strcmp(argv[i] + 2, r.name) && has_value)
+            {
+                if (!parse_range(argv[++i], r))
+                    return 1;
+                matched = true;
+            }
+        if (matched)
+            continue;
+
+        if (!strcmp(argv[i], "--random") && has_value)
+            random = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && has_value)
+            seed = (unsigned)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && has_value)
+            threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--sort") && has_value)
+            sort_by = argv[++i];
+        else if (!strcmp(argv[i], "--top") && has_value)
+            top = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--csv") && has_value)
+            csv_path = argv[++i];
+        else if (argv[i][0] != '-')
+            paths.push_back(argv[i]);
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (threads < 1)
+        threads = 1;
+    if (strcmp(sort_by, "alt") && strcmp(sort_by, "vel") && strcmp(sort_by, "apogee"))
+    {
+        fprintf(stderr, "--sort takes alt, vel or apogee\n");
+        return 1;
+    }
+    if (paths.empty())
+    {
+        paths.push_back("../data/tf2.csv");
+        paths.push_back("../data/sim_data/tf2_sim.csv");
+    }
+    if (paths.size() % 2)
+    {
+        fprintf(stderr, "logs come in pairs: log.csv truth.csv\n");
+        return 1;
+    }
+
+    std::vector<flight_log> flights;
+    for (size_t i = 0; i < paths.size(); i += 2)
+    {
+        flight_log f;
+        if (!load_flight(paths[i], paths[i + 1], f))
+            return 1;
+        printf("%s: %zu samples, reference apogee at %u ms\n", f.name.c_str(), f.samples.size(), f.truth_apogee);
+        flights.push_back(f);
+    }
+
+    std::vector<config> configs;
+    if (random > 0)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> u(0.f, 1.f);
+        for (int i = 0; i < random; i++)
+        {
+            float v[4];
+            for (int p = 0; p < 4; p++)
+                v[p] = ranges[p].lo * powf(ranges[p].hi / ranges[p].lo, u(rng));
+            configs.push_back(config{v[0], v[1], v[2], v[3]});
+        }
+    }
+    else
+    {
+        for (int a = 0; a < ranges[0].n; a++)
+            for (int g = 0; g < ranges[1].n; g++)
+                for (int b = 0; b < ranges[2].n; b++)
+                    for (int t = 0; t < ranges[3].n; t++)
+                        configs.push_back(config{grid_point(ranges[0], a), grid_point(ranges[1], g),
+                                                 grid_point(ranges[2], b), grid_point(ranges[3], t)});
+    }
+
+    // what the flight code runs today, for comparison
+    config current{SIGMA_ACCEL, SIGMA_GYRO, SIGMA_BARO, ACCEL_THRESHOLD};
+    score current_score = evaluate(current, flights);
+
+    std::vector<score> scores(configs.size());
+    WorkStealingPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    pool.run((int)configs.size(), [&](int i)
+             { scores[i] = evaluate(configs[i], flights); });
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%zu configurations x %zu logs on %d threads in %.2f s (%d steals)\n\n",
+           configs.size(), flights.size(), threads, elapsed, pool.steals());
+
+    auto key = [&](const score &s)
+    {
+        if (!strcmp(sort_by, "vel"))
+            return s.vel_rmse;
+        if (!strcmp(sort_by, "apogee"))
+            return s.apogee_err;
+        return s.alt_rmse;
+    };
+    std::vector<int> order(configs.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = (int)i;
+    // ties (apogee error is in whole log samples) go to the lower altitude error
+    std::sort(order.begin(), order.end(), [&](int a, int b)
+              {
+                  if (key(scores[a]) != key(scores[b]))
+                      return key(scores[a]) < key(scores[b]);
+                  return scores[a].alt_rmse < scores[b].alt_rmse; });
+
+    printf("sigma_accel  sigma_gyro  sigma_baro  threshold   alt rmse (m)  vel rmse (m/s)  apogee err (ms)\n");
+    auto print_row = [](const config &c, const score &s)
+    {
+        printf("%11.4f %11.4f %11.4f %10.4f %14.2f %15.2f %16.0f\n", c.sigma_accel, c.sigma_gyro,
+               c.sigma_baro, c.threshold, s.alt_rmse, s.vel_rmse, s.apogee_err);
+    };
+    for (int i = 0; i < top && i < (int)order.size(); i++)
+        print_row(configs[order[i]], scores[order[i]]);
+    printf("current StateDetermination.h values:\n");
+    print_row(current, current_score);
+
+    if (csv_path)
+    {
+        std::ofstream out(csv_path);
+        if (!out.is_open())
+        {
+            fprintf(stderr, "couldn't write %s\n", csv_path);
+            return 1;
+        }
+        out << "sigma_accel,sigma_gyro,sigma_baro,threshold,alt_rmse,vel_rmse,apogee_err_ms\n";
+        for (int i : order)
+            out << configs[i].sigma_accel << "," << configs[i].sigma_gyro << "," << configs[i].sigma_baro << ","
+                << configs[i].threshold << "," << scores[i].alt_rmse << "," << scores[i].vel_rmse << ","
+                << scores[i].apogee_err << "\n";
+    }
+
+    return 0;
+}
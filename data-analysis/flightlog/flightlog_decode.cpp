@@ -0,0 +1,716 @@
+/*
+    flightlog_decode.cpp: Flight log (flightlog.h) decoder and exporter
+
+    Maps a log the v2 firmware's FlightLogger wrote and decodes it on every
+    core:
+
+    1. find the blocks, each thread scanning its own slice of the file and
+       checking CRCs. A thread starting mid-block skips ahead to the first
+       intact header, so the slices join up where the one before's last
+       block ends
+    2. number the boots (one per schema block) and check each boot's schema
+       against the one this was built with, in file order
+    3. decode the record blocks, split between the threads by bytes, into
+       one array of rows per stream
+    4. per stream, unwrap t_us into 64 bits and count sequence gaps, then
+       write the output, formatting text on every thread
+
+    A damaged block is counted and skipped, the scan carries on at the next
+    intact one. A boot whose schema isn't this decoder's is skipped as a
+    whole, decode it with the decoder from that firmware's tree.
+
+    --format picks the output, in outdir:
+      csv  one <stream>.csv per stream: boot, seq, t_us and the fields
+      npy  one <stream>.npy per stream, a numpy structured array with the
+           same columns, for the notebooks: pd.DataFrame(np.load("imu.npy"))
+      tf2  flight.csv in the layout of data/tf2.csv (what state_replay and
+           plot_filter.py read), one row per IMU sample holding the latest
+           baro, GPS and estimator values, in tf2.csv's units
+
+    The columns and the record layouts come from the same X-macros the
+    firmware writes with, so this is rebuilt, not edited, when a stream
+    changes.
+
+    make, then ./flightlog_decode [--format csv|npy|tf2] [--threads n] flight.bin [outdir]
+*/
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "flightlog.h"
+
+// ------------------------------------------------------------------
+// decoded rows
+// ------------------------------------------------------------------
+
+// A decoded record: the boot it's from, its seq, t_us unwrapped to 64 bits
+// and the fields as the record has them. The npy output is these as they are
+#define ROW_HEADER_SIZE 12
+
+#define ROW_STRUCT(NAME, name, id, FIELDS)                                                  \
+    struct __attribute__((packed)) row_##name                                               \
+    {                                                                                       \
+        uint16_t boot;                                                                      \
+        uint16_t seq;                                                                       \
+        uint64_t t_us;                                                                      \
+        FIELDS(FLIGHTLOG_MEMBER)                                                            \
+    };                                                                                      \
+    static_assert(sizeof(row_##name) - ROW_HEADER_SIZE ==                                   \
+                      sizeof(flightlog_##name) - sizeof(flightlog_header),                  \
+                  "row_" #name " fields differ from the record's");
+FLIGHTLOG_STREAMS(ROW_STRUCT)
+#undef ROW_STRUCT
+
+static size_t row_size(int id)
+{
+    switch (id)
+    {
+#define ROW_SIZE(NAME, name, id, FIELDS) \
+    case id:                             \
+        return sizeof(row_##name);
+        FLIGHTLOG_STREAMS(ROW_SIZE)
+#undef ROW_SIZE
+    default:
+        return 0;
+    }
+}
+
+// one stream's rows, back to back
+struct stream_rows
+{
+    int id;
+    std::vector<uint8_t> data;
+    size_t count() const { return row_size(id) ? data.size() / row_size(id) : 0; }
+};
+
+// runs fn(t, begin, end) for threads slices of [0, n), one thread each
+template <class Fn>
+static void parallel(size_t n, int threads, Fn fn)
+{
+    std::vector<std::thread> pool;
+    size_t slice = (n + threads - 1) / threads;
+    for (int t = 0; t < threads; t++)
+    {
+        size_t begin = std::min(n, t * slice), end = std::min(n, begin + slice);
+        pool.emplace_back([=] { fn(t, begin, end); });
+    }
+    for (std::thread &th : pool)
+        th.join();
+}
+
+// ------------------------------------------------------------------
+// 1. blocks
+// ------------------------------------------------------------------
+
+// The same CRC-32 as gnc::crc32, eight bytes a step from 8 KB of tables
+// (slice-by-8). The firmware's four bits a step is what fits there, here
+// it would be most of the run time
+static uint32_t crc_table[8][256];
+
+static void crc_init()
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+        crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+        for (int t = 1; t < 8; t++)
+            crc_table[t][i] = (crc_table[t - 1][i] >> 8) ^ crc_table[0][crc_table[t - 1][i] & 0xFF];
+}
+
+static uint32_t crc_update(uint32_t crc, const uint8_t *p, size_t len)
+{
+    crc = ~crc;
+    for (; len >= 8; len -= 8, p += 8)
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^ crc_table[5][(lo >> 16) & 0xFF] ^
+              crc_table[4][lo >> 24] ^ crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^
+              crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+    }
+    for (; len; len--, p++)
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p) & 0xFF];
+    return ~crc;
+}
+
+// flightlog_block_valid() with the crc above
+static bool block_valid(const uint8_t *p, size_t avail)
+{
+    flightlog_block b;
+    if (avail < sizeof b)
+        return false;
+    memcpy(&b, p, sizeof b);
+    if (b.magic != FLIGHTLOG_BLOCK_MAGIC || b.version != FLIGHTLOG_VERSION || b.used < sizeof b ||
+        b.used > b.size || b.size > avail)
+        return false;
+    uint32_t crc = crc_update(0, p, offsetof(flightlog_block, crc));
+    return b.crc == crc_update(crc, p + sizeof b, b.used - sizeof b);
+}
+
+struct block_ref
+{
+    size_t offset;
+    flightlog_block h;
+    int boot;  // set by number_boots()
+    bool ours; // the boot's schema is this decoder's
+};
+
+// intact blocks starting in [begin, end): jump from one to the next, scan
+// byte by byte where that doesn't land on one
+static void scan_blocks(const uint8_t *log, size_t n, size_t begin, size_t end, std::vector<block_ref> &out)
+{
+    size_t pos = begin;
+    while (pos < end && pos + sizeof(flightlog_block) <= n)
+    {
+        if (block_valid(log + pos, n - pos))
+        {
+            block_ref b = {};
+            b.offset = pos;
+            memcpy(&b.h, log + pos, sizeof b.h);
+            out.push_back(b);
+            pos += b.h.size;
+        }
+        else
+            pos++;
+    }
+}
+
+struct scan_result
+{
+    std::vector<block_ref> blocks;
+    uint64_t skipped; // bytes not in an intact block: padding after a reset, torn blocks
+    uint64_t damaged; // block headers among them, i.e. blocks that failed their CRC
+};
+
+static scan_result find_blocks(const uint8_t *log, size_t n, int threads)
+{
+    std::vector<std::vector<block_ref>> parts(threads);
+    parallel(n, threads, [&](int t, size_t begin, size_t end) { scan_blocks(log, n, begin, end, parts[t]); });
+
+    // A slice's first finds can be inside the last block of the slice
+    // before (the magic turning up in its records, or a damaged block in
+    // there). Anything starting before that block ends is dropped
+    scan_result r = {};
+    size_t covered = 0;
+    for (const std::vector<block_ref> &part : parts)
+        for (const block_ref &b : part)
+            if (b.offset >= covered)
+            {
+                r.blocks.push_back(b);
+                covered = b.offset + b.h.size;
+            }
+
+    size_t pos = 0;
+    auto gap = [&](size_t from, size_t to) {
+        r.skipped += to - from;
+        for (size_t i = from; i + sizeof(uint32_t) <= to; i++)
+        {
+            uint32_t magic;
+            memcpy(&magic, log + i, sizeof magic);
+            if (magic == FLIGHTLOG_BLOCK_MAGIC)
+                r.damaged++;
+        }
+    };
+    for (const block_ref &b : r.blocks)
+    {
+        gap(pos, b.offset);
+        pos = b.offset + b.h.size;
+    }
+    gap(pos, n);
+    return r;
+}
+
+// ------------------------------------------------------------------
+// 2. boots
+// ------------------------------------------------------------------
+
+struct boot_stats
+{
+    int boots;
+    uint64_t block_gaps;
+    uint64_t foreign_blocks;
+};
+
+static boot_stats number_boots(const uint8_t *log, std::vector<block_ref> &blocks)
+{
+    static const char schema[] = FLIGHTLOG_SCHEMA;
+    boot_stats s = {};
+    int boot = -1;
+    bool ours = true; // records before the first schema block (it was lost) are taken to be ours, as boot 0
+    uint32_t next_seq = 0;
+    for (block_ref &b : blocks)
+    {
+        const char *body = (const char *)log + b.offset + sizeof(flightlog_block);
+        size_t body_len = b.h.used - sizeof(flightlog_block);
+        if (b.h.kind == FLIGHTLOG_BLOCK_SCHEMA)
+        {
+            boot++;
+            ours = body_len == sizeof(schema) - 1 && memcmp(body, schema, body_len) == 0;
+            if (!ours)
+                fprintf(stderr, "boot %d: schema isn't this decoder's, skipping its records:\n%.*s\n", boot,
+                        (int)body_len, body);
+        }
+        else if (b.h.seq != next_seq)
+            s.block_gaps++;
+        next_seq = b.h.seq + 1;
+
+        b.boot = boot < 0 ? 0 : boot;
+        b.ours = ours;
+        if (b.h.kind == FLIGHTLOG_BLOCK_RECORDS && !ours)
+            s.foreign_blocks++;
+    }
+    s.boots = boot + 1;
+    return s;
+}
+
+// ------------------------------------------------------------------
+// 3. records
+// ------------------------------------------------------------------
+
+struct decode_part
+{
+    std::vector<uint8_t> rows[FLIGHTLOG_STREAM_IDS];
+    uint64_t bad_records;
+};
+
+static void decode_blocks(const uint8_t *log, const block_ref *blocks, size_t count, decode_part &out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const block_ref &b = blocks[i];
+        if (b.h.kind != FLIGHTLOG_BLOCK_RECORDS || !b.ours)
+            continue;
+
+        const uint8_t *body = log + b.offset + sizeof(flightlog_block);
+        size_t len = b.h.used - sizeof(flightlog_block), off = 0;
+        while (off + sizeof(flightlog_header) <= len)
+        {
+            flightlog_header h;
+            memcpy(&h, body + off, sizeof h);
+            if (h.size < sizeof(flightlog_header) || off + h.size > len)
+            {
+                out.bad_records++;
+                break;
+            }
+            size_t size = h.stream < FLIGHTLOG_STREAM_IDS ? row_size(h.stream) : 0;
+            if (!size || h.size - sizeof h != size - ROW_HEADER_SIZE)
+                out.bad_records++;
+            else
+            {
+                // t_us as it is for now, unwrap() makes it 64 bits once the
+                // rows are in order
+                std::vector<uint8_t> &rows = out.rows[h.stream];
+                size_t at = rows.size();
+                rows.resize(at + size);
+                uint8_t *row = &rows[at];
+                uint16_t boot = (uint16_t)b.boot;
+                uint64_t t_us = h.t_us;
+                memcpy(row, &boot, 2);
+                memcpy(row + 2, &h.seq, 2);
+                memcpy(row + 4, &t_us, 8);
+                memcpy(row + ROW_HEADER_SIZE, body + off + sizeof h, h.size - sizeof h);
+            }
+            off += h.size;
+        }
+    }
+}
+
+// ------------------------------------------------------------------
+// 4. per stream
+// ------------------------------------------------------------------
+
+// t_us is the low 32 bits of esp_timer and wraps every 71 minutes, carried
+// into 64 bits here. Returns the records missing going by seq
+static uint64_t unwrap(stream_rows &s)
+{
+    size_t size = row_size(s.id), n = s.count();
+    uint64_t missing = 0, t64 = 0;
+    uint16_t last_boot = 0, last_seq = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t *row = &s.data[i * size];
+        uint16_t boot, seq;
+        uint64_t t;
+        memcpy(&boot, row, 2);
+        memcpy(&seq, row + 2, 2);
+        memcpy(&t, row + 4, 8);
+        if (i == 0 || boot != last_boot)
+            t64 = t;
+        else
+        {
+            t64 += (uint32_t)((uint32_t)t - (uint32_t)t64);
+            missing += (uint16_t)(seq - last_seq - 1);
+        }
+        last_boot = boot;
+        last_seq = seq;
+        memcpy(row + 4, &t64, 8);
+    }
+    return missing;
+}
+
+// one value per field type, as text that reads back to the same number
+static void put(std::string &s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void put(std::string &s, const char *fmt, ...)
+{
+    char buf[32];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof buf, fmt, args);
+    va_end(args);
+    s.append(buf, n);
+}
+inline void put(std::string &s, flightlog_u8 v) { put(s, ",%u", (unsigned)v); }
+inline void put(std::string &s, flightlog_u16 v) { put(s, ",%u", (unsigned)v); }
+inline void put(std::string &s, flightlog_u32 v) { put(s, ",%lu", (unsigned long)v); }
+inline void put(std::string &s, flightlog_i16 v) { put(s, ",%d", (int)v); }
+inline void put(std::string &s, flightlog_i32 v) { put(s, ",%ld", (long)v); }
+inline void put(std::string &s, flightlog_f32 v) { put(s, ",%.9g", (double)v); }
+inline void put(std::string &s, flightlog_f64 v) { put(s, ",%.17g", v); }
+
+// the text of fn(begin, end, text) over threads slices of n rows, written
+// out in order
+template <class Fn>
+static void write_rows(FILE *f, size_t n, int threads, Fn fn)
+{
+    std::vector<std::string> text(threads);
+    parallel(n, threads, [&](int t, size_t begin, size_t end) { fn(begin, end, text[t]); });
+    for (const std::string &s : text)
+        fwrite(s.data(), 1, s.size(), f);
+}
+
+static void format_rows(const stream_rows &s, size_t begin, size_t end, std::string &out)
+{
+    size_t size = row_size(s.id);
+    for (size_t i = begin; i < end; i++)
+    {
+        const uint8_t *p = &s.data[i * size];
+        switch (s.id)
+        {
+#define VALUE(type, name) put(out, r.name);
+#define FORMAT(NAME, name, id, FIELDS)                                                            \
+    case id:                                                                                      \
+    {                                                                                             \
+        row_##name r;                                                                             \
+        memcpy(&r, p, sizeof r);                                                                  \
+        put(out, "%u,%u,%llu", (unsigned)r.boot, (unsigned)r.seq, (unsigned long long)r.t_us);    \
+        FIELDS(VALUE)                                                                             \
+        break;                                                                                    \
+    }
+            FLIGHTLOG_STREAMS(FORMAT)
+#undef FORMAT
+#undef VALUE
+        }
+        out += '\n';
+    }
+}
+
+static FILE *create(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+        fprintf(stderr, "can't write %s\n", path.c_str());
+    return f;
+}
+
+static bool write_csv(const std::string &dir, const char *name, const char *columns, const stream_rows &s,
+                      int threads)
+{
+    FILE *f = create(dir + "/" + name + ".csv");
+    if (!f)
+        return false;
+    fprintf(f, "boot,seq,t_us%s\n", columns);
+    write_rows(f, s.count(), threads,
+               [&](size_t begin, size_t end, std::string &out) { format_rows(s, begin, end, out); });
+    return fclose(f) == 0;
+}
+
+// numpy's names for the field types
+#define NPY_u8 "|u1"
+#define NPY_u16 "<u2"
+#define NPY_u32 "<u4"
+#define NPY_i16 "<i2"
+#define NPY_i32 "<i4"
+#define NPY_f32 "<f4"
+#define NPY_f64 "<f8"
+
+// .npy version 1.0: magic, header length, the dtype and shape as a python
+// dict padded so the data starts 64 byte aligned, then the rows as they are
+static bool write_npy(const std::string &dir, const char *name, const char *descr, const stream_rows &s)
+{
+    FILE *f = create(dir + "/" + name + ".npy");
+    if (!f)
+        return false;
+    std::string header = std::string("{'descr': [('boot', '<u2'), ('seq', '<u2'), ('t_us', '<u8'), ") + descr +
+                         "], 'fortran_order': False, 'shape': (" + std::to_string(s.count()) + ",), }";
+    size_t total = 10 + header.size() + 1;
+    header.append((64 - total % 64) % 64, ' ');
+    header += '\n';
+    uint16_t len = (uint16_t)header.size();
+    fwrite("\x93NUMPY\x01\x00", 1, 8, f);
+    fwrite(&len, sizeof len, 1, f);
+    fwrite(header.data(), 1, header.size(), f);
+    fwrite(s.data.data(), 1, s.data.size(), f);
+    return fclose(f) == 0;
+}
+
+// ------------------------------------------------------------------
+// tf2.csv layout
+// ------------------------------------------------------------------
+
+static const char TF2_COLUMNS[] =
+    "STATE,time (ms),external temperature (C),av bay temperature (C),barometer temp (C),air pressure (kPa),"
+    "altitude (m),kf vertical velocity (m/s),kf vertical acceleration (m/s^2),kf altitude (m),"
+    "x acceleration (m/s^2),y acceleration (m/s^2),z acceleration (m/s^2),"
+    "x magnetic force (gauss),y magnetic force (gauss),z magnetic force (gauss),"
+    "x gyro (dps),y gyro (dps),z gyro (dps),"
+    "gps lat,gps long,gps speed,gps angle,gps altitude,gps fix,gps fix quality,gps satellites,"
+    "gps antenna status,error flags\n";
+
+static const float G = 9.80665f;
+static const float DEG_PER_RAD = 57.2957795f;
+
+template <class Row>
+static Row row_at(const stream_rows &s, size_t i)
+{
+    Row r;
+    memcpy(&r, &s.data[i * sizeof(Row)], sizeof r);
+    return r;
+}
+
+// for each IMU row, the last row of another stream at or before it in the
+// same boot, -1 if there's none yet
+template <class Row>
+static std::vector<long> hold(const stream_rows &imu, const stream_rows &other)
+{
+    size_t n = imu.count(), m = other.count(), j = 0;
+    std::vector<long> at(n, -1);
+    long last = -1;
+    int boot = -1;
+    for (size_t i = 0; i < n; i++)
+    {
+        row_imu r = row_at<row_imu>(imu, i);
+        if (r.boot != boot)
+        {
+            boot = r.boot;
+            last = -1;
+        }
+        for (; j < m; j++)
+        {
+            Row o = row_at<Row>(other, j);
+            if (o.boot > r.boot || (o.boot == r.boot && o.t_us > r.t_us))
+                break;
+            if (o.boot == r.boot)
+                last = (long)j;
+        }
+        at[i] = last;
+    }
+    return at;
+}
+
+static bool write_tf2(const std::string &dir, const std::vector<stream_rows> &streams, int threads)
+{
+    const stream_rows &imu = streams[(int)flightlog_stream::IMU];
+    const stream_rows &baro = streams[(int)flightlog_stream::BARO];
+    const stream_rows &gps = streams[(int)flightlog_stream::GPS];
+    const stream_rows &est = streams[(int)flightlog_stream::ESTIMATOR];
+    std::vector<long> baro_at = hold<row_baro>(imu, baro), gps_at = hold<row_gps>(imu, gps),
+                      est_at = hold<row_estimator>(imu, est);
+
+    FILE *f = create(dir + "/flight.csv");
+    if (!f)
+        return false;
+    fputs(TF2_COLUMNS, f);
+    write_rows(f, imu.count(), threads, [&](size_t begin, size_t end, std::string &out) {
+        for (size_t i = begin; i < end; i++)
+        {
+            row_imu m = row_at<row_imu>(imu, i);
+
+            // blank where a stream has nothing yet, and for what isn't logged
+            if (est_at[i] >= 0)
+                put(out, "%u", (unsigned)row_at<row_estimator>(est, est_at[i]).state);
+            put(out, ",%llu,", (unsigned long long)(m.t_us / 1000));
+            put(out, (flightlog_f32)m.temp);
+            if (baro_at[i] >= 0)
+            {
+                row_baro b = row_at<row_baro>(baro, baro_at[i]);
+                put(out, (flightlog_f32)b.temp);
+                put(out, (flightlog_f32)(b.pressure / 100.f)); // hPa, which is what tf2.csv has under its kPa header
+                put(out, (flightlog_f32)b.altitude);
+            }
+            else
+                out += ",,,";
+            if (est_at[i] >= 0)
+            {
+                row_estimator e = row_at<row_estimator>(est, est_at[i]);
+                put(out, (flightlog_f32)e.vertical_velocity);
+                put(out, (flightlog_f32)e.vertical_accel);
+                put(out, (flightlog_f32)e.altitude);
+            }
+            else
+                out += ",,,";
+            put(out, (flightlog_f32)(m.accel_x * G));
+            put(out, (flightlog_f32)(m.accel_y * G));
+            put(out, (flightlog_f32)(m.accel_z * G));
+            put(out, (flightlog_f32)(m.mag_x / 100.f)); // uT to gauss
+            put(out, (flightlog_f32)(m.mag_y / 100.f));
+            put(out, (flightlog_f32)(m.mag_z / 100.f));
+            put(out, (flightlog_f32)(m.gyro_x * DEG_PER_RAD));
+            put(out, (flightlog_f32)(m.gyro_y * DEG_PER_RAD));
+            put(out, (flightlog_f32)(m.gyro_z * DEG_PER_RAD));
+            if (gps_at[i] >= 0)
+            {
+                row_gps g = row_at<row_gps>(gps, gps_at[i]);
+                put(out, (flightlog_f64)g.lat);
+                put(out, (flightlog_f64)g.lon);
+                put(out, (flightlog_f32)g.speed);
+                put(out, (flightlog_f32)g.cog);
+                put(out, (flightlog_f32)g.alt);
+                put(out, (flightlog_u8)g.fix_valid);
+                put(out, (flightlog_u8)g.fix_status);
+                put(out, (flightlog_u8)g.num_sats);
+            }
+            else
+                out += ",,,,,,,,";
+            out += ",,\n";
+        }
+    });
+    return fclose(f) == 0;
+}
+
+// ------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    std::string format = "csv";
+    int threads = (int)std::thread::hardware_concurrency();
+    std::vector<const char *> args;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--format") && i + 1 < argc)
+            format = argv[++i];
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else
+            args.push_back(argv[i]);
+    }
+    if (args.empty() || (format != "csv" && format != "npy" && format != "tf2"))
+    {
+        fprintf(stderr, "usage: %s [--format csv|npy|tf2] [--threads n] flight.bin [outdir]\n", argv[0]);
+        return 2;
+    }
+    threads = std::max(threads, 1);
+    std::string dir = args.size() > 1 ? args[1] : ".";
+
+    int fd = open(args[0], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        fprintf(stderr, "can't read %s\n", args[0]);
+        return 1;
+    }
+    size_t n = (size_t)st.st_size;
+    const uint8_t *log = nullptr;
+    if (n)
+    {
+        void *map = mmap(nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            fprintf(stderr, "can't map %s\n", args[0]);
+            return 1;
+        }
+        log = (const uint8_t *)map;
+    }
+    close(fd);
+
+    crc_init();
+    scan_result scan = find_blocks(log, n, threads);
+    boot_stats boots = number_boots(log, scan.blocks);
+
+    // the blocks split between the threads by where they are in the file,
+    // so each gets about the same bytes
+    std::vector<size_t> first(threads + 1, scan.blocks.size());
+    for (int t = 0; t < threads; t++)
+        first[t] = std::lower_bound(scan.blocks.begin(), scan.blocks.end(), n / threads * t,
+                                    [](const block_ref &b, size_t pos) { return b.offset < pos; }) -
+                   scan.blocks.begin();
+    std::vector<decode_part> parts(threads);
+    parallel(threads, threads, [&](int t, size_t, size_t) {
+        parts[t].bad_records = 0;
+        decode_blocks(log, scan.blocks.data() + first[t], first[t + 1] - first[t], parts[t]);
+    });
+
+    // joined up per stream in file order
+    std::vector<stream_rows> streams(FLIGHTLOG_STREAM_IDS);
+    uint64_t bad_records = 0;
+    for (int id = 0; id < FLIGHTLOG_STREAM_IDS; id++)
+    {
+        stream_rows &s = streams[id];
+        s.id = id;
+        size_t total = 0;
+        for (const decode_part &p : parts)
+            total += p.rows[id].size();
+        s.data.reserve(total);
+        for (decode_part &p : parts)
+        {
+            s.data.insert(s.data.end(), p.rows[id].begin(), p.rows[id].end());
+            std::vector<uint8_t>().swap(p.rows[id]);
+        }
+    }
+    for (const decode_part &p : parts)
+        bad_records += p.bad_records;
+
+    std::vector<uint64_t> missing(FLIGHTLOG_STREAM_IDS);
+    parallel(FLIGHTLOG_STREAM_IDS, FLIGHTLOG_STREAM_IDS,
+             [&](int id, size_t, size_t) { missing[id] = row_size(id) ? unwrap(streams[id]) : 0; });
+
+    bool ok = true;
+    if (format == "csv")
+    {
+#define COLUMN(type, name) "," #name
+#define CSV(NAME, name, id, FIELDS) ok &= write_csv(dir, #name, "" FIELDS(COLUMN), streams[id], threads);
+        FLIGHTLOG_STREAMS(CSV)
+#undef CSV
+#undef COLUMN
+    }
+    else if (format == "npy")
+    {
+#define DESCR(type, name) "('" #name "', '" NPY_##type "'), "
+#define NPY(NAME, name, id, FIELDS) ok &= write_npy(dir, #name, "" FIELDS(DESCR), streams[id]);
+        FLIGHTLOG_STREAMS(NPY)
+#undef NPY
+#undef DESCR
+    }
+    else
+        ok = write_tf2(dir, streams, threads);
+
+    printf("%zu bytes, %zu blocks over %d boot(s)\n", n, scan.blocks.size(), boots.boots);
+    printf("crc failures %llu, bytes skipped %llu, block gaps %llu, bad records %llu, blocks of another schema %llu\n",
+           (unsigned long long)scan.damaged, (unsigned long long)scan.skipped,
+           (unsigned long long)boots.block_gaps, (unsigned long long)bad_records,
+           (unsigned long long)boots.foreign_blocks);
+    printf("stream       records   missing\n");
+#define SUMMARY(NAME, name, id, FIELDS) \
+    printf("%-10s %9zu %9llu\n", #name, streams[id].count(), (unsigned long long)missing[id]);
+    FLIGHTLOG_STREAMS(SUMMARY)
+#undef SUMMARY
+    if (!ok)
+        return 1;
+    return scan.damaged || bad_records ? 1 : 0;
+}
@@ -0,0 +1,130 @@
+/*
+    flightlog_extract.cpp: Raw log region (flightlog.h) to a plain flight log
+
+    In raw mode the firmware writes the log straight to the sectors of a
+    region on the card. This finds the region in a card image (dd of the
+    whole card) or in the region's file copied off the card, and writes
+    the log in it out as an ordinary log for flightlog_decode:
+
+    1. every sector is checked for a superblock, the intact one with the
+       highest seq is the current one. Its copy number and the region's
+       start sector say where the region is in the input, which works the
+       same for an image and for the file
+    2. each extent (one per boot) is copied as the superblock has it
+    3. past what the superblock recorded, blocks are followed as long as
+       their CRCs check out, up to the next extent: what a boot wrote
+       after the superblock's last update, the end of a flight cut short by
+       a reset or the battery
+
+    make, then ./flightlog_extract card.img flight.bin
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "flightlog.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s card.img flight.bin\n", argv[0]);
+        return 2;
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        fprintf(stderr, "can't read %s\n", argv[1]);
+        return 1;
+    }
+    size_t n = (size_t)st.st_size;
+    const uint8_t *image = nullptr;
+    if (n)
+    {
+        void *map = mmap(nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            fprintf(stderr, "can't map %s\n", argv[1]);
+            return 1;
+        }
+        image = (const uint8_t *)map;
+    }
+    close(fd);
+
+    const size_t SECTOR = FLIGHTLOG_RAW_SECTOR;
+    flightlog_raw_superblock sb = {};
+    size_t base = 0;
+    bool found = false;
+    for (size_t off = 0; off + SECTOR <= n; off += SECTOR)
+    {
+        if (!flightlog_raw_valid(image + off))
+            continue;
+        const flightlog_raw_superblock *s = (const flightlog_raw_superblock *)(image + off);
+        if (off < s->copy * SECTOR || (found && s->seq <= sb.seq))
+            continue;
+        memcpy(&sb, s, sizeof sb);
+        base = off - sb.copy * SECTOR;
+        found = true;
+    }
+    if (!found)
+    {
+        fprintf(stderr, "no raw log superblock in %s\n", argv[1]);
+        return 1;
+    }
+
+    size_t region_end = base + (size_t)sb.region_sectors * SECTOR;
+    printf("region at card sector %lu, %lu sectors, superblock seq %lu, %lu extent(s)\n",
+           (unsigned long)sb.region_start, (unsigned long)sb.region_sectors, (unsigned long)sb.seq,
+           (unsigned long)sb.extent_count);
+    if (region_end > n)
+    {
+        fprintf(stderr, "the input stops %zu bytes short of the region's end\n", region_end - n);
+        region_end = n;
+    }
+
+    FILE *out = fopen(argv[2], "wb");
+    if (!out)
+    {
+        fprintf(stderr, "can't write %s\n", argv[2]);
+        return 1;
+    }
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < sb.extent_count; i++)
+    {
+        const flightlog_raw_extent &e = sb.extents[i];
+        size_t from = base + (size_t)e.first * SECTOR;
+        size_t limit = i + 1 < sb.extent_count ? base + (size_t)sb.extents[i + 1].first * SECTOR : region_end;
+        if (limit > region_end)
+            limit = region_end;
+        size_t recorded = from + (size_t)e.sectors * SECTOR;
+        if (from > limit || recorded > limit)
+        {
+            fprintf(stderr, "extent %lu is outside the region, skipped\n", (unsigned long)i);
+            continue;
+        }
+
+        size_t end = recorded;
+        while (end < limit && flightlog_block_valid(image + end, limit - end))
+            end += ((const flightlog_block *)(image + end))->size;
+
+        fwrite(image + from, 1, end - from, out);
+        total += end - from;
+        printf("extent %2lu  sector %8lu  %10zu bytes recorded  %8zu more found after\n", (unsigned long)i,
+               (unsigned long)e.first, recorded - from, end - recorded);
+    }
+    if (fclose(out) != 0)
+    {
+        fprintf(stderr, "can't write %s\n", argv[2]);
+        return 1;
+    }
+    printf("%llu bytes of log to %s\n", (unsigned long long)total, argv[2]);
+    return 0;
+}
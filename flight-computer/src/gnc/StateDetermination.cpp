@@ -0,0 +1,253 @@
+/**************************************************************
+ *
+ *                     StateDetermination.cpp
+ *
+ *     Author(s):  Daniel Opara
+ *     Date:       3/20/2024
+ *
+ *     Overview: Implementation of StateDetermination.h
+ *
+ *
+ **************************************************************/
+
+#include "StateDetermination.h"
+
+// Rows for a state have to be next to each other and in rocket_state order.
+// When a state has more than one row the first one to fire wins
+static const transition_rule transition_table[] = {
+    {rocket_state::LAUNCH_READY, rocket_state::POWERED_FLIGHT_PHASE, state_signal::VERTICAL_ACCEL,
+     true, LAUNCH_ACCEL, LAUNCH_ACCEL_RELEASE, STATE_DEBOUNCE_SAMPLES},
+    {rocket_state::POWERED_FLIGHT_PHASE, rocket_state::BURNOUT_PHASE, state_signal::VERTICAL_ACCEL,
+     false, BURNOUT_ACCEL, BURNOUT_ACCEL_RELEASE, STATE_DEBOUNCE_SAMPLES},
+    // burnout never seen, don't let that hold up apogee
+    {rocket_state::POWERED_FLIGHT_PHASE, rocket_state::APOGEE_PHASE, state_signal::VERTICAL_VELOCITY,
+     false, APOGEE_VELOCITY, APOGEE_VELOCITY_RELEASE, STATE_DEBOUNCE_SAMPLES},
+    // burnout and apogee are only passed through, one sample later
+    {rocket_state::BURNOUT_PHASE, rocket_state::COAST_PHASE, state_signal::TIME_IN_STATE,
+     true, 0.f, 0.f, 1},
+    // once the ApogeePredictor arms it this only needs APOGEE_ARMED_SAMPLES,
+    // see updateState
+    {rocket_state::COAST_PHASE, rocket_state::APOGEE_PHASE, state_signal::VERTICAL_VELOCITY,
+     false, APOGEE_VELOCITY, APOGEE_VELOCITY_RELEASE, STATE_DEBOUNCE_SAMPLES},
+    {rocket_state::APOGEE_PHASE, rocket_state::DROGUE_DEPLOYED, state_signal::TIME_IN_STATE,
+     true, 0.f, 0.f, 1},
+    {rocket_state::DROGUE_DEPLOYED, rocket_state::MAIN_DEPLOY_ATTEMPT, state_signal::ALTITUDE_AGL,
+     false, MAIN_DEPLOY_ALTITUDE, MAIN_DEPLOY_ALTITUDE + MAIN_DEPLOY_RELEASE, STATE_DEBOUNCE_SAMPLES},
+    {rocket_state::MAIN_DEPLOY_ATTEMPT, rocket_state::MAIN_DEPLOYED, state_signal::VERTICAL_VELOCITY,
+     true, MAIN_OPEN_VELOCITY, MAIN_OPEN_VELOCITY_RELEASE, STATE_DEBOUNCE_SAMPLES},
+    {rocket_state::MAIN_DEPLOY_ATTEMPT, rocket_state::RECOVERY, state_signal::ALTITUDE_AGL,
+     false, LANDED_ALTITUDE, LANDED_ALTITUDE_RELEASE, STATE_DEBOUNCE_SAMPLES},
+    {rocket_state::MAIN_DEPLOYED, rocket_state::RECOVERY, state_signal::ALTITUDE_AGL,
+     false, LANDED_ALTITUDE, LANDED_ALTITUDE_RELEASE, STATE_DEBOUNCE_SAMPLES},
+};
+
+static const uint8_t transition_count = sizeof(transition_table) / sizeof(transition_table[0]);
+
+StateDeterminer::StateDeterminer()
+    : estimator_(SIGMA_ACCEL, SIGMA_GYRO, SIGMA_BARO, ACCEL_THRESHOLD),
+      landed_accel_(LANDED_WINDOW, LANDED_ACCEL), landed_velocity_(LANDED_WINDOW, LANDED_VELOCITY)
+{
+  static_assert(sizeof(transition_table) / sizeof(transition_table[0]) <= max_rules_,
+                "transition table is bigger than the debounce state");
+
+  curr_state_ = rocket_state::LAUNCH_READY;
+  state_entered_ms_ = 0;
+  pad_altitude_ = 0.f;
+  apogee_ = apogee_prediction{0.f, 0.f};
+  apogee_arm_count_ = 0;
+  apogee_armed_ = false;
+  resetLanded();
+  first_step_ = false;
+
+  uint8_t row = 0;
+  for (int s = 0; s <= (int)rocket_state::STATE_COUNT; s++)
+  {
+    while (row < transition_count && (int)transition_table[row].from < s)
+      row++;
+    first_rule_[s] = row;
+  }
+  for (uint8_t k = 0; k < max_rules_; k++)
+  {
+    counts_[k] = 0;
+    run_start_ms_[k] = 0;
+  }
+}
+
+StateDeterminer::~StateDeterminer()
+{
+}
+
+filter_estimates StateDeterminer::determineState(float accel_data[3], float gyro_data[3], float mag_data[3], float altitude, unsigned long curr_time)
+{
+  if (first_step_ == false)
+  {
+    estimator_.setInitTime(0);
+    state_entered_ms_ = (uint32_t)curr_time;
+    first_step_ = true;
+  }
+
+  estimator_.estimate(accel_data, gyro_data, mag_data, altitude, curr_time);
+
+  filter_estimates est = estimator_.getEstimates();
+  updateState(est, (uint32_t)curr_time);
+  updateLanded(accel_data, est, (uint32_t)curr_time);
+  return est;
+}
+
+flight_checkpoint StateDeterminer::getCheckpoint(unsigned long curr_time) const
+{
+  flight_checkpoint cp;
+  cp.estimator = estimator_.getCheckpoint();
+  cp.state = curr_state_;
+  cp.time_in_state_ms = (uint32_t)curr_time - state_entered_ms_;
+  cp.pad_altitude = pad_altitude_;
+  cp.drag_coefficient = apogee_predictor_.getDragCoefficient();
+  return cp;
+}
+
+void StateDeterminer::restoreCheckpoint(const flight_checkpoint &cp, unsigned long curr_time, float gap_s)
+{
+  estimator_.restoreCheckpoint(cp.estimator, gap_s);
+  // the estimator channels start over on their own, so no setInitTime
+  first_step_ = true;
+
+  curr_state_ = cp.state;
+  state_entered_ms_ = (uint32_t)curr_time - cp.time_in_state_ms - (uint32_t)(gap_s * 1000.f);
+  pad_altitude_ = cp.pad_altitude;
+  apogee_predictor_.setDragCoefficient(cp.drag_coefficient);
+  apogee_ = apogee_prediction{0.f, 0.f};
+  apogee_arm_count_ = 0;
+  apogee_armed_ = false;
+  resetLanded();
+
+  for (uint8_t k = 0; k < max_rules_; k++)
+    counts_[k] = 0;
+  transitions_.clear();
+}
+
+// at most a couple of table rows per state, so this costs the same every step
+void StateDeterminer::updateState(const filter_estimates &est, uint32_t time_ms)
+{
+  // altitudes are judged from the pad, which is wherever we sat before launch
+  if (curr_state_ == rocket_state::LAUNCH_READY)
+    pad_altitude_ = est.cf_results.altitude;
+  float altitude_agl = est.cf_results.altitude - pad_altitude_;
+  apogee_ = apogee_predictor_.update(altitude_agl, est.cf_results.vertical_velocity, est.vertical_accel,
+                                     curr_state_ == rocket_state::COAST_PHASE);
+
+  // the prediction only arms apogee, it never deploys anything on its own.
+  // Armed, the velocity row below fires on its first sample past zero
+  // instead of waiting out the debounce
+  if (curr_state_ == rocket_state::COAST_PHASE && !apogee_armed_)
+  {
+    if (apogee_.time_to_apogee < APOGEE_LEAD_TIME)
+      apogee_armed_ = ++apogee_arm_count_ >= STATE_DEBOUNCE_SAMPLES;
+    else if (apogee_.time_to_apogee > APOGEE_LEAD_RELEASE)
+      apogee_arm_count_ = 0;
+  }
+
+  int state = (int)curr_state_;
+  for (uint8_t k = first_rule_[state]; k < first_rule_[state + 1]; k++)
+  {
+    const transition_rule &rule = transition_table[k];
+
+    float value;
+    switch (rule.signal)
+    {
+    case state_signal::VERTICAL_ACCEL:
+      value = est.vertical_accel;
+      break;
+    case state_signal::VERTICAL_VELOCITY:
+      value = est.cf_results.vertical_velocity;
+      break;
+    case state_signal::ALTITUDE_AGL:
+      value = altitude_agl;
+      break;
+    default:
+      value = (time_ms - state_entered_ms_) * 0.001f;
+      break;
+    }
+
+    bool triggered = rule.rising ? value > rule.trigger : value < rule.trigger;
+    bool released = rule.rising ? value < rule.release : value > rule.release;
+
+    uint8_t samples = rule.samples;
+    if (apogee_armed_ && rule.to == rocket_state::APOGEE_PHASE)
+      samples = APOGEE_ARMED_SAMPLES;
+
+    if (triggered)
+    {
+      if (counts_[k] == 0)
+        run_start_ms_[k] = time_ms;
+      if (++counts_[k] >= samples)
+      {
+        enterState(rule.to, run_start_ms_[k], time_ms);
+        return;
+      }
+    }
+    else if (released)
+    {
+      counts_[k] = 0;
+    }
+  }
+}
+
+void StateDeterminer::resetLanded()
+{
+  landed_accel_.reset();
+  landed_velocity_.reset();
+  still_since_ms_ = 0;
+  still_ = false;
+  landed_ = false;
+}
+
+// the altitude alone can't tell hanging under the main at 50 m from lying in
+// the field, a rocket on the ground reads g and nothing else and has stopped
+// going down. The detectors start out quiet, so they need a full window first
+void StateDeterminer::updateLanded(const float accel[3], const filter_estimates &est, uint32_t time_ms)
+{
+  if (landed_ || curr_state_ < rocket_state::DROGUE_DEPLOYED)
+    return;
+
+  float accel_norm = sqrtf(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+  bool accel_quiet = landed_accel_.add(accel_norm - GRAVITY) && landed_accel_.full();
+  bool velocity_quiet = landed_velocity_.add(est.cf_results.vertical_velocity) && landed_velocity_.full();
+  if (!accel_quiet || !velocity_quiet)
+  {
+    still_ = false;
+    return;
+  }
+
+  if (!still_)
+  {
+    still_ = true;
+    still_since_ms_ = time_ms;
+  }
+  landed_ = time_ms - still_since_ms_ >= LANDED_HOLD_MS;
+}
+
+void StateDeterminer::enterState(rocket_state next, uint32_t trigger_ms, uint32_t time_ms)
+{
+  transitions_.push(state_transition_event{curr_state_, next, trigger_ms, time_ms});
+
+  curr_state_ = next;
+  state_entered_ms_ = time_ms;
+  for (uint8_t k = first_rule_[(int)next]; k < first_rule_[(int)next + 1]; k++)
+    counts_[k] = 0;
+}
+
+// void StateDeterminer::switchGroundState(BBManager &manager, uint64_t packet)
+// {
+//   // 0x53504F = SPO in ASCII = 5460047 in decimal = Switch Power On
+//   // 0x534C52 = SLR in ASCII = 5459026 in decimal = Switch Launch Ready
+//   if (packet == 5460047)
+//   {
+//     manager.curr_state = state::POWER_ON;
+//     return;
+//   }
+//   if (packet == 5459026)
+//   {
+//     manager.curr_state = state::LAUNCH_READY;
+//     return;
+//   }
+// }
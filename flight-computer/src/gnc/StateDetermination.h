@@ -0,0 +1,185 @@
+/**************************************************************
+ *
+ *                     StateDetermination.h
+ *
+ *     Author(s):  Daniel Opara
+ *     Date:       3/20/2024
+ *
+ *
+ *
+ **************************************************************/
+
+#ifndef STATE_DETERMINATION_H
+#define STATE_DETERMINATION_H
+
+#include <inttypes.h>
+#include "altitude.h"
+#include "apogee.h"
+
+// standard noise deviation, calculated by Daniel TODO: OUTDATED, UPDATE THEM
+// (make tune in data-analysis/filter-tests sweeps these against flight logs)
+#define SIGMA_GYRO 0.5f
+#define SIGMA_ACCEL 0.5f
+#define SIGMA_BARO 0.5f
+
+// TODO: see if this is still needed
+// #define CA 0.5
+
+// something for complementary filtering for the zero-velocity update feature
+#define ACCEL_THRESHOLD 0.1f
+
+#define MAIN_DEPLOY_ALTITUDE 213.36f // meters, bode set it to 700 feet
+
+// flight event detection, see the transition table in StateDetermination.cpp.
+// each detector needs STATE_DEBOUNCE_SAMPLES samples past its trigger level
+// and only starts counting over once the signal is back past its release level
+#define STATE_DEBOUNCE_SAMPLES 3
+#define LAUNCH_ACCEL 8.f         // m/s^2 upwards, gravity removed
+#define LAUNCH_ACCEL_RELEASE 3.f
+#define BURNOUT_ACCEL 0.f        // net accel turns negative once the motor is out
+#define BURNOUT_ACCEL_RELEASE 5.f
+#define APOGEE_VELOCITY 0.f      // m/s
+#define APOGEE_VELOCITY_RELEASE 2.f
+#define APOGEE_LEAD_TIME 0.2f    // s, predicted time to apogee that arms the apogee detector
+#define APOGEE_LEAD_RELEASE 1.f
+#define APOGEE_ARMED_SAMPLES 1   // velocity samples that fire apogee once armed
+#define MAIN_DEPLOY_RELEASE 10.f // m above MAIN_DEPLOY_ALTITUDE
+#define MAIN_OPEN_VELOCITY -15.f // descent rate under main, m/s
+#define MAIN_OPEN_VELOCITY_RELEASE -20.f
+#define LANDED_ALTITUDE 50.f     // m above the pad, RECOVERY is still under the main
+#define LANDED_ALTITUDE_RELEASE 60.f
+// on the ground for real: | |a| - g | and the vertical speed stay under these
+// for LANDED_WINDOW samples in a row, and that lasts LANDED_HOLD_MS
+#define LANDED_ACCEL 1.f         // m/s^2
+#define LANDED_VELOCITY 1.f      // m/s
+#define LANDED_WINDOW 32         // samples
+#define LANDED_HOLD_MS 2000
+#define STATE_LOG_SIZE 16        // transitions kept, power of two
+
+enum class rocket_state
+{
+    POWER_ON = 0,
+    LAUNCH_READY,
+    POWERED_FLIGHT_PHASE,
+    BURNOUT_PHASE,
+    COAST_PHASE,
+    APOGEE_PHASE,
+    DROGUE_DEPLOYED,
+    MAIN_DEPLOY_ATTEMPT,
+    MAIN_DEPLOYED,
+    RECOVERY,
+    STATE_COUNT
+};
+
+// what a transition rule looks at
+enum class state_signal : uint8_t
+{
+    VERTICAL_ACCEL,    // m/s^2, gravity removed
+    VERTICAL_VELOCITY, // m/s
+    ALTITUDE_AGL,      // m above the pad
+    TIME_IN_STATE,     // s
+};
+
+// one row of the transition table. A sample counts towards the transition
+// once the signal is past trigger (above it when rising, below it if not),
+// the count only goes back to zero when the signal gets back past release,
+// so a noisy signal sitting between the two doesn't restart it. The
+// transition fires on the samples'th counted sample
+struct transition_rule
+{
+    rocket_state from;
+    rocket_state to;
+    state_signal signal;
+    bool rising;
+    float trigger;
+    float release;
+    uint8_t samples;
+};
+
+struct state_transition_event
+{
+    rocket_state from;
+    rocket_state to;
+    uint32_t trigger_ms; // first sample of the run that fired the transition
+    uint32_t detect_ms;  // sample it fired on
+
+    uint32_t latency_ms() const { return detect_ms - trigger_ms; }
+};
+
+// everything needed to pick a flight back up after a reset, see
+// StateDeterminer::restoreCheckpoint. Plain data, meant to be kept in
+// memory that survives the reset (RTC slow memory on the ESP32)
+struct flight_checkpoint
+{
+    estimator_checkpoint estimator;
+    rocket_state state;
+    uint32_t time_in_state_ms;
+    float pad_altitude;     // baro altitude the AGL thresholds are taken from
+    float drag_coefficient; // ApogeePredictor's k, so it doesn't relearn it
+};
+
+class StateDeterminer
+{
+public:
+    StateDeterminer();
+    ~StateDeterminer();
+    filter_estimates determineState(float accel_data[3], float gyro_data[3], float mag_data[3], float altitude, unsigned long curr_time);
+    // void switchGroundState(BBManager &manager, uint64_t packet);
+
+    rocket_state getState() const { return curr_state_; }
+    // body to earth, as of the last step
+    const State &getAttitude() const { return estimator_.getAttitudeFilter().getQuaternion(); }
+    // as of the last step, only meaningful on the way up
+    apogee_prediction getApogeePrediction() const { return apogee_; }
+    // the predictor has seen apogee coming, the velocity test still decides
+    // when it is there, just without the full debounce
+    bool isApogeeArmed() const { return apogee_armed_; }
+    // lying still on the ground after the flight, not just low (RECOVERY).
+    // Only looked for once the drogue is out, stays set
+    bool hasLanded() const { return landed_; }
+    // transitions so far, oldest first, the oldest drop out past STATE_LOG_SIZE
+    const gnc::HistoryRing<state_transition_event, STATE_LOG_SIZE> &getTransitions() const { return transitions_; }
+
+    // snapshot as of curr_time (same clock as determineState)
+    flight_checkpoint getCheckpoint(unsigned long curr_time) const;
+    // carries on from a checkpoint taken gap_s seconds before curr_time,
+    // without going back through the pad states. The debounce counts and the
+    // transition log start empty
+    void restoreCheckpoint(const flight_checkpoint &cp, unsigned long curr_time, float gap_s);
+
+private:
+    Estimator estimator_;
+
+    // used for ensuring the time is properly setup
+    bool first_step_;
+
+    rocket_state curr_state_;
+    uint32_t state_entered_ms_;
+    float pad_altitude_;
+    ApogeePredictor apogee_predictor_;
+    apogee_prediction apogee_;
+    uint8_t apogee_arm_count_;
+    bool apogee_armed_;
+
+    gnc::QuietDetector<LANDED_WINDOW> landed_accel_;
+    gnc::QuietDetector<LANDED_WINDOW> landed_velocity_;
+    uint32_t still_since_ms_;
+    bool still_;
+    bool landed_;
+
+    // debounce state per table row, only the rows for curr_state_ are live
+    static const uint8_t max_rules_ = 16;
+    uint8_t counts_[max_rules_];
+    uint32_t run_start_ms_[max_rules_];
+    // first table row for each state, rows for a state are contiguous
+    uint8_t first_rule_[(int)rocket_state::STATE_COUNT + 1];
+
+    gnc::HistoryRing<state_transition_event, STATE_LOG_SIZE> transitions_;
+
+    void updateState(const filter_estimates &est, uint32_t time_ms);
+    void updateLanded(const float accel[3], const filter_estimates &est, uint32_t time_ms);
+    void resetLanded();
+    void enterState(rocket_state next, uint32_t trigger_ms, uint32_t time_ms);
+};
+
+#endif
\ No newline at end of file
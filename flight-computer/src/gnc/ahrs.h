@@ -0,0 +1,203 @@
+/*
+   ahrs.h: Mahony and Madgwick attitude filters
+
+   Fixed gain alternatives to the Kalman filters in filters.h, with the same
+   interface so either can be the Estimator's attitude policy. No
+   covariance, so a step is a handful of multiply-adds where the 4-state EKF
+   does 4x4 matrix products, at the price of fixed gains that don't know
+   how sure they are.
+
+   Both take the accel and mag updates as a correction that is applied at
+   the next predict, only the latest sample of each counts, so running the
+   accel faster than the predict doesn't turn the gain up. The mag only
+   corrects heading: it is projected onto the horizontal plane of the
+   current estimate, so a disturbed field (motor, pyro currents) can't tilt
+   the attitude.
+
+   Only the |a| ~ g check of AttitudeCore applies to the accel, there is no
+   innovation covariance to gate on, so every other update counts as
+   accepted. Heading-only mag updates are fine without the accel.
+
+   Gains follow from the gyro noise the same way the Kalman filters take
+   it: Madgwick's beta = sqrt(3/4) * gyro error (his paper, eq. 50), and
+   Mahony's Kp = 2 * beta, which gives the two the same crossover.
+
+   Header only, the ground station uses MahonyFilter without the rest of
+   gnc.
+ */
+
+#pragma once
+
+#include "attitude.h"
+
+// sqrt(3/4), gyro error to Madgwick's beta
+#define AHRS_BETA_PER_GYRO_NOISE 0.8660254f
+
+class MahonyFilter : public AttitudeCore
+{
+public:
+	// gyro_noise in rad/s sets Kp, ki is the integral (gyro bias) gain
+	explicit MahonyFilter(float gyro_noise, float ki = 0.f)
+	{
+		setGains(2.f * AHRS_BETA_PER_GYRO_NOISE * gyro_noise, ki);
+		integral_ = gnc::Vector3f::zeros();
+		accel_error_ = mag_error_ = gnc::Vector3f::zeros();
+	}
+
+	void setGains(float kp, float ki)
+	{
+		kp_ = kp;
+		ki_ = ki;
+	}
+
+	void predict(const float gyro[3], float dt)
+	{
+		const float dtheta[3] = {gyro[0] * dt, gyro[1] * dt, gyro[2] * dt};
+		predictDelta(dtheta, dt);
+	}
+
+	void predictDelta(const float dtheta[3], float dt)
+	{
+		gnc::Vector3f e = accel_error_ + mag_error_;
+		accel_error_ = mag_error_ = gnc::Vector3f::zeros();
+		if (ki_ > 0.f)
+			integral_ += e * (ki_ * dt);
+
+		// w = gyro + Kp * e + integral, as a rotation over dt
+		gnc::Vector3f phi = gnc::vec3(dtheta) + (e * kp_ + integral_) * dt;
+		curr_quat_ = curr_quat_ * State::fromRotationVector(phi);
+		gnc::fast_normalize(curr_quat_);
+	}
+
+	// error is measured x estimated, the rotation that takes the estimate
+	// onto the measurement (small angle)
+	void updateAccel(const float accel[3])
+	{
+		gnc::Vector3f a = gnc::vec3(accel);
+		if (!nearGravity(accel) || !gnc::fast_normalize(a))
+			return;
+		passGate(update_stats_.accel, 0.f);
+		accel_error_ = gnc::cross(a, bodyUp());
+	}
+
+	void updateMag(const float mag[3])
+	{
+		// horizontal part of the field, as the direction west of it
+		gnc::Vector3f up = bodyUp();
+		gnc::Vector3f h = gnc::cross(up, gnc::vec3(mag));
+		gnc::Vector3f w = gnc::cross(up, bodyMagReference());
+		if (!gnc::fast_normalize(h) || !gnc::fast_normalize(w))
+			return;
+		passGate(update_stats_.mag, 0.f);
+		mag_error_ = gnc::cross(h, w);
+	}
+
+	const gnc::Vector3f &getGyroBias() const { return integral_; }
+
+	struct checkpoint
+	{
+		State quat;
+		gnc::Vector3f integral;
+	};
+	checkpoint getCheckpoint() const { return checkpoint{curr_quat_, integral_}; }
+	void restoreCheckpoint(const checkpoint &cp)
+	{
+		curr_quat_ = cp.quat;
+		integral_ = cp.integral;
+		accel_error_ = mag_error_ = gnc::Vector3f::zeros();
+		gravity_run_ = 0;
+	}
+
+private:
+	float kp_;
+	float ki_;
+	gnc::Vector3f integral_; // -gyro bias when ki > 0
+	gnc::Vector3f accel_error_;
+	gnc::Vector3f mag_error_;
+};
+
+class MadgwickFilter : public AttitudeCore
+{
+public:
+	// gyro_noise in rad/s sets beta
+	explicit MadgwickFilter(float gyro_noise)
+	{
+		beta_ = AHRS_BETA_PER_GYRO_NOISE * gyro_noise;
+		accel_grad_ = mag_grad_ = gnc::Vector<4>::zeros();
+	}
+
+	void setBeta(float beta) { beta_ = beta; }
+
+	void predict(const float gyro[3], float dt)
+	{
+		const float dtheta[3] = {gyro[0] * dt, gyro[1] * dt, gyro[2] * dt};
+		predictDelta(dtheta, dt);
+	}
+
+	// q = q * exp(dtheta / 2) - beta * dt * grad / |grad|
+	void predictDelta(const float dtheta[3], float dt)
+	{
+		gnc::Vector<4> grad = accel_grad_ + mag_grad_;
+		accel_grad_ = mag_grad_ = gnc::Vector<4>::zeros();
+
+		curr_quat_ = curr_quat_ * State::fromRotationVector(gnc::vec3(dtheta));
+		float n2 = gnc::dot(grad, grad);
+		if (n2 > 0.f)
+		{
+			float step = beta_ * dt * gnc::fast_inv_sqrtf(n2);
+			curr_quat_.w -= step * grad(0);
+			curr_quat_.x -= step * grad(1);
+			curr_quat_.y -= step * grad(2);
+			curr_quat_.z -= step * grad(3);
+		}
+		gnc::fast_normalize(curr_quat_);
+	}
+
+	// gradient of |R^T ref - z|^2 / 2 over q, J^T (R^T ref - z)
+	void updateAccel(const float accel[3])
+	{
+		gnc::Vector3f a = gnc::vec3(accel);
+		if (!nearGravity(accel) || !gnc::fast_normalize(a))
+			return;
+		passGate(update_stats_.accel, 0.f);
+		accel_grad_ = gradient(gnc::vec3(0.f, 0.f, 1.f), a);
+	}
+
+	void updateMag(const float mag[3])
+	{
+		// same horizontal projection as MahonyFilter, compared as the
+		// direction west of the field so only heading is corrected
+		gnc::Vector3f up = bodyUp();
+		gnc::Vector3f h = gnc::cross(up, gnc::vec3(mag));
+		if (!gnc::fast_normalize(h))
+			return;
+		gnc::Vector3f west = gnc::cross(gnc::vec3(0.f, 0.f, 1.f), B_E);
+		if (!gnc::fast_normalize(west))
+			return;
+		passGate(update_stats_.mag, 0.f);
+		mag_grad_ = gradient(west, h);
+	}
+
+	struct checkpoint
+	{
+		State quat;
+	};
+	checkpoint getCheckpoint() const { return checkpoint{curr_quat_}; }
+	void restoreCheckpoint(const checkpoint &cp)
+	{
+		curr_quat_ = cp.quat;
+		accel_grad_ = mag_grad_ = gnc::Vector<4>::zeros();
+		gravity_run_ = 0;
+	}
+
+private:
+	float beta_;
+	gnc::Vector<4> accel_grad_;
+	gnc::Vector<4> mag_grad_;
+
+	gnc::Vector<4> gradient(const gnc::Vector3f &ref, const gnc::Vector3f &z) const
+	{
+		gnc::Vector3f f = curr_quat_.rotateInverse(ref) - z;
+		return gnc::multAtB(body_vector_jacobian(curr_quat_, ref), f);
+	}
+};
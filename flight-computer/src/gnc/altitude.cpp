@@ -0,0 +1,315 @@
+/*
+    altitude.cpp: Altitude estimation via barometer/accelerometer fusion
+*/
+
+#include "filters.h"
+#include "altitude.h"
+
+template <class AttitudePolicy>
+BasicEstimator<AttitudePolicy>::BasicEstimator(float sigma_accel, float sigma_gyro, float sigma_baro,
+                                               float accel_threshold)
+    : attitude_(sigma_gyro), complementary_(sigma_accel, sigma_baro, accel_threshold)
+{
+        gyro_.primed = accel_.primed = mag_.primed = baro_.primed = false;
+        gyro_.last_us = accel_.last_us = mag_.last_us = baro_.last_us = 0;
+        resetCpuStats();
+        estimates_ = filter_estimates{};
+        current_ = comp_filter_results{};
+        current_us_ = 0;
+        delay_stats_ = delayed_fusion_stats{};
+}
+
+template <class AttitudePolicy>
+bool BasicEstimator<AttitudePolicy>::freshSample(sensor_channel &ch, uint32_t timestamp_us)
+{
+        if (ch.primed && timestamp_us == ch.last_us)
+                return false; // nothing new from this sensor
+
+        ch.primed = true;
+        ch.last_us = timestamp_us;
+        return true;
+}
+
+template <class AttitudePolicy>
+float BasicEstimator<AttitudePolicy>::channelStep(sensor_channel &ch, uint32_t timestamp_us)
+{
+        bool primed = ch.primed;
+        uint32_t last_us = ch.last_us;
+        if (!freshSample(ch, timestamp_us) || !primed)
+                return -1.0f;
+
+        uint32_t elapsed = timestamp_us - last_us;
+        if (elapsed > GNC_MAX_SAMPLE_GAP_US)
+                return -1.0f;
+        return (float)elapsed * 1e-6f;
+}
+
+template <class AttitudePolicy>
+bool BasicEstimator<AttitudePolicy>::addGyro(const float gyro[3], uint32_t timestamp_us)
+{
+        uint32_t start = gnc::cycle_count();
+        bool repeat = gyro_.primed && timestamp_us == gyro_.last_us;
+        float dt = channelStep(gyro_, timestamp_us);
+        if (dt < 0.0f)
+        {
+#if GNC_PREDICT_PERIOD_US > 0
+                // first sample or one after a gap, the one before it isn't
+                // its neighbour for the coning term
+                if (!repeat)
+                        preint_.restart();
+#endif
+                return false;
+        }
+
+#if GNC_PREDICT_PERIOD_US > 0
+        preint_.addSample(gyro, nullptr, dt);
+        if (preint_.elapsed() >= GNC_PREDICT_PERIOD_US * 1e-6f - 1e-6f)
+        {
+                imu_delta delta = preint_.take();
+                float dtheta[3];
+                delta.dtheta.copyTo(dtheta);
+                GNC_PROFILE_SCOPE(PREDICT);
+                attitude_.predictDelta(dtheta, delta.dt);
+        }
+#else
+        {
+                GNC_PROFILE_SCOPE(PREDICT);
+                attitude_.predict(gyro, dt);
+        }
+#endif
+
+        gyro_.cpu.add(gnc::cycle_count() - start);
+        return true;
+}
+
+template <class AttitudePolicy>
+bool BasicEstimator<AttitudePolicy>::addAccel(const float accel[3], uint32_t timestamp_us)
+{
+        uint32_t start = gnc::cycle_count();
+        if (!freshSample(accel_, timestamp_us))
+                return false;
+
+        {
+                GNC_PROFILE_SCOPE(UPDATE_ACCEL);
+                attitude_.updateAccel(accel);
+        }
+
+        float vertical_accel;
+        {
+                GNC_PROFILE_SCOPE(VERTICAL_ACCEL);
+                vertical_accel = attitude_.calcVerticalAccel(accel);
+        }
+        history_.push(vertical_sample{timestamp_us, vertical_accel});
+        estimates_.vertical_accel = vertical_accel;
+
+        // keep the altitude output moving at accel rate between baro samples
+        if (baro_.primed)
+        {
+                uint32_t elapsed = timestamp_us - current_us_;
+                if (elapsed <= GNC_MAX_SAMPLE_GAP_US)
+                {
+                        current_ = complementary_.propagate(current_, vertical_accel, (float)elapsed * 1e-6f);
+                        estimates_.cf_results = current_;
+                }
+                current_us_ = timestamp_us;
+        }
+
+        accel_.cpu.add(gnc::cycle_count() - start);
+        return true;
+}
+
+template <class AttitudePolicy>
+bool BasicEstimator<AttitudePolicy>::addMag(const float mag[3], uint32_t timestamp_us)
+{
+        uint32_t start = gnc::cycle_count();
+        if (!freshSample(mag_, timestamp_us))
+                return false;
+
+        {
+                GNC_PROFILE_SCOPE(UPDATE_MAG);
+                attitude_.updateMag(mag);
+        }
+
+        mag_.cpu.add(gnc::cycle_count() - start);
+        return true;
+}
+
+template <class AttitudePolicy>
+bool BasicEstimator<AttitudePolicy>::addBaro(float baro_alt, uint32_t timestamp_us)
+{
+        uint32_t start = gnc::cycle_count();
+        uint32_t anchor_us = baro_.last_us;
+        if (baro_.primed && timestamp_us == anchor_us)
+                return false; // nothing new
+
+        float dt = channelStep(baro_, timestamp_us);
+        if (dt < 0.0f)
+        {
+                // first sample or after a gap, restart the output from here
+                current_us_ = timestamp_us;
+                return false;
+        }
+        uint32_t interval = timestamp_us - anchor_us;
+
+        // timed from before the history walk, which grows with how late the
+        // sample is just like the replay does
+        uint32_t replay_start = gnc::cycle_count();
+
+        // mean vertical accel over the baro interval (anchor, t], or the latest
+        // one if the accel hasn't produced anything in it. Walked back from
+        // the newest sample, so it only looks at the interval and whatever
+        // came after it, not the whole ring
+        float accel_sum = 0.0f;
+        int accel_count = 0;
+        int first_after = history_.size();
+        for (int i = history_.size() - 1; i >= 0; i--)
+        {
+                int32_t since_anchor = (int32_t)(history_[i].t_us - anchor_us);
+                if (since_anchor <= 0)
+                        break; // the ring is in time order, the rest is older still
+                if ((uint32_t)since_anchor <= interval)
+                {
+                        accel_sum += history_[i].accel;
+                        accel_count++;
+                }
+                else
+                {
+                        first_after = i; // newer than t, to be replayed
+                }
+        }
+        float vertical_accel = accel_count > 0 ? accel_sum / (float)accel_count : estimates_.vertical_accel;
+
+        // the oldest sample held is already inside the interval, so some of it is gone
+        if (history_.full() && history_[0].t_us - anchor_us - 1 < interval)
+                delay_stats_.overruns++;
+
+        comp_filter_results cfr;
+        {
+                GNC_PROFILE_SCOPE(VERTICAL_FILTER);
+                cfr = complementary_.estimate(baro_alt, prev_altitude_, prev_vertical_velocity_, vertical_accel, dt);
+        }
+        prev_altitude_ = cfr.altitude;
+        prev_vertical_velocity_ = cfr.vertical_velocity;
+
+        // carry the corrected state forward over the accel samples that
+        // arrived after the baro sample was taken
+        current_ = cfr;
+        current_us_ = timestamp_us;
+        int replayed = 0;
+        for (int i = first_after; i < history_.size(); i++)
+        {
+                const vertical_sample &sample = history_[i];
+                current_ = complementary_.propagate(current_, sample.accel,
+                                                    (float)(sample.t_us - current_us_) * 1e-6f);
+                current_us_ = sample.t_us;
+                replayed++;
+        }
+        estimates_.cf_results = current_;
+
+        if (replayed > 0)
+        {
+                delay_stats_.late++;
+                if ((uint32_t)replayed > delay_stats_.max_replayed)
+                        delay_stats_.max_replayed = replayed;
+                delay_stats_.catch_up.add(gnc::cycle_count() - replay_start);
+        }
+
+        baro_.cpu.add(gnc::cycle_count() - start);
+        return true;
+}
+
+template <class AttitudePolicy>
+void BasicEstimator<AttitudePolicy>::estimate(float accel[3], float gyro[3], float mag[3], float baro_alt, uint32_t timestamp)
+{
+        uint32_t timestamp_us = timestamp * 1000;
+
+        addGyro(gyro, timestamp_us);
+        addAccel(accel, timestamp_us);
+        addMag(mag, timestamp_us);
+        addBaro(baro_alt, timestamp_us);
+}
+
+template <class AttitudePolicy>
+filter_estimates BasicEstimator<AttitudePolicy>::getEstimates()
+{
+        // euler angles are only needed for output, so they are worked out here
+        // rather than on every gyro sample
+        GNC_PROFILE_SCOPE(ATTITUDE);
+        estimates_.angles = attitude_.calcAttitude();
+        return estimates_;
+}
+
+template <class AttitudePolicy>
+void BasicEstimator<AttitudePolicy>::setInitTime(uint32_t time)
+{
+        uint32_t time_us = time * 1000;
+        gyro_.last_us = accel_.last_us = mag_.last_us = baro_.last_us = time_us;
+        gyro_.primed = accel_.primed = mag_.primed = baro_.primed = true;
+}
+
+template <class AttitudePolicy>
+typename BasicEstimator<AttitudePolicy>::checkpoint BasicEstimator<AttitudePolicy>::getCheckpoint() const
+{
+        checkpoint cp;
+        cp.attitude = attitude_.getCheckpoint();
+        cp.vertical = complementary_.getCheckpoint();
+        cp.anchor = comp_filter_results{prev_vertical_velocity_, prev_altitude_};
+        cp.current = current_;
+        // one accel sample is too noisy to coast on for the length of a
+        // reboot, take the mean of the last few
+        cp.vertical_accel = estimates_.vertical_accel;
+        int n = history_.size() < 8 ? history_.size() : 8;
+        if (n > 0)
+        {
+                float sum = 0.0f;
+                for (int i = history_.size() - n; i < history_.size(); i++)
+                        sum += history_[i].accel;
+                cp.vertical_accel = sum / (float)n;
+        }
+        return cp;
+}
+
+template <class AttitudePolicy>
+void BasicEstimator<AttitudePolicy>::restoreCheckpoint(const checkpoint &cp, float gap_s)
+{
+        attitude_.restoreCheckpoint(cp.attitude);
+        complementary_.restoreCheckpoint(cp.vertical);
+        preint_ = ImuPreintegrator();
+        history_.clear();
+
+        // the next baro step starts from the anchor with dt measured from the
+        // first baro sample after the restart, so both have to be at "now"
+        current_ = complementary_.propagate(cp.current, cp.vertical_accel, gap_s);
+        prev_altitude_ = current_.altitude;
+        prev_vertical_velocity_ = current_.vertical_velocity;
+        estimates_.cf_results = current_;
+        estimates_.vertical_accel = cp.vertical_accel;
+
+        gyro_.primed = accel_.primed = mag_.primed = baro_.primed = false;
+}
+
+template <class AttitudePolicy>
+estimator_cpu_stats BasicEstimator<AttitudePolicy>::getCpuStats()
+{
+        return estimator_cpu_stats{gyro_.cpu, accel_.cpu, mag_.cpu, baro_.cpu};
+}
+
+template <class AttitudePolicy>
+void BasicEstimator<AttitudePolicy>::resetCpuStats()
+{
+        gyro_.cpu = accel_.cpu = mag_.cpu = baro_.cpu = gnc::cpu_stats{};
+        delay_stats_.catch_up = gnc::cpu_stats{};
+}
+
+template <class AttitudePolicy>
+delayed_fusion_stats BasicEstimator<AttitudePolicy>::getDelayStats()
+{
+        return delay_stats_;
+}
+
+// every policy altitude.h can pick, so switching one is only a define
+template class BasicEstimator<ExtendedKalmanFilter>;
+template class BasicEstimator<UDExtendedKalmanFilter>;
+template class BasicEstimator<AttitudeBiasMEKF>;
+template class BasicEstimator<MahonyFilter>;
+template class BasicEstimator<MadgwickFilter>;
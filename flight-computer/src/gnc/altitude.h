@@ -0,0 +1,206 @@
+/*
+    altitude.h: Altitude estimation via barometer/accelerometer fusion
+*/
+
+#pragma once
+
+#include "filters.h"
+#include "ahrs.h"
+#include "cycles.h"
+#include "history.h"
+#include "preintegration.h"
+#include "profile.h"
+
+// attitude filter run by the Estimator, the 4-state quaternion EKF unless
+// one of these is defined:
+//   GNC_ATTITUDE_EKF_UD    the same EKF with its covariance UD factored
+//   GNC_ATTITUDE_MEKF      error-state filter with gyro bias
+//   GNC_ATTITUDE_MAHONY    fixed gain complementary filter (ahrs.h)
+//   GNC_ATTITUDE_MADGWICK  gradient descent filter (ahrs.h)
+#if defined(GNC_ATTITUDE_EKF_UD)
+typedef UDExtendedKalmanFilter AttitudeFilter;
+#elif defined(GNC_ATTITUDE_MEKF)
+typedef AttitudeBiasMEKF AttitudeFilter;
+#elif defined(GNC_ATTITUDE_MAHONY)
+typedef MahonyFilter AttitudeFilter;
+#elif defined(GNC_ATTITUDE_MADGWICK)
+typedef MadgwickFilter AttitudeFilter;
+#else
+typedef ExtendedKalmanFilter AttitudeFilter;
+#endif
+
+// vertical channel filter, define GNC_VERTICAL_KF to use the 3-state
+// Kalman filter (with accel bias) instead of the complementary filter
+#ifdef GNC_VERTICAL_KF
+typedef VerticalKalmanFilter VerticalFilter;
+#else
+typedef ComplementaryFilter VerticalFilter;
+#endif
+
+// sample gaps longer than this (us) restart a sensor channel instead of
+// being integrated as one giant step, e.g. the first sample or a bus dropout
+#ifndef GNC_MAX_SAMPLE_GAP_US
+#define GNC_MAX_SAMPLE_GAP_US 500000
+#endif
+
+// attitude predict period (us). Gyro samples in between are pre-integrated
+// with coning correction, so the filter runs at this rate without losing
+// accuracy. 0 predicts on every gyro sample instead
+#ifndef GNC_PREDICT_PERIOD_US
+#define GNC_PREDICT_PERIOD_US 10000
+#endif
+
+// vertical accel samples kept for replaying late baro (or GPS altitude)
+// samples, power of two, 8 bytes each. It has to reach back over the delay
+// plus one sample interval, 512 is 512 ms at 1 kHz accel or 5 s at 100 Hz
+#ifndef GNC_HISTORY_SIZE
+#define GNC_HISTORY_SIZE 512
+#endif
+
+struct filter_estimates
+{
+  euler_angles angles;
+  comp_filter_results cf_results;
+  float vertical_accel;
+};
+
+// bookkeeping for one sensor feeding the estimator
+struct sensor_channel
+{
+  uint32_t last_us; // timestamp of the last sample that was used
+  bool primed;      // false until a first sample has been seen
+  gnc::cpu_stats cpu;
+};
+
+// one vertical accel sample in the history ring
+struct vertical_sample
+{
+  uint32_t t_us;
+  float accel;
+};
+
+// how much work late altitude samples are causing
+struct delayed_fusion_stats
+{
+  uint32_t late;         // samples that were older than the newest accel sample
+  uint32_t max_replayed; // most accel samples replayed after one late sample
+  uint32_t overruns;     // samples whose interval had already left the ring
+  gnc::cpu_stats catch_up; // cost of the history walk and replay, per late sample
+};
+
+struct estimator_cpu_stats
+{
+  gnc::cpu_stats gyro;  // attitude predict
+  gnc::cpu_stats accel; // attitude accel update + vertical accel
+  gnc::cpu_stats mag;   // attitude mag update
+  gnc::cpu_stats baro;  // vertical channel filter
+};
+
+// The attitude filter is a policy, anything with the interface of
+// ExtendedKalmanFilter will do:
+//   AttitudePolicy(float gyro_noise)
+//   predict(gyro, dt), predictDelta(dtheta, dt)
+//   updateAccel(accel), updateMag(mag)
+//   calcVerticalAccel(accel), calcAttitude(), getQuaternion()
+//   checkpoint, getCheckpoint(), restoreCheckpoint(cp)
+// Instantiated in altitude.cpp for the four filters above, Estimator is
+// the one picked by the GNC_ATTITUDE_* defines
+template <class AttitudePolicy>
+class BasicEstimator
+{
+public:
+  typedef AttitudePolicy attitude_filter;
+
+  // what a warm restart needs to carry on where the estimator was, see
+  // restoreCheckpoint. Plain data, so it can be copied as bytes
+  struct checkpoint
+  {
+    typename AttitudePolicy::checkpoint attitude;
+    VerticalFilter::checkpoint vertical;
+    comp_filter_results anchor;  // vertical state as of the last baro sample
+    comp_filter_results current; // and carried forward to the last accel sample
+    float vertical_accel;
+  };
+
+  BasicEstimator(float sigma_accel, float sigma_gyro, float sigma_baro,
+                 float accel_threshold);
+
+  // Multi-rate interface, hand each sensor over whenever it has a sample, with
+  // the time (us) the sample was taken. The attitude is propagated every
+  // GNC_PREDICT_PERIOD_US from the accumulated gyro samples, the accel/mag
+  // updates see the attitude as of the last predict. Each update only runs on
+  // fresh data, so a sample with the same timestamp as the last one from that
+  // sensor is dropped and false is returned. Timestamps are free running and
+  // may wrap.
+  bool addGyro(const float gyro[3], uint32_t timestamp_us);
+  bool addAccel(const float accel[3], uint32_t timestamp_us);
+  bool addMag(const float mag[3], uint32_t timestamp_us);
+  // timestamp_us is when the altitude was measured, not when it showed up,
+  // so subtract conversion time / filter delay (or GPS latency) first. The
+  // vertical filter is corrected at that time from the accel history and
+  // carried forward to the newest accel sample
+  bool addBaro(float baro_alt, uint32_t timestamp_us);
+
+  // Lockstep version of the above, every sensor at one rate (timestamp in ms)
+  void estimate(float accel[3], float gyro[3], float mag[3], float baro_alt, uint32_t timestamp);
+
+  filter_estimates getEstimates();
+
+  void setInitTime(uint32_t time);
+
+  checkpoint getCheckpoint() const;
+  // picks up from a checkpoint taken gap_s seconds ago. The vertical state is
+  // carried over the gap on the last vertical accel, every sensor channel
+  // starts over as if on its first sample, the accel history is dropped
+  void restoreCheckpoint(const checkpoint &cp, float gap_s);
+
+  // the attitude filter itself, for its gates and update counts
+  AttitudePolicy &getAttitudeFilter() { return attitude_; }
+  const AttitudePolicy &getAttitudeFilter() const { return attitude_; }
+
+  // time spent per sensor channel in gnc::cycle_count() units
+  estimator_cpu_stats getCpuStats();
+  void resetCpuStats();
+  delayed_fusion_stats getDelayStats();
+
+private:
+  sensor_channel gyro_;
+  sensor_channel accel_;
+  sensor_channel mag_;
+  sensor_channel baro_;
+  // required filters for altitude and vertical velocity estimation
+  AttitudePolicy attitude_;
+  ImuPreintegrator preint_;
+  VerticalFilter complementary_;
+  filter_estimates estimates_;
+  // required parameters for the filters used for the estimations
+  // sensor's standard deviations
+  // float sigma_accel_;
+  // float sigma_gyro_;
+  // float sigma_baro_;
+  // Acceleration markov chain model state transition constant
+  // float ca_;
+  // Zero-velocity update acceleration threshold
+  // float cf_accel_threshold_;
+  // gravity
+  // float g = 9.81;
+  // vertical accel since (at least) the last baro sample. The vertical filter
+  // steps at baro rate with the mean accel over the baro interval, that
+  // state at the baro timestamp is kept as the anchor and current_ is the
+  // anchor carried forward through the newer accel samples
+  gnc::HistoryRing<vertical_sample, GNC_HISTORY_SIZE> history_;
+  float prev_vertical_velocity_ = 0;
+  float prev_altitude_ = 0;
+  comp_filter_results current_;
+  uint32_t current_us_;
+  delayed_fusion_stats delay_stats_;
+
+  // false if the sample is one we've already seen, otherwise marks it seen
+  static bool freshSample(sensor_channel &ch, uint32_t timestamp_us);
+  // seconds since the channel's last sample, < 0 if the sample should not
+  // be integrated (stale, first one, or after a long gap)
+  static float channelStep(sensor_channel &ch, uint32_t timestamp_us);
+}; // class AltitudeEstimator
+
+typedef BasicEstimator<AttitudeFilter> Estimator;
+typedef Estimator::checkpoint estimator_checkpoint;
@@ -0,0 +1,62 @@
+/*
+   apogee.cpp: Closed form time-to-apogee and apogee altitude during coast
+ */
+
+#include "apogee.h"
+
+// below this k v^2 / g the drag terms are swamped by rounding, use the
+// ballistic forms instead
+#define APOGEE_MIN_DRAG_RATIO 1e-4f
+
+ApogeePredictor::ApogeePredictor(float drag_gain, float min_speed)
+{
+	drag_gain_ = drag_gain;
+	min_speed_ = min_speed;
+	reset();
+}
+
+void ApogeePredictor::reset()
+{
+	k_ = 0.f;
+	k_seen_ = false;
+}
+
+void ApogeePredictor::setDragCoefficient(float k)
+{
+	k_ = k > 0.f ? k : 0.f;
+	k_seen_ = k_ > 0.f;
+}
+
+apogee_prediction ApogeePredictor::update(float altitude, float velocity, float accel, bool coasting)
+{
+	if (coasting && velocity > min_speed_)
+	{
+		float k = -(accel + GRAVITY) / (velocity * velocity);
+		if (k < 0.f)
+			k = 0.f;
+		// first sample seeds the filter rather than dragging it up from zero
+		k_ = k_seen_ ? k_ + drag_gain_ * (k - k_) : k;
+		k_seen_ = true;
+	}
+
+	apogee_prediction out;
+	if (velocity <= 0.f)
+	{
+		out.time_to_apogee = 0.f;
+		out.altitude = altitude;
+		return out;
+	}
+
+	float ratio = k_ * velocity * velocity / GRAVITY;
+	if (ratio < APOGEE_MIN_DRAG_RATIO)
+	{
+		out.time_to_apogee = velocity / GRAVITY;
+		out.altitude = altitude + 0.5f * velocity * velocity / GRAVITY;
+		return out;
+	}
+
+	float root_gk = gnc::fast_sqrtf(GRAVITY * k_);
+	out.time_to_apogee = gnc::fast_atan2f(velocity * root_gk, GRAVITY) / root_gk;
+	out.altitude = altitude + logf(1.f + ratio) / (2.f * k_);
+	return out;
+}
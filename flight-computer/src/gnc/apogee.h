@@ -0,0 +1,49 @@
+/*
+   apogee.h: Closed form time-to-apogee and apogee altitude during coast
+
+   Coasting up, the vertical channel is dv/dt = -g - k v^2 with k the drag
+   per unit mass over v^2 (1/m). That integrates without iterating:
+
+	 time to apogee   t_a = atan(v sqrt(k / g)) / sqrt(g k)
+	 height to go     dh  = ln(1 + k v^2 / g) / (2 k)
+
+   which fall back to v / g and v^2 / 2g as k goes to zero. k is learned
+   from the estimator's vertical accel while coasting, k = -(a + g) / v^2,
+   low-pass filtered, and only at speeds where the drag is big enough to
+   see. It is held at zero if the accel says otherwise, so a biased accel
+   can only make the prediction late (plain ballistic), never early.
+ */
+
+#pragma once
+
+#include "filters.h"
+
+struct apogee_prediction
+{
+	float time_to_apogee; // s, 0 once the vertical velocity is <= 0
+	float altitude;		  // m, same reference as the altitude passed in
+};
+
+class ApogeePredictor
+{
+public:
+	// drag_gain is the low-pass gain per sample for k, min_speed (m/s) the
+	// speed below which k is no longer updated
+	ApogeePredictor(float drag_gain = 0.05f, float min_speed = 30.f);
+
+	// one estimator step, accel is the vertical accel with gravity removed
+	// (+up). Set coasting while the motor is out and nothing is deployed,
+	// only then is the drag learned
+	apogee_prediction update(float altitude, float velocity, float accel, bool coasting);
+
+	float getDragCoefficient() const { return k_; }
+	// e.g. after a warm restart, 0 leaves k to be learned from scratch
+	void setDragCoefficient(float k);
+	void reset();
+
+private:
+	float drag_gain_;
+	float min_speed_;
+	float k_;
+	bool k_seen_;
+};
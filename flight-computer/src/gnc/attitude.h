@@ -0,0 +1,230 @@
+/*
+   attitude.h: Quaternion and calibration core shared by the attitude filters
+
+   Every attitude filter (ExtendedKalmanFilter, ErrorStateKalmanFilter,
+   MahonyFilter, MadgwickFilter) keeps a body to earth quaternion and
+   answers the same questions from it, so that part lives here once:
+   vertical accel for the altitude channel, euler angles for output, and
+   what gravity / the mag field should read in the body frame. Earth frame
+   is z up with x along the mag reference B_E.
+
+   The measurement gates live here too, so every filter rejects the same
+   samples and counts them the same way. An accel sample is only used when
+   |a| has been within GNC_GRAVITY_GATE of g for GNC_GRAVITY_SETTLE samples
+   in a row; under thrust, drag or in free fall it isn't measuring gravity,
+   and the update would pull the attitude towards the thrust axis (the run
+   is so a sample passing through g at burnout doesn't get in). The Kalman
+   filters compare the whole mag vector against B_E, which without the dip
+   modelled only works with the accel holding the tilt, so they drop mag
+   updates too while the accel is out. They also gate on the innovation,
+   y^T S^-1 y against GNC_CHI2_GATE, before any gain or covariance work.
+   A filter that has drifted off would gate everything after it, so after
+   GNC_GATE_MAX_REJECTS innovation rejections in a row one is let through.
+
+   imu_calibration is the raw sensor to calibrated transform from the
+   startup_vals in NVS, for boards that read raw sensors and calibrate
+   themselves (the antenna tracker) rather than in the driver.
+
+   Header only, so the ground station can use it without building the rest
+   of gnc.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "fastmath.h"
+#include "matrix.h"
+
+// find this empirically, might need to be updated onsite
+// face comp towards true north/known orientation
+// TODO: add function that calculates NED coords based on curr
+//		location's declination, inclination, and magneteic field
+#define Bx 1
+#define By 0
+#define Bz 0
+
+// standard gravity, accelerometer reads +g on earth z when at rest
+#define GRAVITY 9.80665f
+
+// largest | |a| / g - 1 | an accel sample is used at, 0 turns the check off
+#ifndef GNC_GRAVITY_GATE
+#define GNC_GRAVITY_GATE 0.1f
+#endif
+// samples in a row within it before the accel is used again
+#ifndef GNC_GRAVITY_SETTLE
+#define GNC_GRAVITY_SETTLE 10
+#endif
+// largest y^T S^-1 y an update is used at, the 99.9% point of chi-square
+// with 3 dof. 0 turns the gate off
+#ifndef GNC_CHI2_GATE
+#define GNC_CHI2_GATE 16.27f
+#endif
+// innovation rejections in a row before one is let through regardless
+#ifndef GNC_GATE_MAX_REJECTS
+#define GNC_GATE_MAX_REJECTS 50
+#endif
+
+// simple 4D quaternion state
+// maybe in the future do a 7D matrix
+typedef gnc::Quatf State;
+
+struct euler_angles
+{
+	float yaw;
+	float pitch;
+	float roll;
+}; // these are actually Tait-Bryant angles :p
+
+// d(R(q)^T * b)/dq for the body frame reading of an earth frame vector b
+inline gnc::Matrix<3, 4> body_vector_jacobian(const State &q, const gnc::Vector3f &b)
+{
+	float bx = b(0), by = b(1), bz = b(2);
+
+	gnc::Matrix<3, 4> H{{{q.w * bx + q.z * by - q.y * bz, q.x * bx + q.y * by + q.z * bz,
+						  -q.y * bx + q.x * by - q.w * bz, -q.z * bx + q.w * by + q.x * bz},
+						 {-q.z * bx + q.w * by + q.x * bz, q.y * bx - q.x * by + q.w * bz,
+						  q.x * bx + q.y * by + q.z * bz, -q.w * bx - q.z * by + q.y * bz},
+						 {q.y * bx - q.x * by + q.w * bz, q.z * bx - q.w * by - q.x * bz,
+						  q.w * bx + q.z * by - q.y * bz, q.x * bx + q.y * by + q.z * bz}}};
+	return H * 2.f;
+}
+
+// what happened to the updates from one sensor
+struct update_counts
+{
+	uint32_t accepted;
+	uint32_t off_gravity; // |a| too far from g (or, for the mag, no gravity reference)
+	uint32_t gated;       // innovation over the chi-square gate
+	uint32_t forced;      // let through after GNC_GATE_MAX_REJECTS, also in accepted
+	uint32_t run;         // innovation rejections in a row right now
+};
+
+struct attitude_update_stats
+{
+	update_counts accel;
+	update_counts mag;
+};
+
+class AttitudeCore
+{
+public:
+	const State &getQuaternion() const { return curr_quat_; }
+
+	// 0 turns either off
+	void setGates(float gravity_tolerance, float chi2)
+	{
+		gravity_gate_ = gravity_tolerance;
+		chi2_gate_ = chi2;
+	}
+	const attitude_update_stats &getUpdateStats() const { return update_stats_; }
+	void resetUpdateStats() { update_stats_ = attitude_update_stats{}; }
+
+	// earth frame vertical accel with gravity taken out, accel in m/s^2
+	float calcVerticalAccel(const float accel[3]) const
+	{
+		gnc::Vector3f up = bodyUp();
+		return up(0) * accel[0] + up(1) * accel[1] + up(2) * accel[2] - GRAVITY;
+	}
+
+	euler_angles calcAttitude() const
+	{
+		euler_angles angles;
+		gnc::fast_euler(curr_quat_, angles.roll, angles.pitch, angles.yaw);
+		return angles;
+	}
+
+protected:
+	AttitudeCore()
+		: curr_quat_(State::identity()), gravity_gate_(GNC_GRAVITY_GATE), chi2_gate_(GNC_CHI2_GATE),
+		  gravity_run_(0), update_stats_{}
+	{
+	}
+
+	State curr_quat_;
+	const gnc::Vector3f B_E = gnc::vec3<float>(Bx, By, Bz);
+	float gravity_gate_;
+	float chi2_gate_;
+	uint32_t gravity_run_; // accel samples in a row near g
+	attitude_update_stats update_stats_;
+
+	// false (and counted) if the accel isn't reading gravity, call before
+	// doing anything else with the sample
+	bool nearGravity(const float accel[3])
+	{
+		if (gravity_gate_ <= 0.f)
+			return true;
+		float n2 = accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2];
+		float lo = GRAVITY * (1.f - gravity_gate_), hi = GRAVITY * (1.f + gravity_gate_);
+		if (n2 >= lo * lo && n2 <= hi * hi)
+		{
+			if (++gravity_run_ >= GNC_GRAVITY_SETTLE)
+				return true;
+		}
+		else
+			gravity_run_ = 0;
+		update_stats_.accel.off_gravity++;
+		return false;
+	}
+
+	// whether the accel is currently holding the tilt, false (and counted)
+	// for a mag update that would have to go without
+	bool magHasReference()
+	{
+		if (gravity_gate_ <= 0.f || gravity_run_ >= GNC_GRAVITY_SETTLE)
+			return true;
+		update_stats_.mag.off_gravity++;
+		return false;
+	}
+
+	// whether an update with squared Mahalanobis distance d2 goes ahead,
+	// counted either way. Filters without an innovation covariance pass 0
+	bool passGate(update_counts &counts, float d2)
+	{
+		if (chi2_gate_ > 0.f && d2 > chi2_gate_)
+		{
+			if (++counts.run <= GNC_GATE_MAX_REJECTS)
+			{
+				counts.gated++;
+				return false;
+			}
+			counts.forced++;
+		}
+		counts.run = 0;
+		counts.accepted++;
+		return true;
+	}
+
+	// earth z as seen from the body, the bottom row of R(q). All that
+	// vertical accel needs, so the full rotation matrix is never built
+	gnc::Vector3f bodyUp() const
+	{
+		const State &q = curr_quat_;
+		return gnc::vec3(2.f * (q.x * q.z - q.w * q.y), 2.f * (q.y * q.z + q.w * q.x),
+						 1.f - 2.f * (q.x * q.x + q.y * q.y));
+	}
+	gnc::Vector3f bodyMagReference() const { return curr_quat_.rotateInverse(B_E); }
+};
+
+// corrected = A_inv * (raw - B) for accel and mag, gyro = g_scale * (raw - offset),
+// same as the flight computer's startup_vals
+struct imu_calibration
+{
+	float g_scale;
+	gnc::Vector3f G_offset;
+	gnc::Vector3f A_B;
+	gnc::Matrix3f A_Ainv;
+	gnc::Vector3f M_B;
+	gnc::Matrix3f M_Ainv;
+
+	static imu_calibration from(float g_scale, const float G_offset[3], const float A_B[3],
+								const float A_Ainv[3][3], const float M_B[3], const float M_Ainv[3][3])
+	{
+		return imu_calibration{g_scale, gnc::vec3(G_offset), gnc::vec3(A_B), gnc::Matrix3f::from(&A_Ainv[0][0]),
+							   gnc::vec3(M_B), gnc::Matrix3f::from(&M_Ainv[0][0])};
+	}
+
+	gnc::Vector3f gyro(const gnc::Vector3f &raw) const { return (raw - G_offset) * g_scale; }
+	gnc::Vector3f accel(const gnc::Vector3f &raw) const { return A_Ainv * (raw - A_B); }
+	gnc::Vector3f mag(const gnc::Vector3f &raw) const { return M_Ainv * (raw - M_B); }
+};
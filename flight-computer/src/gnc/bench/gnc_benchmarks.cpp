@@ -0,0 +1,219 @@
+/*
+    gnc_benchmarks.cpp: Google Benchmark suite for the gnc library
+
+    ns per call on the host for what the flight loop runs every sample:
+    - Estimator::estimate, one lockstep step with every sensor, for each
+      attitude policy altitude.cpp instantiates
+    - attitude predict, accel update and mag update on their own, plain and
+      UD factored EKF, the error-state filter and the fixed gain filters
+    - one vertical channel step, complementary vs Kalman
+
+    The inputs are a synthetic pitch oscillation (the same one gnc_bench
+    uses for its schedules) tabulated up front, so the timed loop is the
+    filter and nothing else. Accuracy checks and the before/after kernel
+    comparisons stay in data-analysis/filter-tests/gnc_bench.cpp; this is
+    the number to watch from one commit to the next, e.g.
+
+        ./gnc_benchmarks --benchmark_filter=Estimate
+*/
+
+#include <cmath>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "altitude.h"
+
+namespace
+{
+
+const float SIGMA_ACCEL = 0.5f;
+const float SIGMA_GYRO = 0.05f;
+const float SIGMA_BARO = 0.5f;
+const float ACCEL_THRESHOLD = 0.1f;
+
+// one lockstep sample of every sensor
+struct sample
+{
+    float gyro[3];
+    float accel[3];
+    float mag[3];
+    float baro;
+};
+
+// rocket pitching +-0.2 rad at 8 Hz, sampled every 10 ms, climbing slowly
+// so the vertical channel has something to do. Accel stays near g, so the
+// gates let the updates through like they would on the pad
+const std::vector<sample> &samples()
+{
+    static std::vector<sample> table;
+    if (!table.empty())
+        return table;
+
+    const int count = 1000;
+    const float dt = 0.01f;
+    const float amp = 0.2f;
+    const float omega = 2.f * GNC_PI * 8.f;
+    table.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        float ts = i * dt;
+        float theta = amp * sinf(omega * ts);
+        gnc::Quatf q = gnc::Quatf::fromRotationVector(gnc::vec3(0.f, theta, 0.f));
+
+        sample &s = table[i];
+        s.gyro[0] = s.gyro[2] = 0.f;
+        s.gyro[1] = amp * omega * cosf(omega * ts);
+        q.rotateInverse(gnc::vec3(0.f, 0.f, GRAVITY)).copyTo(s.accel);
+        q.rotateInverse(gnc::vec3<float>(Bx, By, Bz)).copyTo(s.mag);
+        s.baro = 100.f + 2.f * ts;
+    }
+    return table;
+}
+
+// ------------------------------------------------------------------
+// whole estimator
+// ------------------------------------------------------------------
+
+template <class AttitudePolicy>
+void Estimate(benchmark::State &state)
+{
+    const std::vector<sample> &in = samples();
+    BasicEstimator<AttitudePolicy> est(SIGMA_ACCEL, SIGMA_GYRO, SIGMA_BARO, ACCEL_THRESHOLD);
+    uint32_t t_ms = 0;
+    size_t i = 0;
+
+    for (auto _ : state)
+    {
+        // estimate() takes non-const pointers, it doesn't write through them
+        sample s = in[i];
+        est.estimate(s.accel, s.gyro, s.mag, s.baro, t_ms);
+        benchmark::DoNotOptimize(est);
+        t_ms += 10;
+        if (++i == in.size())
+            i = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(Estimate, ExtendedKalmanFilter);
+BENCHMARK_TEMPLATE(Estimate, UDExtendedKalmanFilter);
+BENCHMARK_TEMPLATE(Estimate, AttitudeBiasMEKF);
+BENCHMARK_TEMPLATE(Estimate, MahonyFilter);
+BENCHMARK_TEMPLATE(Estimate, MadgwickFilter);
+
+// ------------------------------------------------------------------
+// attitude filters
+// ------------------------------------------------------------------
+
+template <class AttitudePolicy>
+void AttitudePredict(benchmark::State &state)
+{
+    const std::vector<sample> &in = samples();
+    AttitudePolicy filter(SIGMA_GYRO);
+    size_t i = 0;
+
+    for (auto _ : state)
+    {
+        filter.predict(in[i].gyro, 0.01f);
+        benchmark::DoNotOptimize(filter);
+        if (++i == in.size())
+            i = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// a filter that has been running on the table for a while, predicted up
+// to the sample after, so the update below sees a normal innovation and
+// a settled covariance. Also gets the |a| ~ g run going
+template <class AttitudePolicy>
+AttitudePolicy warmFilter(size_t &next)
+{
+    const std::vector<sample> &in = samples();
+    AttitudePolicy filter(SIGMA_GYRO);
+    next = in.size() / 2;
+    for (size_t i = 0; i < next; i++)
+    {
+        filter.predict(in[i].gyro, 0.01f);
+        filter.updateAccel(in[i].accel);
+        filter.updateMag(in[i].mag);
+    }
+    filter.predict(in[next].gyro, 0.01f);
+    return filter;
+}
+
+// each update from the same warm filter, copied so every one starts from
+// the same place (the copy, a hundred bytes or so, is in the time).
+// Pausing the timer for a predict in between would cost more than the
+// update itself
+template <class AttitudePolicy>
+void AttitudeUpdateAccel(benchmark::State &state)
+{
+    size_t next;
+    const AttitudePolicy warm = warmFilter<AttitudePolicy>(next);
+    const float *accel = samples()[next].accel;
+
+    for (auto _ : state)
+    {
+        AttitudePolicy filter(warm);
+        filter.updateAccel(accel);
+        benchmark::DoNotOptimize(filter);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <class AttitudePolicy>
+void AttitudeUpdateMag(benchmark::State &state)
+{
+    size_t next;
+    const AttitudePolicy warm = warmFilter<AttitudePolicy>(next);
+    const float *mag = samples()[next].mag;
+
+    for (auto _ : state)
+    {
+        AttitudePolicy filter(warm);
+        filter.updateMag(mag);
+        benchmark::DoNotOptimize(filter);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+#define GNC_ATTITUDE_BENCHMARKS(Policy)              \
+    BENCHMARK_TEMPLATE(AttitudePredict, Policy);     \
+    BENCHMARK_TEMPLATE(AttitudeUpdateAccel, Policy); \
+    BENCHMARK_TEMPLATE(AttitudeUpdateMag, Policy)
+
+GNC_ATTITUDE_BENCHMARKS(ExtendedKalmanFilter);
+GNC_ATTITUDE_BENCHMARKS(UDExtendedKalmanFilter);
+GNC_ATTITUDE_BENCHMARKS(AttitudeBiasMEKF);
+GNC_ATTITUDE_BENCHMARKS(MahonyFilter);
+GNC_ATTITUDE_BENCHMARKS(MadgwickFilter);
+
+// ------------------------------------------------------------------
+// vertical channel
+// ------------------------------------------------------------------
+
+// one baro step as the Estimator takes it, with the vertical accel the
+// attitude filter would have handed over
+template <class Vertical>
+void VerticalStep(benchmark::State &state)
+{
+    const std::vector<sample> &in = samples();
+    Vertical filter(SIGMA_ACCEL, SIGMA_BARO, ACCEL_THRESHOLD);
+    comp_filter_results prev{0.f, in[0].baro};
+    size_t i = 0;
+
+    for (auto _ : state)
+    {
+        prev = filter.estimate(in[i].baro, prev.altitude, prev.vertical_velocity, 0.2f, 0.01f);
+        benchmark::DoNotOptimize(prev);
+        if (++i == in.size())
+            i = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(VerticalStep, ComplementaryFilter);
+BENCHMARK_TEMPLATE(VerticalStep, VerticalKalmanFilter);
+
+} // namespace
@@ -0,0 +1,41 @@
+/*
+   crc32.h: CRC-32 (IEEE 802.3, the zlib / PNG one) over a byte buffer
+
+   Four bits at a time from a 16 entry table, so it costs 64 bytes of
+   table rather than 1 KB and still does a few hundred bytes in well under
+   a microsecond, which is all the checkpoint and log records need. Matches
+   zlib.crc32 / binascii.crc32 on the host side, crc32("123456789") is
+   0xCBF43926.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace gnc
+{
+
+	// carry a running crc over several buffers, start from 0
+	inline uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+	{
+		static const uint32_t table[16] = {
+			0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+			0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+		const uint8_t *p = (const uint8_t *)data;
+		crc = ~crc;
+		for (size_t i = 0; i < len; i++)
+		{
+			crc = (crc >> 4) ^ table[(crc ^ p[i]) & 0x0F];
+			crc = (crc >> 4) ^ table[(crc ^ (p[i] >> 4)) & 0x0F];
+		}
+		return ~crc;
+	}
+
+	inline uint32_t crc32(const void *data, size_t len)
+	{
+		return crc32_update(0, data, len);
+	}
+
+} // namespace gnc
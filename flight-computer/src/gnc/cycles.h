@@ -0,0 +1,52 @@
+/*
+   cycles.h: Cheap CPU time stamps for accounting gnc work
+
+   On the ESP32 this is the core's cycle counter (CCOUNT), which wraps every
+   ~18 s at 240 MHz, so only ever subtract two nearby readings. On the host
+   there is no portable cycle counter so it is steady_clock nanoseconds
+   truncated to 32 bits, same wrap rules.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_cpu.h"
+#else
+#include <chrono>
+#endif
+
+namespace gnc
+{
+
+	inline uint32_t cycle_count()
+	{
+#ifdef ESP_PLATFORM
+		return (uint32_t)esp_cpu_get_cycle_count();
+#else
+		return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				   std::chrono::steady_clock::now().time_since_epoch())
+			.count();
+#endif
+	}
+
+	// running totals for one piece of work, in cycle_count() units
+	struct cpu_stats
+	{
+		uint32_t calls;
+		uint32_t max;
+		uint64_t total;
+
+		void add(uint32_t elapsed)
+		{
+			calls++;
+			total += elapsed;
+			if (elapsed > max)
+				max = elapsed;
+		}
+
+		uint32_t mean() const { return calls ? (uint32_t)(total / calls) : 0; }
+	};
+
+} // namespace gnc
@@ -0,0 +1,127 @@
+/*
+   fastmath.h: Single precision math kernels for the gnc hot path
+
+   The ESP32 FPU only does float, anything that touches a double (an
+   unsuffixed literal, abs() on a float, the double overloads of atan2/asin)
+   falls back to soft-double and costs 10-50x. Everything in here is float
+   in and float out, branch light and has a bounded error that gnc_bench
+   checks by sweeping the whole input range:
+
+	 fast_inv_sqrtf   relative error < 5e-6 (two newton steps)
+	 fast_sqrtf       relative error < 5e-6, exact 0 for x <= 0
+	 fast_atan2f      absolute error < 1.2e-5 rad
+	 fast_asinf       absolute error < 8e-5 rad, input clamped to [-1, 1]
+	 fast_normalize   ||q| - 1| < 5e-6 afterwards
+	 fast_euler       roll/yaw < 5e-5 rad, pitch < 8e-5 rad
+
+   That is all well under a thousandth of a degree, which is far below what
+   the filters can actually resolve.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "matrix.h"
+
+#define GNC_PI 3.14159265f
+#define GNC_PI_2 1.57079633f
+#define GNC_RAD_TO_DEG 57.2957795f
+#define GNC_DEG_TO_RAD 0.0174532925f
+
+namespace gnc
+{
+
+	// 1/sqrt(x) for x > 0, bit trick initial guess then two newton steps
+	inline float fast_inv_sqrtf(float x)
+	{
+		uint32_t i;
+		memcpy(&i, &x, sizeof(i));
+		i = 0x5f375a86u - (i >> 1);
+		float y;
+		memcpy(&y, &i, sizeof(y));
+
+		float half_x = 0.5f * x;
+		y = y * (1.5f - half_x * y * y);
+		y = y * (1.5f - half_x * y * y);
+		return y;
+	}
+
+	inline float fast_sqrtf(float x)
+	{
+		return x > 0.f ? x * fast_inv_sqrtf(x) : 0.f;
+	}
+
+	// atan(t) for |t| <= 1, Abramowitz & Stegun 4.4.47
+	inline float atan_unit(float t)
+	{
+		float t2 = t * t;
+		return t * (0.9998660f + t2 * (-0.3302995f + t2 * (0.1801410f + t2 * (-0.0851330f + t2 * 0.0208351f))));
+	}
+
+	// atan2 over all four quadrants, signed zero in y picks the side like atan2f
+	inline float fast_atan2f(float y, float x)
+	{
+		float ax = fabsf(x);
+		float ay = fabsf(y);
+		float hi = ax > ay ? ax : ay;
+		if (hi == 0.f)
+			return signbit(x) ? copysignf(GNC_PI, y) : copysignf(0.f, y);
+		float lo = ax > ay ? ay : ax;
+
+		float r = atan_unit(lo / hi);
+		if (ay > ax)
+			r = GNC_PI_2 - r;
+		if (x < 0.f)
+			r = GNC_PI - r;
+		return copysignf(r, y);
+	}
+
+	// asin(x), Abramowitz & Stegun 4.4.45 on |x| and mirrored
+	inline float fast_asinf(float x)
+	{
+		float ax = fabsf(x);
+		if (ax >= 1.f)
+			return copysignf(GNC_PI_2, x);
+		float p = 1.5707288f + ax * (-0.2121144f + ax * (0.0742610f + ax * -0.0187293f));
+		return copysignf(GNC_PI_2 - fast_sqrtf(1.f - ax) * p, x);
+	}
+
+	// normalize in place, false (and reset to identity) if the quaternion has collapsed
+	inline bool fast_normalize(Quatf &q)
+	{
+		float n2 = q.norm2();
+		if (n2 < 1e-24f)
+		{
+			q = Quatf::identity();
+			return false;
+		}
+		float s = fast_inv_sqrtf(n2);
+		q.w *= s;
+		q.x *= s;
+		q.y *= s;
+		q.z *= s;
+		return true;
+	}
+
+	// scale v to unit length, false (and v untouched) if it is basically zero
+	inline bool fast_normalize(Vector3f &v)
+	{
+		float n2 = dot(v, v);
+		if (n2 < 1e-18f)
+			return false;
+		v *= fast_inv_sqrtf(n2);
+		return true;
+	}
+
+	// ZYX (Tait-Bryan) angles in radians of a unit body to earth quaternion
+	inline void fast_euler(const Quatf &q, float &roll, float &pitch, float &yaw)
+	{
+		roll = fast_atan2f(q.w * q.x + q.y * q.z, 0.5f - (q.x * q.x + q.y * q.y));
+		pitch = fast_asinf(2.0f * (q.w * q.y - q.x * q.z));
+		yaw = fast_atan2f(q.x * q.y + q.w * q.z, 0.5f - (q.y * q.y + q.z * q.z));
+	}
+
+} // namespace gnc
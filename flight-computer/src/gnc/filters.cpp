@@ -0,0 +1,588 @@
+/*
+   filters.cpp: Filter class implementations
+ */
+
+#include "filters.h"
+
+using gnc::Matrix;
+using gnc::SymMatrix;
+using gnc::Vector3f;
+
+template <class Covariance>
+BasicExtendedKalmanFilter<Covariance>::BasicExtendedKalmanFilter(float gyro_noise, float accel_noise,
+																 float mag_noise)
+{
+	this->gyro_noise = gyro_noise;
+
+	prev_gyro_ = Vector3f::zeros();
+	gyro_primed_ = false;
+	efk_vals_.P = Covariance::diagonal(0.1f);
+	efk_vals_.q = 0.f;
+	efk_vals_.H_a = Matrix<3, 4>::zeros();
+	efk_vals_.H_m = Matrix<3, 4>::zeros();
+	efk_vals_.R_a = SymMatrix<3>::diagonal(accel_noise * accel_noise);
+	efk_vals_.R_m = SymMatrix<3>::diagonal(mag_noise * mag_noise);
+}
+
+Matrix<4, 4> build_omega(const float gyro[3])
+{
+	float gx = gyro[0];
+	float gy = gyro[1];
+	float gz = gyro[2];
+
+	return Matrix<4, 4>{{{0.f, -gx, -gy, -gz},
+						 {gx, 0.f, gz, -gy},
+						 {gy, -gz, 0.f, gx},
+						 {gz, gy, -gx, 0.f}}};
+}
+
+// called in each time step, essentially a random walk
+// TODO: tune this mf, should gyro noise be static or dynamic?
+template <class Covariance>
+void BasicExtendedKalmanFilter<Covariance>::setQOrientation(float dt)
+{
+	// Very rough approach: we guess Q ~ (dt^2 * gyro_noise^2) * I
+	// not sure if time needs to be squred here tho
+	// gyro_noise is in units: rad^2/s^2?
+	efk_vals_.q = gyro_noise * gyro_noise * dt * dt;
+}
+
+/// The actual function f(x,u):
+/// xCurr -> xPred
+template <class Covariance>
+State BasicExtendedKalmanFilter<Covariance>::processFunction(const float gyro[3], float dt)
+{
+	Vector3f w = gnc::vec3(gyro);
+#if GNC_QUAT_PROPAGATION == GNC_QUAT_EULER
+	return gnc::propagate_euler(curr_quat_, w, dt);
+#else
+	// rate taken as linear between the previous sample and this one, the
+	// first step has nothing before it so holds this one
+	if (!gyro_primed_)
+	{
+		prev_gyro_ = w;
+		gyro_primed_ = true;
+	}
+#if GNC_QUAT_PROPAGATION == GNC_QUAT_RK4
+	State next = gnc::propagate_rk4(curr_quat_, prev_gyro_, w, dt);
+#else
+	State next = gnc::propagate_exp(curr_quat_, prev_gyro_, w, dt);
+#endif
+	prev_gyro_ = w;
+	return next;
+#endif
+}
+
+/// Compute F = dF/dx. (4x4). Ignores normalization effect
+template <class Covariance>
+Matrix<4, 4> BasicExtendedKalmanFilter<Covariance>::computeF(const float gyro[3], float dt)
+{
+	// F = I + (dt/2)*Omega(gyro)
+	// not using curr_quat bc we have static gyro bias/dont store bias in 4x4
+	return Matrix<4, 4>::identity() + build_omega(gyro) * (0.5f * dt);
+}
+
+template <>
+void ExtendedKalmanFilter::propagateCovariance(const Matrix<4, 4> &F, float dt)
+{
+	// setting up the process noise matrix (Q matrix)
+	setQOrientation(dt);
+
+	// PPred = F * P * F^T + Q <-- note these are matrices
+	efk_vals_.P = gnc::sandwich(F, efk_vals_.P);
+	efk_vals_.P.addDiagonal(efk_vals_.q);
+}
+
+template <>
+void UDExtendedKalmanFilter::propagateCovariance(const Matrix<4, 4> &F, float dt)
+{
+	setQOrientation(dt);
+
+	// same F * P * F^T + Q, straight onto the factors
+	efk_vals_.P.propagate(F, efk_vals_.q);
+}
+
+template <class Covariance>
+void BasicExtendedKalmanFilter<Covariance>::predict(const float gyro[3], float dt)
+{
+	// compute predicted quaternion
+	State pred_quat = processFunction(gyro, dt);
+
+	// compute F e.g. jacobian e.g. partial derivative of process function
+	propagateCovariance(computeF(gyro, dt), dt);
+
+	curr_quat_ = pred_quat; // update the state
+}
+
+template <class Covariance>
+void BasicExtendedKalmanFilter<Covariance>::predictDelta(const float dtheta[3], float dt)
+{
+	// the increment can be a lot bigger than one gyro sample's worth, so use
+	// the closed form q = q * exp(dtheta/2) rather than an euler step
+	State pred_quat = curr_quat_ * State::fromRotationVector(gnc::vec3(dtheta));
+	gnc::fast_normalize(pred_quat);
+	gyro_primed_ = false; // no rate sample to interpolate from after this
+
+	// F = I + (1/2)*Omega(dtheta), i.e. computeF with gyro * dt = dtheta
+	propagateCovariance(Matrix<4, 4>::identity() + build_omega(dtheta) * 0.5f, dt);
+
+	curr_quat_ = pred_quat;
+}
+
+template <>
+SymMatrix<4> ExtendedKalmanFilter::getCovariance() const
+{
+	return efk_vals_.P;
+}
+
+template <>
+SymMatrix<4> UDExtendedKalmanFilter::getCovariance() const
+{
+	return efk_vals_.P.covariance();
+}
+
+template <class Covariance>
+typename BasicExtendedKalmanFilter<Covariance>::checkpoint BasicExtendedKalmanFilter<Covariance>::getCheckpoint() const
+{
+	return checkpoint{curr_quat_, efk_vals_.P};
+}
+
+template <class Covariance>
+void BasicExtendedKalmanFilter<Covariance>::restoreCheckpoint(const checkpoint &cp)
+{
+	curr_quat_ = cp.quat;
+	efk_vals_.P = cp.P;
+	gyro_primed_ = false; // the last rate sample is from before the restart
+	gravity_run_ = 0;
+}
+
+template <class Covariance>
+Vector3f BasicExtendedKalmanFilter<Covariance>::rotateGravity()
+{
+	// predicted accelerometer reading, earth (0, 0, g) seen from the body
+	return curr_quat_.rotateInverse(gnc::vec3(0.f, 0.f, GRAVITY));
+}
+
+template <class Covariance>
+void BasicExtendedKalmanFilter<Covariance>::computeH_Accel()
+{
+	efk_vals_.H_a = body_vector_jacobian(curr_quat_, gnc::vec3(0.f, 0.f, GRAVITY));
+}
+
+template <class Covariance>
+void BasicExtendedKalmanFilter<Covariance>::applyCorrection(const gnc::Vector<4> &dx)
+{
+	// x (updated quaternion) = x (curr quaternion) + K*y
+	curr_quat_.w += dx(0);
+	curr_quat_.x += dx(1);
+	curr_quat_.y += dx(2);
+	curr_quat_.z += dx(3);
+	// Renormalize quaternion, falls back to identity if degenerate
+	gnc::fast_normalize(curr_quat_);
+}
+
+template <>
+void ExtendedKalmanFilter::update(const Vector3f &y, const Matrix<3, 4> &H, const SymMatrix<3> &R,
+								  update_counts &counts)
+{
+	// S = H * PPred * H^T + R
+	Matrix<4, 3> PHt = gnc::multABt(static_cast<const Matrix<4, 4> &>(efk_vals_.P), H);
+	Matrix<3, 3> S = H * PHt + R;
+
+	// Kalman gain K = PPred * H^T * inv(S)
+	Matrix<3, 3> Sinv;
+	if (!gnc::inverse(S, Sinv))
+	{
+		// singular innovation covariance, skip update
+		return;
+	}
+
+	// chi-square gate, an outlier goes no further than this
+	if (!passGate(counts, gnc::dot(y, Sinv * y)))
+		return;
+	Matrix<4, 3> K = PHt * Sinv;
+
+	applyCorrection(K * y);
+
+	// PUpdated = (I - K*H) * PPred = PPred - K * (PPred * H^T)^T
+	efk_vals_.P -= gnc::symmetricABt(K, PHt);
+}
+
+template <>
+void UDExtendedKalmanFilter::update(const Vector3f &y, const Matrix<3, 4> &H, const SymMatrix<3> &R,
+									update_counts &counts)
+{
+	// gated on S = H * P * H^T + R worked out from U and D, so a rejected
+	// update costs a 3x3 inverse and nothing is copied or undone
+	Matrix<3, 3> S = efk_vals_.P.project(H) + R;
+	Matrix<3, 3> Sinv;
+	if (!gnc::inverse(S, Sinv))
+		return;
+	if (!passGate(counts, gnc::dot(y, Sinv * y)))
+		return;
+
+	// then one axis at a time (Bierman) in place, the same update as the
+	// full one since R is diagonal for both sensors. Each axis sees what
+	// the earlier ones left of its innovation
+	gnc::Vector<4> dx = gnc::Vector<4>::zeros();
+	for (int i = 0; i < 3; i++)
+	{
+		gnc::Vector<4> h = H.block<1, 4>(i, 0).transpose();
+		gnc::Vector<4> k;
+		efk_vals_.P.update(h, R[i][i], k);
+		dx += k * (y(i) - gnc::dot(h, dx));
+	}
+
+	applyCorrection(dx);
+}
+
+template <class Covariance>
+void BasicExtendedKalmanFilter<Covariance>::updateAccel(const float accel[3])
+{
+	// not reading gravity (boost, coast), nothing to compare against
+	if (!nearGravity(accel))
+		return;
+
+	// h is the predicted accelerometer reading if there's no linear motion
+	Vector3f h = rotateGravity();
+
+	// H = dH/dx where H is "measurement jacobian for accelerometer"
+	computeH_Accel();
+
+	// 3D innovation/residual
+	// y = z – h
+	update(gnc::vec3(accel) - h, efk_vals_.H_a, efk_vals_.R_a, update_stats_.accel);
+}
+
+template <class Covariance>
+Vector3f BasicExtendedKalmanFilter<Covariance>::rotateMag()
+{
+	return curr_quat_.rotateInverse(B_E);
+}
+
+template <class Covariance>
+void BasicExtendedKalmanFilter<Covariance>::computeH_Mag()
+{
+	efk_vals_.H_m = body_vector_jacobian(curr_quat_, B_E);
+}
+
+template <class Covariance>
+void BasicExtendedKalmanFilter<Covariance>::updateMag(const float mag[3])
+{
+	if (!magHasReference())
+		return;
+
+	// B_E is a unit vector so compare directions only
+	Vector3f m = gnc::vec3(mag);
+	if (!gnc::fast_normalize(m))
+		return;
+
+	// h is the predicted magnetometer reading
+	Vector3f h = rotateMag();
+
+	// H = dH/dx where H is "measurement jacobian for magnetometer"
+	computeH_Mag();
+
+	// 3D innovation/residual
+	// y = z – h
+	update(m - h, efk_vals_.H_m, efk_vals_.R_m, update_stats_.mag);
+}
+
+template class BasicExtendedKalmanFilter<SymMatrix<4>>;
+template class BasicExtendedKalmanFilter<gnc::UDFactor<4>>;
+
+template <bool GyroBias>
+ErrorStateKalmanFilter<GyroBias>::ErrorStateKalmanFilter(float gyro_noise, float gyro_bias_noise,
+														 float accel_noise, float mag_noise)
+{
+	gyro_noise_ = gyro_noise;
+	gyro_bias_noise_ = gyro_bias_noise;
+	r_accel_ = accel_noise * accel_noise;
+	r_mag_ = mag_noise * mag_noise;
+
+	gyro_bias_ = Vector3f::zeros();
+
+	// start out unsure of the attitude (~0.3 rad) and fairly sure of the bias
+	P_ = SymMatrix<N>::diagonal(0.1f);
+	for (int i = 3; i < N; i++)
+		P_[i][i] = 1e-4f;
+}
+
+template <bool GyroBias>
+void ErrorStateKalmanFilter<GyroBias>::predict(const float gyro[3], float dt)
+{
+	const float dtheta[3] = {gyro[0] * dt, gyro[1] * dt, gyro[2] * dt};
+	predictDelta(dtheta, dt);
+}
+
+template <bool GyroBias>
+void ErrorStateKalmanFilter<GyroBias>::predictDelta(const float dtheta[3], float dt)
+{
+	Vector3f phi = gnc::vec3(dtheta) - gyro_bias_ * dt;
+
+	// nominal state: q = q * exp(phi/2), closed form for a constant rate
+	curr_quat_ = curr_quat_ * State::fromRotationVector(phi);
+
+	// dq is unit so the norm only drifts by rounding, one newton step pulls it back
+	float k = 1.5f - 0.5f * curr_quat_.norm2();
+	curr_quat_.w *= k;
+	curr_quat_.x *= k;
+	curr_quat_.y *= k;
+	curr_quat_.z *= k;
+
+	// error state jacobian
+	// F = | I - [w x]dt   -I dt |
+	//     |     0           I   |
+	Matrix<N, N> F = Matrix<N, N>::identity();
+	Matrix<3, 3> phix = gnc::skew(phi);
+	for (int r = 0; r < 3; r++)
+	{
+		for (int c = 0; c < 3; c++)
+			F[r][c] -= phix[r][c];
+	}
+	for (int i = 3; i < N; i++)
+		F[i - 3][i] = -dt;
+
+	// P = F * P * F^T + Q
+	P_ = gnc::sandwich(F, P_);
+
+	float q_att = gyro_noise_ * gyro_noise_ * dt * dt;
+	float q_bias = gyro_bias_noise_ * gyro_bias_noise_ * dt;
+	for (int i = 0; i < 3; i++)
+		P_[i][i] += q_att;
+	for (int i = 3; i < N; i++)
+		P_[i][i] += q_bias;
+}
+
+template <bool GyroBias>
+void ErrorStateKalmanFilter<GyroBias>::updateVector(const Vector3f &z, const Vector3f &ref, float r,
+													update_counts &counts)
+{
+	// predicted body frame reading, h = R^T * ref
+	Vector3f h = curr_quat_.rotateInverse(ref);
+
+	// with q_true = q * dq(dtheta), h(dtheta) ~ h - dtheta x h = h + [h x] dtheta
+	// so H = [ [h x]  0 ] and only the first three columns are ever touched
+	Matrix<3, 3> H = gnc::skew(h);
+
+	// PHt = P * H^T (Nx3), only the attitude columns of P matter
+	Matrix<N, 3> PHt = gnc::multABt(P_.template block<N, 3>(0, 0), H);
+
+	// S = H * P * H^T + R, the top 3 rows of PHt are P_aa * H^T
+	Matrix<3, 3> S = H * PHt.template block<3, 3>(0, 0);
+	for (int i = 0; i < 3; i++)
+		S[i][i] += r;
+
+	Matrix<3, 3> Sinv;
+	if (!gnc::inverse(S, Sinv))
+		return; // singular innovation covariance, skip this update
+
+	Vector3f y = z - h;
+	if (!passGate(counts, gnc::dot(y, Sinv * y)))
+		return;
+
+	// K = PHt * inv(S) (Nx3), error state estimate dx = K * (z - h)
+	Matrix<N, 3> K = PHt * Sinv;
+	gnc::Vector<N> dx = K * y;
+
+	// inject attitude error multiplicatively then reset it to zero
+	curr_quat_ = curr_quat_ * State{1.f, 0.5f * dx(0), 0.5f * dx(1), 0.5f * dx(2)};
+	gnc::fast_normalize(curr_quat_);
+
+	for (int i = 3; i < N; i++)
+		gyro_bias_(i - 3) += dx(i);
+
+	// P = (I - K*H) * P = P - K * (P*H^T)^T
+	P_ -= gnc::symmetricABt(K, PHt);
+}
+
+template <bool GyroBias>
+void ErrorStateKalmanFilter<GyroBias>::updateAccel(const float accel[3])
+{
+	if (!nearGravity(accel))
+		return;
+	updateVector(gnc::vec3(accel), gnc::vec3(0.f, 0.f, GRAVITY), r_accel_, update_stats_.accel);
+}
+
+template <bool GyroBias>
+void ErrorStateKalmanFilter<GyroBias>::updateMag(const float mag[3])
+{
+	if (!magHasReference())
+		return;
+
+	// B_E is a unit vector so compare directions only
+	Vector3f m = gnc::vec3(mag);
+	if (!gnc::fast_normalize(m))
+		return;
+	updateVector(m, B_E, r_mag_, update_stats_.mag);
+}
+
+template <bool GyroBias>
+typename ErrorStateKalmanFilter<GyroBias>::checkpoint ErrorStateKalmanFilter<GyroBias>::getCheckpoint() const
+{
+	return checkpoint{curr_quat_, gyro_bias_, P_};
+}
+
+template <bool GyroBias>
+void ErrorStateKalmanFilter<GyroBias>::restoreCheckpoint(const checkpoint &cp)
+{
+	curr_quat_ = cp.quat;
+	gyro_bias_ = cp.gyro_bias;
+	P_ = cp.P;
+	gravity_run_ = 0;
+}
+
+template class ErrorStateKalmanFilter<false>;
+template class ErrorStateKalmanFilter<true>;
+
+float ComplementaryFilter::applyZUPT(float accel, float vel)
+{
+	// zero velocity once the accel has been quiet for the whole window
+	return zupt_.add(accel) ? 0.0f : vel;
+}
+
+ComplementaryFilter::ComplementaryFilter(float sigma_accel, float sigma_baro, float accel_threshold)
+	: zupt_(GNC_ZUPT_WINDOW, accel_threshold)
+{
+	// Compute the filter gain
+	gain_[0] = sqrtf(2.f * sigma_accel / sigma_baro);
+	gain_[1] = sigma_accel / sigma_baro;
+}
+
+comp_filter_results ComplementaryFilter::estimate(float baro_altitude, float past_altitude,
+												  float past_velocity, float accel, float dt)
+{
+	comp_filter_results cfr;
+	// Apply complementary filter
+	float altitude = past_altitude + dt * (past_velocity + (gain_[0] + gain_[1] * dt * 0.5f) * (baro_altitude - past_altitude)) + accel * dt * dt * 0.5f;
+	float velocity = past_velocity + dt * (gain_[1] * (baro_altitude - past_altitude) + accel);
+	// Compute zero-velocity update
+	velocity = applyZUPT(accel, velocity);
+
+	cfr.vertical_velocity = velocity;
+	cfr.altitude = altitude;
+
+	return cfr;
+}
+
+comp_filter_results ComplementaryFilter::propagate(const comp_filter_results &state, float accel, float dt)
+{
+	comp_filter_results cfr;
+	cfr.altitude = state.altitude + dt * (state.vertical_velocity + 0.5f * accel * dt);
+	cfr.vertical_velocity = state.vertical_velocity + accel * dt;
+	return cfr;
+}
+
+// Iterates the Riccati recursion for the constant-dt model until the gain
+// stops moving, which gives the steady-state (DARE) Kalman gain
+//   x = [h, v, b], u = measured vertical accel
+//   h' = h + v*dt + (u - b)*dt^2/2
+//   v' = v + (u - b)*dt
+//   b' = b
+Vector3f VerticalKalmanFilter::solveSteadyStateGain(float dt, float sigma_accel, float sigma_baro,
+													float sigma_bias)
+{
+	// done in double since it only runs at init and the recursion is stiff for small dt
+	typedef Matrix<3, 3, double> Matrix3d;
+	typedef gnc::Vector<3, double> Vector3d;
+
+	const double h = dt;
+	const Matrix3d F{{{1.0, h, -0.5 * h * h},
+					  {0.0, 1.0, -h},
+					  {0.0, 0.0, 1.0}}};
+	const Vector3d G = gnc::vec3(0.5 * h * h, h, 0.0);
+	const double qa = (double)sigma_accel * sigma_accel;
+	const double qb = (double)sigma_bias * sigma_bias * h;
+	const double r = (double)sigma_baro * sigma_baro;
+
+	SymMatrix<3, double> P = SymMatrix<3, double>::diagonal(1.0);
+	P[0][0] = r;
+	Vector3d k_prev = Vector3d::zeros();
+	for (int iter = 0; iter < 5000; iter++)
+	{
+		// P = F * P * F^T + G * G^T * qa + Q_bias
+		P = gnc::sandwich(F, P);
+		P += gnc::symmetricABt(G * qa, G);
+		P[2][2] += qb;
+
+		// H = [1 0 0] so K = P[:,0] / (P[0][0] + r)
+		Vector3d k = P.block<3, 1>(0, 0) * (1.0 / (P[0][0] + r));
+
+		// P = (I - K*H) * P = P - K * P[0,:]
+		P -= gnc::symmetricABt(k, P.block<3, 1>(0, 0));
+
+		Vector3d change = k - k_prev;
+		k_prev = k;
+		if (fabs(change(0)) + fabs(change(1)) + fabs(change(2)) < 1e-10)
+			break;
+	}
+
+	return gnc::vec3((float)k_prev(0), (float)k_prev(1), (float)k_prev(2));
+}
+
+VerticalKalmanFilter::VerticalKalmanFilter(float sigma_accel, float sigma_baro, float accel_threshold,
+										   float nominal_dt, float sigma_bias)
+	: zupt_(GNC_ZUPT_WINDOW, accel_threshold)
+{
+	float dt_step = nominal_dt / 4.f;
+	inv_dt_step_ = 1.f / dt_step;
+	for (uint8_t k = 0; k < gain_table_size_; k++)
+	{
+		gains_[k] = solveSteadyStateGain((k + 1) * dt_step, sigma_accel, sigma_baro, sigma_bias);
+	}
+
+	accel_bias_ = 0.f;
+}
+
+float VerticalKalmanFilter::applyZUPT(float accel, float vel)
+{
+	return zupt_.add(accel) ? 0.0f : vel;
+}
+
+comp_filter_results VerticalKalmanFilter::estimate(float baro_altitude, float past_altitude,
+												   float past_velocity, float accel, float dt)
+{
+	// nearest tabulated gain, dt outside the table uses the closest end
+	int idx = (int)(dt * inv_dt_step_ + 0.5f) - 1;
+	if (idx < 0)
+		idx = 0;
+	else if (idx >= gain_table_size_)
+		idx = gain_table_size_ - 1;
+	const Vector3f &K = gains_[idx];
+
+	// predict with bias corrected accel
+	float a = accel - accel_bias_;
+	float altitude = past_altitude + dt * (past_velocity + 0.5f * a * dt);
+	float velocity = past_velocity + a * dt;
+
+	// correct with baro
+	float y = baro_altitude - altitude;
+	altitude += K(0) * y;
+	velocity += K(1) * y;
+	accel_bias_ += K(2) * y;
+
+	comp_filter_results cfr;
+	cfr.vertical_velocity = applyZUPT(accel, velocity);
+	cfr.altitude = altitude;
+	return cfr;
+}
+
+comp_filter_results VerticalKalmanFilter::propagate(const comp_filter_results &state, float accel, float dt)
+{
+	float a = accel - accel_bias_;
+	comp_filter_results cfr;
+	cfr.altitude = state.altitude + dt * (state.vertical_velocity + 0.5f * a * dt);
+	cfr.vertical_velocity = state.vertical_velocity + a * dt;
+	return cfr;
+}
+
+float VerticalKalmanFilter::getAccelBias()
+{
+	return accel_bias_;
+}
+
+void VerticalKalmanFilter::restoreCheckpoint(const checkpoint &cp)
+{
+	accel_bias_ = cp.accel_bias;
+	zupt_ = cp.zupt;
+}
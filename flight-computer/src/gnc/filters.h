@@ -0,0 +1,235 @@
+/*
+   filters.h: Filter class declarations
+ */
+
+#pragma once
+
+// #include <cmath>
+#include <math.h>
+#include <stdint.h>
+
+#include "attitude.h"
+#include "fastmath.h"
+#include "quatprop.h"
+#include "quiet.h"
+#include "udfactor.h"
+
+// samples the vertical accel has to stay within the ZUPT threshold before
+// the velocity is clamped to zero, at most 64
+#ifndef GNC_ZUPT_WINDOW
+#define GNC_ZUPT_WINDOW 32
+#endif
+
+template <class Covariance>
+struct Ekf
+{
+	// 4x4 predicted covariance matrix, in full or UD factored
+	Covariance P;
+
+	// Process noise, Q = q * I so only the diagonal value is kept
+	float q;
+
+	// measurement jacobian for accelerometer
+	gnc::Matrix<3, 4> H_a;
+
+	// accelerometer measurement noise
+	gnc::SymMatrix<3> R_a;
+
+	// measurement jacobian for magnetometer
+	gnc::Matrix<3, 4> H_m;
+
+	// magnetometer measurement noise
+	gnc::SymMatrix<3> R_m;
+};
+
+struct comp_filter_results
+{
+	float vertical_velocity;
+	float altitude;
+};
+
+// 4-state quaternion EKF. Covariance is how P is kept: gnc::SymMatrix<4>
+// is the plain P = (I - KH)P form, gnc::UDFactor<4> keeps it as U * D * U^T
+// and updates the factors (udfactor.h), which stays positive definite in
+// float however long the filter sits still. Costs a bit more per predict
+template <class Covariance>
+class BasicExtendedKalmanFilter : public AttitudeCore
+{
+public:
+	BasicExtendedKalmanFilter(float gyro_noise, float accel_noise = 0.5f, float mag_noise = 0.5f);
+
+	// calcVerticalAccel() / calcAttitude() (AttitudeCore) for actual values
+
+	// call prediction first
+	void predict(const float gyro[3], float dt);
+	// or with a rotation vector accumulated over dt (see ImuPreintegrator)
+	void predictDelta(const float dtheta[3], float dt);
+
+	// then update the state with other sensor values
+	void updateAccel(const float accel[3]);
+	void updateMag(const float mag[3]);
+
+	// state for a warm restart (see Estimator::getCheckpoint), plain data
+	// P as a matrix either way, for checks and output
+	gnc::SymMatrix<4> getCovariance() const;
+
+	struct checkpoint
+	{
+		State quat;
+		Covariance P;
+	};
+	checkpoint getCheckpoint() const;
+	void restoreCheckpoint(const checkpoint &cp);
+
+private:
+	Ekf<Covariance> efk_vals_; // will hold curr vals
+	gnc::Vector3f prev_gyro_; // rate at the start of the step (GNC_QUAT_PROPAGATION)
+	bool gyro_primed_;
+	float gyro_noise;
+
+	// prediction steps that lead up to calling predict()
+	State processFunction(const float gyro[3], float dt);
+	void setQOrientation(float dt);
+	gnc::Matrix<4, 4> computeF(const float gyro[3], float dt);
+	void propagateCovariance(const gnc::Matrix<4, 4> &F, float dt);
+
+	// update prediction with accelerometer data (nonlinear update step)
+	gnc::Vector3f rotateGravity();
+	void computeH_Accel();
+
+	// update prediction with magnetometer data (nonlinear update step)
+	gnc::Vector3f rotateMag();
+	void computeH_Mag();
+
+	// shared measurement update, y is the innovation z - h(x), counted in counts
+	void update(const gnc::Vector3f &y, const gnc::Matrix<3, 4> &H, const gnc::SymMatrix<3> &R,
+				update_counts &counts);
+	void applyCorrection(const gnc::Vector<4> &dx);
+};
+
+typedef BasicExtendedKalmanFilter<gnc::SymMatrix<4>> ExtendedKalmanFilter;
+typedef BasicExtendedKalmanFilter<gnc::UDFactor<4>> UDExtendedKalmanFilter;
+
+// Error-state (multiplicative) EKF. The quaternion is the nominal state and is
+// propagated directly, P only holds the 3D attitude error (and the gyro bias
+// when GyroBias is set, making it 6x6). Corrections are applied as a small
+// rotation q = q * dq(dtheta) and then dtheta is reset to zero, so P stays full
+// rank and the filter does 3x3 work where ExtendedKalmanFilter does 4x4
+template <bool GyroBias>
+class ErrorStateKalmanFilter : public AttitudeCore
+{
+public:
+	// number of error states
+	static const int N = GyroBias ? 6 : 3;
+
+	// noise values are 1-sigma: gyro in rad/s, bias random walk in rad/s/sqrt(s),
+	// accel in m/s^2 and mag in units of the normalized field
+	ErrorStateKalmanFilter(float gyro_noise, float gyro_bias_noise = 0.001f,
+						   float accel_noise = 0.5f, float mag_noise = 0.5f);
+
+	// same interface as ExtendedKalmanFilter
+	void predict(const float gyro[3], float dt);
+	void predictDelta(const float dtheta[3], float dt);
+
+	void updateAccel(const float accel[3]);
+	void updateMag(const float mag[3]);
+
+	struct checkpoint
+	{
+		State quat;
+		gnc::Vector3f gyro_bias;
+		gnc::SymMatrix<N> P;
+	};
+	checkpoint getCheckpoint() const;
+	void restoreCheckpoint(const checkpoint &cp);
+
+private:
+	gnc::Vector3f gyro_bias_;
+	gnc::SymMatrix<N> P_;
+
+	float gyro_noise_;
+	float gyro_bias_noise_;
+	// measurement noise variances, R is diagonal for both sensors
+	float r_accel_;
+	float r_mag_;
+
+	// shared measurement update for a known earth-frame reference vector
+	void updateVector(const gnc::Vector3f &z, const gnc::Vector3f &ref, float r, update_counts &counts);
+};
+
+typedef ErrorStateKalmanFilter<false> AttitudeMEKF;
+typedef ErrorStateKalmanFilter<true> AttitudeBiasMEKF;
+
+class ComplementaryFilter
+{
+
+public:
+	ComplementaryFilter(float sigma_accel, float sigma_baro, float accel_threshold);
+
+	comp_filter_results estimate(float baro_altitude, float past_altitude,
+								 float past_velocity, float accel, float dt);
+
+	// prediction only, for carrying a state forward between baro samples
+	comp_filter_results propagate(const comp_filter_results &state, float accel, float dt);
+
+	// the altitude and velocity live in the Estimator, only the ZUPT window is ours
+	struct checkpoint
+	{
+		gnc::QuietDetector<> zupt;
+	};
+	checkpoint getCheckpoint() const { return checkpoint{zupt_}; }
+	void restoreCheckpoint(const checkpoint &cp) { zupt_ = cp.zupt; }
+
+private:
+	// filter gain
+	float gain_[2];
+	// Zero-velocity update
+	gnc::QuietDetector<> zupt_;
+
+	float applyZUPT(float accel, float vel);
+}; // Class ComplementaryFilter
+
+// 3-state vertical channel Kalman filter (altitude, velocity, accel bias)
+// driven by earth frame vertical accel and corrected by baro altitude.
+// The gains are the steady-state ones for a handful of sample periods,
+// solved once in the constructor, so a step costs about the same as
+// ComplementaryFilter::estimate and can be swapped in for it
+class VerticalKalmanFilter
+{
+public:
+	// sigma_bias is the accel bias random walk in m/s^2/sqrt(s), nominal_dt
+	// is the expected sample period in seconds
+	VerticalKalmanFilter(float sigma_accel, float sigma_baro, float accel_threshold,
+						 float nominal_dt = 0.05f, float sigma_bias = 0.01f);
+
+	comp_filter_results estimate(float baro_altitude, float past_altitude,
+								 float past_velocity, float accel, float dt);
+
+	// prediction only, for carrying a state forward between baro samples
+	comp_filter_results propagate(const comp_filter_results &state, float accel, float dt);
+
+	float getAccelBias();
+
+	struct checkpoint
+	{
+		float accel_bias;
+		gnc::QuietDetector<> zupt;
+	};
+	checkpoint getCheckpoint() const { return checkpoint{accel_bias_, zupt_}; }
+	void restoreCheckpoint(const checkpoint &cp);
+
+private:
+	// gains are tabulated for dt = (k + 1) * nominal_dt / 4, k = 0..7
+	static const uint8_t gain_table_size_ = 8;
+	gnc::Vector3f gains_[gain_table_size_];
+	float inv_dt_step_;
+
+	float accel_bias_;
+
+	// Zero-velocity update
+	gnc::QuietDetector<> zupt_;
+
+	float applyZUPT(float accel, float vel);
+	static gnc::Vector3f solveSteadyStateGain(float dt, float sigma_accel, float sigma_baro,
+											  float sigma_bias);
+}; // Class VerticalKalmanFilter
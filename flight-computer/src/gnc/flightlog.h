@@ -0,0 +1,282 @@
+/*
+   flightlog.h: Binary flight log format
+
+   The one definition of what goes in the log, shared by the firmware's
+   writer (FlightLogger in the v2 firmware) and the host decoders. Every
+   stream is an X-macro list of fields below, which expands into the packed
+   record structs both sides use and into the schema text at the start of
+   the log, so a field added here shows up in the writer, the decoder and
+   the file together.
+
+   The file is a run of blocks, each one of the logger's writes:
+
+     flightlog_block header, 24 bytes
+     records (or the schema text), back to back
+     zero padding up to size
+
+   The CRC covers the header and the used bytes, so a torn or corrupted
+   block is dropped on its own and the decoder picks up at the next one
+   (size says where it is, or scan for the magic if the header is gone).
+   Records never straddle blocks. seq counts blocks since boot; every boot
+   starts with a schema block (seq 0), so a log appended to over several
+   boots carries the schema of the firmware that wrote each part.
+
+   The firmware's flight loop writes every stream but EVENT on each pass it
+   has a new sample for (log_flight_loop() in the v2 system.h), EVENT is
+   written where the thing happens.
+
+   A record is flightlog_header then the stream's fields, little endian
+   and packed, fixed size per stream. The header's size byte lets a
+   decoder skip streams it doesn't know, its seq counts records per stream,
+   so a gap is a record dropped on the way (logger ring full).
+
+   Schema text, one line per stream after the version line, e.g.
+
+     flightlog 1
+     imu 1 size:u8 stream:u8 seq:u16 t_us:u32 accel_x:f32 ...
+
+   name, stream id, then name:type for every field in order, header first.
+   Types are u8 u16 u32 i16 i32 f32 f64.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "crc32.h"
+
+#define FLIGHTLOG_BLOCK_MAGIC 0x424C5050 // "PPLB"
+#define FLIGHTLOG_VERSION 1
+
+// block kinds
+#define FLIGHTLOG_BLOCK_SCHEMA 1
+#define FLIGHTLOG_BLOCK_RECORDS 2
+
+// field types, by the names the schema text uses
+typedef uint8_t flightlog_u8;
+typedef uint16_t flightlog_u16;
+typedef uint32_t flightlog_u32;
+typedef int16_t flightlog_i16;
+typedef int32_t flightlog_i32;
+typedef float flightlog_f32;
+typedef double flightlog_f64;
+
+// in front of every record
+#define FLIGHTLOG_HEADER_FIELDS(F) \
+	F(u8, size)                    \
+	F(u8, stream)                  \
+	F(u16, seq)                    \
+	F(u32, t_us)
+
+// ICM20948, calibrated: accel g, gyro rad/s, mag uT (M_B / M_Ainv applied
+// in the flight loop, zero while the AK09916 isn't read), temp is the
+// TMP1075 board temperature in C
+#define FLIGHTLOG_IMU_FIELDS(F) \
+	F(f32, accel_x)             \
+	F(f32, accel_y)             \
+	F(f32, accel_z)             \
+	F(f32, gyro_x)              \
+	F(f32, gyro_y)              \
+	F(f32, gyro_z)              \
+	F(f32, mag_x)               \
+	F(f32, mag_y)               \
+	F(f32, mag_z)               \
+	F(f32, temp)
+
+// ADXL375, g
+#define FLIGHTLOG_HIGHG_FIELDS(F) \
+	F(f32, accel_x)               \
+	F(f32, accel_y)               \
+	F(f32, accel_z)
+
+// BMP581, Pa, C, m above sea level (the pad offset isn't taken off)
+#define FLIGHTLOG_BARO_FIELDS(F) \
+	F(f32, pressure)             \
+	F(f32, temp)                 \
+	F(f32, altitude)
+
+// NMEA fix, degrees, m, m/s, degrees
+#define FLIGHTLOG_GPS_FIELDS(F) \
+	F(f64, lat)                 \
+	F(f64, lon)                 \
+	F(f32, alt)                 \
+	F(f32, speed)               \
+	F(f32, cog)                 \
+	F(f32, mag_vari)            \
+	F(u16, year)                \
+	F(u8, month)                \
+	F(u8, day)                  \
+	F(u8, hour)                 \
+	F(u8, minute)               \
+	F(u8, second)               \
+	F(u8, num_sats)             \
+	F(u8, fix_status)           \
+	F(u8, fix_valid)
+
+// Estimator output: attitude quaternion (body to earth), vertical channel
+// and the flight state (rocket_state) it was in
+#define FLIGHTLOG_ESTIMATOR_FIELDS(F) \
+	F(f32, q_w)                       \
+	F(f32, q_x)                       \
+	F(f32, q_y)                       \
+	F(f32, q_z)                       \
+	F(f32, altitude)                  \
+	F(f32, vertical_velocity)         \
+	F(f32, vertical_accel)            \
+	F(u8, state)
+
+// things that happen once, see flightlog_event_kind
+#define FLIGHTLOG_EVENT_FIELDS(F) \
+	F(u16, event)                 \
+	F(u16, arg)                   \
+	F(f32, value)
+
+// S(NAME, name, id, FIELDS), ids are what goes in the header's stream byte
+// and are never reused
+#define FLIGHTLOG_STREAMS(S)                                \
+	S(IMU, imu, 1, FLIGHTLOG_IMU_FIELDS)                    \
+	S(HIGHG, highg, 2, FLIGHTLOG_HIGHG_FIELDS)              \
+	S(BARO, baro, 3, FLIGHTLOG_BARO_FIELDS)                 \
+	S(GPS, gps, 4, FLIGHTLOG_GPS_FIELDS)                    \
+	S(ESTIMATOR, estimator, 5, FLIGHTLOG_ESTIMATOR_FIELDS) \
+	S(EVENT, event, 6, FLIGHTLOG_EVENT_FIELDS)
+
+// one past the largest stream id
+#define FLIGHTLOG_STREAM_IDS 7
+
+enum class flightlog_event_kind : uint16_t
+{
+	BOOT = 1,        // arg is esp_reset_reason(), value 1 on a warm restart
+	STATE = 2,       // arg is the new rocket_state
+	LOG_DROPS = 3,   // value is records the logger dropped so far, logged by finish()
+	LOG_LATENCY = 4, // value is the slowest block write (arg 0) or fsync (arg 1) so far, us
+	LANDED = 5,      // StateDeterminer::hasLanded(), arg is the rocket_state it landed in
+};
+
+#define FLIGHTLOG_MEMBER(type, name) flightlog_##type name;
+
+struct __attribute__((packed)) flightlog_header
+{
+	FLIGHTLOG_HEADER_FIELDS(FLIGHTLOG_MEMBER)
+};
+
+enum class flightlog_stream : uint8_t
+{
+#define FLIGHTLOG_STREAM_ID(NAME, name, id, FIELDS) NAME = id,
+	FLIGHTLOG_STREAMS(FLIGHTLOG_STREAM_ID)
+#undef FLIGHTLOG_STREAM_ID
+};
+
+// flightlog_imu, flightlog_baro, ... with the stream they go in
+#define FLIGHTLOG_RECORD(NAME, name, id, FIELDS)                   \
+	struct __attribute__((packed)) flightlog_##name                \
+	{                                                              \
+		static const flightlog_stream stream = flightlog_stream::NAME; \
+		flightlog_header header;                                   \
+		FIELDS(FLIGHTLOG_MEMBER)                                   \
+	};
+FLIGHTLOG_STREAMS(FLIGHTLOG_RECORD)
+#undef FLIGHTLOG_RECORD
+
+#define FLIGHTLOG_STR_(x) #x
+#define FLIGHTLOG_STR(x) FLIGHTLOG_STR_(x)
+#define FLIGHTLOG_SCHEMA_FIELD(type, name) " " #name ":" #type
+#define FLIGHTLOG_SCHEMA_STREAM(NAME, name, id, FIELDS) \
+	#name " " #id FLIGHTLOG_HEADER_FIELDS(FLIGHTLOG_SCHEMA_FIELD) FIELDS(FLIGHTLOG_SCHEMA_FIELD) "\n"
+
+// the schema block's text, a string literal
+#define FLIGHTLOG_SCHEMA \
+	"flightlog " FLIGHTLOG_STR(FLIGHTLOG_VERSION) "\n" FLIGHTLOG_STREAMS(FLIGHTLOG_SCHEMA_STREAM)
+
+struct __attribute__((packed)) flightlog_block
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t kind; // FLIGHTLOG_BLOCK_SCHEMA / RECORDS
+	uint32_t seq;  // blocks since boot, the schema block is 0
+	uint32_t size; // bytes the block takes in the file, padding included
+	uint32_t used; // header and contents, the rest up to size is zero padding
+	uint32_t crc;  // over the header up to here and the contents
+};
+static_assert(sizeof(flightlog_block) == 24, "flightlog_block is packed");
+
+// crc of a block whose header (but crc) is filled in, and used bytes of it
+// are at b
+inline uint32_t flightlog_block_crc(const flightlog_block *b)
+{
+	uint32_t crc = gnc::crc32(b, offsetof(flightlog_block, crc));
+	return gnc::crc32_update(crc, b + 1, b->used - sizeof(flightlog_block));
+}
+
+// whether the avail bytes at p start with an intact block
+inline bool flightlog_block_valid(const uint8_t *p, size_t avail)
+{
+	if (avail < sizeof(flightlog_block))
+		return false;
+	const flightlog_block *b = (const flightlog_block *)p;
+	return b->magic == FLIGHTLOG_BLOCK_MAGIC && b->version == FLIGHTLOG_VERSION &&
+		   b->used >= sizeof(flightlog_block) && b->used <= b->size && b->size <= avail &&
+		   b->crc == flightlog_block_crc(b);
+}
+
+// ------------------------------------------------------------------
+// raw region
+// ------------------------------------------------------------------
+
+/*
+   In raw mode the logger writes its blocks straight to the card's sectors,
+   into a region of its own (the contiguous extent of a preallocated file,
+   so FATFS keeps it reserved and the file can still be copied off the card
+   as it is). The region is
+
+     sectors 0 and 1   superblock, two copies written alternately
+     from sector 2     the log, as a log file would have it
+
+   Every block's size is a whole number of sectors. Each boot's log is an
+   extent, starting where the last one ended; the superblock lists them and
+   the sectors each has, updated on the logger's fsync cadence. Blocks
+   written after the last update are found by following them from there,
+   the rest of the region is erased. flightlog_extract turns a card image
+   (or the file) back into a plain log.
+ */
+
+#define FLIGHTLOG_RAW_MAGIC 0x57525050 // "PPRW"
+#define FLIGHTLOG_RAW_VERSION 1
+#define FLIGHTLOG_RAW_SECTOR 512
+#define FLIGHTLOG_RAW_LOG_START 2 // first sector of the log in the region
+#define FLIGHTLOG_RAW_EXTENTS 60  // later boots carry on in the last one
+
+struct __attribute__((packed)) flightlog_raw_extent
+{
+	uint32_t first;   // sector in the region
+	uint32_t sectors; // written as of the superblock's update
+};
+
+struct __attribute__((packed)) flightlog_raw_superblock
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t copy;           // which of the two sectors this is
+	uint32_t seq;            // one up with every update, the higher valid copy is current
+	uint32_t region_start;   // card sector of the region's sector 0
+	uint32_t region_sectors; // superblocks included
+	uint32_t extent_count;
+	flightlog_raw_extent extents[FLIGHTLOG_RAW_EXTENTS];
+	uint8_t reserved[FLIGHTLOG_RAW_SECTOR - 24 - FLIGHTLOG_RAW_EXTENTS * sizeof(flightlog_raw_extent) - 4];
+	uint32_t crc; // over everything above
+};
+static_assert(sizeof(flightlog_raw_superblock) == FLIGHTLOG_RAW_SECTOR, "the superblock is one sector");
+
+inline uint32_t flightlog_raw_crc(const flightlog_raw_superblock *s)
+{
+	return gnc::crc32(s, offsetof(flightlog_raw_superblock, crc));
+}
+
+// whether the sector at p is an intact superblock
+inline bool flightlog_raw_valid(const uint8_t *p)
+{
+	const flightlog_raw_superblock *s = (const flightlog_raw_superblock *)p;
+	return s->magic == FLIGHTLOG_RAW_MAGIC && s->version == FLIGHTLOG_RAW_VERSION && s->copy < 2 &&
+		   s->extent_count <= FLIGHTLOG_RAW_EXTENTS && s->crc == flightlog_raw_crc(s);
+}
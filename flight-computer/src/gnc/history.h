@@ -0,0 +1,50 @@
+/*
+   history.h: Fixed size ring of recent samples for replaying late measurements
+
+   Pushing never fails, once full the oldest entry is overwritten. Indexing
+   is oldest first, so history[0] is the oldest sample still held and
+   history[size() - 1] the newest. N has to be a power of two so wrapping
+   is a mask instead of a divide.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace gnc
+{
+
+	template <typename T, int N>
+	class HistoryRing
+	{
+		static_assert(N > 0 && (N & (N - 1)) == 0, "history size must be a power of two");
+
+	public:
+		HistoryRing() : head_(0), count_(0) {}
+
+		void push(const T &item)
+		{
+			buf_[head_] = item;
+			head_ = (head_ + 1) & (N - 1);
+			if (count_ < N)
+				count_++;
+		}
+
+		// oldest first
+		const T &operator[](int i) const { return buf_[(head_ - count_ + i) & (N - 1)]; }
+
+		const T &newest() const { return buf_[(head_ - 1) & (N - 1)]; }
+
+		int size() const { return count_; }
+		bool full() const { return count_ == N; }
+		void clear() { count_ = 0; }
+
+		static int capacity() { return N; }
+
+	private:
+		T buf_[N];
+		int head_;
+		int count_;
+	};
+
+} // namespace gnc
@@ -0,0 +1,226 @@
+/*
+   magcal.cpp: Online magnetometer hard/soft-iron calibration
+ */
+
+#include <math.h>
+
+#include "magcal.h"
+
+using gnc::Matrix;
+using gnc::SymMatrix;
+using gnc::Vector;
+
+// starting coefficient variance, in units of scale_. Big enough that the
+// first few samples aren't pulled towards theta = 0
+#define MAGCAL_INITIAL_VARIANCE 100.f
+
+// Jacobi rotations until a is diagonal, a ends up holding the eigenvalues
+// on its diagonal and the columns of v the eigenvectors. 3x3 converges in
+// a handful of sweeps
+static void eigen_symmetric3(float a[3][3], float v[3][3])
+{
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+			v[r][c] = r == c ? 1.f : 0.f;
+
+	static const int pairs[3][2] = {{0, 1}, {0, 2}, {1, 2}};
+	for (int sweep = 0; sweep < 8; sweep++)
+	{
+		float off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+		float diag = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+		if (off <= 1e-14f * diag)
+			break;
+
+		for (int i = 0; i < 3; i++)
+		{
+			int p = pairs[i][0], q = pairs[i][1];
+			if (a[p][q] == 0.f)
+				continue;
+			float theta = (a[q][q] - a[p][p]) / (2.f * a[p][q]);
+			float t = 1.f / (fabsf(theta) + sqrtf(theta * theta + 1.f));
+			if (theta < 0.f)
+				t = -t;
+			float c = 1.f / sqrtf(t * t + 1.f);
+			float s = t * c;
+
+			for (int k = 0; k < 3; k++)
+			{
+				float akp = a[k][p], akq = a[k][q];
+				a[k][p] = c * akp - s * akq;
+				a[k][q] = s * akp + c * akq;
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				float apk = a[p][k], aqk = a[q][k];
+				a[p][k] = c * apk - s * aqk;
+				a[q][k] = s * apk + c * aqk;
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				float vkp = v[k][p], vkq = v[k][q];
+				v[k][p] = c * vkp - s * vkq;
+				v[k][q] = s * vkp + c * vkq;
+			}
+		}
+	}
+}
+
+MagCalibrator::MagCalibrator(float forgetting)
+{
+	forgetting_ = forgetting;
+	reset();
+}
+
+void MagCalibrator::reset()
+{
+	theta_ = Vector<9>::zeros();
+	P_ = SymMatrix<9>::diagonal(MAGCAL_INITIAL_VARIANCE);
+	scale_ = 0.f;
+	residual_sq_ = 0.f;
+	residual_count_ = 0;
+	since_solve_ = 0;
+
+	cal_ = mag_calibration{};
+	for (int i = 0; i < 3; i++)
+		cal_.soft_iron[i][i] = 1.f;
+	cal_.residual = 1.f;
+	cal_.axis_ratio = 1.f;
+}
+
+void MagCalibrator::add(const float mag[3])
+{
+	if (scale_ == 0.f)
+	{
+		scale_ = sqrtf(mag[0] * mag[0] + mag[1] * mag[1] + mag[2] * mag[2]);
+		if (scale_ == 0.f)
+			return;
+	}
+
+	// how well the current fit explains the sample, and which side of the
+	// centre it's on
+	if (cal_.valid)
+	{
+		float d[3], out[3];
+		for (int i = 0; i < 3; i++)
+			d[i] = mag[i] - cal_.bias[i];
+		correct(mag, out);
+		float err = sqrtf(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]) / cal_.radius - 1.f;
+
+		// plain mean until there are enough samples for the low-pass to take over
+		residual_count_++;
+		float gain = 1.f / (float)residual_count_;
+		if (gain < MAGCAL_RESIDUAL_GAIN)
+			gain = MAGCAL_RESIDUAL_GAIN;
+		residual_sq_ += gain * (err * err - residual_sq_);
+		cal_.residual = sqrtf(residual_sq_);
+		cal_.octants |= 1u << ((d[0] > 0.f ? 1 : 0) | (d[1] > 0.f ? 2 : 0) | (d[2] > 0.f ? 4 : 0));
+	}
+
+	float x = mag[0] / scale_, y = mag[1] / scale_, z = mag[2] / scale_;
+	Vector<9> phi;
+	phi(0) = x * x + y * y - 2.f * z * z;
+	phi(1) = x * x + z * z - 2.f * y * y;
+	phi(2) = 2.f * x * y;
+	phi(3) = 2.f * x * z;
+	phi(4) = 2.f * y * z;
+	phi(5) = 2.f * x;
+	phi(6) = 2.f * y;
+	phi(7) = 2.f * z;
+	phi(8) = 1.f;
+
+	// RLS, P = (P - P phi phi^T P / (lambda + phi^T P phi)) / lambda
+	Vector<9> Pphi = static_cast<const Matrix<9, 9> &>(P_) * phi;
+	float denom = forgetting_ + gnc::dot(phi, Pphi);
+	float e = x * x + y * y + z * z - gnc::dot(phi, theta_);
+	theta_ += Pphi * (e / denom);
+	SymMatrix<9> dP = gnc::symmetricABt(Pphi, Pphi);
+	float inv_denom = 1.f / denom, inv_forgetting = 1.f / forgetting_;
+	for (int r = 0; r < 9; r++)
+		for (int c = r; c < 9; c++)
+		{
+			float p = (P_[r][c] - dP[r][c] * inv_denom) * inv_forgetting;
+			P_[r][c] = p;
+			P_[c][r] = p;
+		}
+
+	cal_.samples++;
+	if (++since_solve_ >= MAGCAL_SOLVE_INTERVAL)
+	{
+		since_solve_ = 0;
+		solve();
+	}
+}
+
+// theta gives the quadric x^T M x + 2 v^T x + J = 0, sign flipped so
+// trace(M) = -3 (see magcal.h). About its centre b = -M^-1 v that is
+// (x - b)^T M (x - b) = b^T M b - J, so A = M / (b^T M b - J) is the
+// ellipsoid and A^1/2 maps it onto the unit sphere
+void MagCalibrator::solve()
+{
+	const Vector<9> &u = theta_;
+	Matrix<3, 3> M{{{u(0) + u(1) - 1.f, u(2), u(3)},
+					{u(2), u(0) - 2.f * u(1) - 1.f, u(4)},
+					{u(3), u(4), u(1) - 2.f * u(0) - 1.f}}};
+	gnc::Vector3f v = gnc::vec3(u(5), u(6), u(7));
+	float J = u(8);
+
+	bool was_valid = cal_.valid;
+	cal_.valid = false;
+	Matrix<3, 3> M_inv;
+	if (!gnc::inverse(M, M_inv))
+		return;
+	gnc::Vector3f b = M_inv * v * -1.f;
+	float s = gnc::dot(b, M * b) - J;
+	if (s == 0.f)
+		return;
+
+	float a[3][3], V[3][3];
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+			a[r][c] = M[r][c] / s;
+	eigen_symmetric3(a, V);
+	float lambda[3] = {a[0][0], a[1][1], a[2][2]};
+	if (!(lambda[0] > 0.f && lambda[1] > 0.f && lambda[2] > 0.f))
+		return;
+
+	// the sphere keeps the geometric mean radius, (l0 l1 l2)^-1/6
+	float radius = 1.f / cbrtf(sqrtf(lambda[0] * lambda[1] * lambda[2]));
+	float lo = fminf(lambda[0], fminf(lambda[1], lambda[2]));
+	float hi = fmaxf(lambda[0], fmaxf(lambda[1], lambda[2]));
+
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+		{
+			float sum = 0.f;
+			for (int k = 0; k < 3; k++)
+				sum += V[r][k] * sqrtf(lambda[k]) * V[c][k];
+			cal_.soft_iron[r][c] = sum * radius;
+		}
+	for (int i = 0; i < 3; i++)
+		cal_.bias[i] = b(i) * scale_;
+	cal_.radius = radius * scale_;
+	cal_.axis_ratio = sqrtf(hi / lo);
+	cal_.valid = true;
+
+	// a new fit after a bad patch, judge it on its own samples
+	if (!was_valid)
+	{
+		residual_sq_ = 0.f;
+		residual_count_ = 0;
+		cal_.octants = 0;
+	}
+}
+
+bool MagCalibrator::converged() const
+{
+	return cal_.valid && cal_.samples >= MAGCAL_MIN_SAMPLES && cal_.octants == 0xFF &&
+		   residual_count_ * MAGCAL_RESIDUAL_GAIN >= 1.f && cal_.axis_ratio <= MAGCAL_MAX_AXIS_RATIO &&
+		   cal_.residual <= MAGCAL_MAX_RESIDUAL;
+}
+
+void MagCalibrator::correct(const float raw[3], float out[3]) const
+{
+	float d[3] = {raw[0] - cal_.bias[0], raw[1] - cal_.bias[1], raw[2] - cal_.bias[2]};
+	for (int r = 0; r < 3; r++)
+		out[r] = cal_.soft_iron[r][0] * d[0] + cal_.soft_iron[r][1] * d[1] + cal_.soft_iron[r][2] * d[2];
+}
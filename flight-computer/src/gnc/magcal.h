@@ -0,0 +1,87 @@
+/*
+   magcal.h: Online magnetometer hard/soft-iron calibration
+
+   The raw field from a mag turned through every orientation lies on an
+   ellipsoid, offset by the hard-iron bias and stretched by the soft iron.
+   With the scale fixed by trace(M) = 3, the quadric x^T M x + 2 v^T x + J = 0
+   of an ellipsoid can be written (Petrov's parametrisation) as
+
+	 x^2 + y^2 + z^2 = u0 (x^2 + y^2 - 2 z^2) + u1 (x^2 + z^2 - 2 y^2)
+					   + 2 u2 xy + 2 u3 xz + 2 u4 yz + 2 u5 x + 2 u6 y + 2 u7 z + u8
+
+   which is linear in its 9 coefficients and doesn't care where the origin
+   is, so they are fit by recursive least squares one sample at a time: 9x9 covariance, constant memory and the same
+   ~200 multiply-adds per sample however long it runs. Every
+   MAGCAL_SOLVE_INTERVAL samples the coefficients are turned into a centre
+   (the bias) and a symmetric matrix that maps the ellipsoid onto a sphere
+   (the soft-iron correction, M_Ainv), through a 3x3 Jacobi eigen
+   decomposition. The sphere keeps the geometric mean radius, so corrected
+   values stay in the sensor's units.
+
+   Applied as corrected = soft_iron * (raw - bias), same as M_B / M_Ainv in
+   the flight computer's startup_vals.
+
+   A fit is only called good (converged()) once it has seen enough samples,
+   all 8 octants around the centre, the ellipsoid is a sane shape, and the
+   corrected field magnitude has stayed within MAGCAL_MAX_RESIDUAL of the
+   radius over the recent samples.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "matrix.h"
+
+// samples between solves, the solve is ~10 RLS updates worth of work
+#define MAGCAL_SOLVE_INTERVAL 32
+// fit quality needed to call it converged
+#define MAGCAL_MIN_SAMPLES 500
+#define MAGCAL_MAX_RESIDUAL 0.05f  // rms of |corrected| / radius - 1, noise included
+#define MAGCAL_MAX_AXIS_RATIO 2.f  // longest / shortest ellipsoid axis
+// low-pass gain per sample for the residual
+#define MAGCAL_RESIDUAL_GAIN 0.01f
+
+struct mag_calibration
+{
+	float bias[3];			// hard iron, raw units
+	float soft_iron[3][3];	// symmetric, corrected = soft_iron * (raw - bias)
+	float radius;			// corrected field magnitude, raw units
+	float residual;			// recent rms of |corrected| / radius - 1
+	float axis_ratio;		// longest / shortest axis of the fitted ellipsoid
+	uint32_t samples;
+	uint8_t octants;		// one bit per octant around the centre seen so far
+	bool valid;				// the last solve gave an ellipsoid
+};
+
+class MagCalibrator
+{
+public:
+	// forgetting is the RLS forgetting factor, 1 keeps every sample
+	explicit MagCalibrator(float forgetting = 1.f);
+
+	// one raw mag sample in any units
+	void add(const float mag[3]);
+
+	const mag_calibration &getCalibration() const { return cal_; }
+	bool converged() const;
+
+	// applies the current calibration
+	void correct(const float raw[3], float out[3]) const;
+
+	void reset();
+
+private:
+	float forgetting_;
+	// coefficients and covariance in units of scale_, picked from the first
+	// sample so the RLS works on numbers around 1
+	gnc::Vector<9> theta_;
+	gnc::SymMatrix<9> P_;
+	float scale_;
+	float residual_sq_;
+	uint32_t residual_count_; // samples judged against the current fit
+	uint32_t since_solve_;
+	mag_calibration cal_;
+
+	void solve();
+};
@@ -0,0 +1,502 @@
+/*
+   matrix.h: Fixed-size matrix and quaternion types for the gnc filters
+
+   Every dimension is a template parameter, so multiplying mismatched shapes
+   fails to compile and nothing ever touches the heap. All loops have
+   constant trip counts and are marked for unrolling, which for the 3x3 to
+   6x6 sizes the filters use turns each product into straight-line
+   multiply-adds. Header only so it builds the same under ESP-IDF and on host.
+ */
+
+#pragma once
+
+#include <math.h>
+
+#if defined(__clang__)
+#define GNC_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__)
+#define GNC_UNROLL _Pragma("GCC unroll 16")
+#else
+#define GNC_UNROLL
+#endif
+
+namespace gnc
+{
+
+	template <int R, int C, typename T = float>
+	struct Matrix
+	{
+		static_assert(R > 0 && C > 0, "matrix dimensions must be positive");
+
+		T m[R][C];
+
+		T *operator[](int r) { return m[r]; }
+		const T *operator[](int r) const { return m[r]; }
+
+		// vector style access, only makes sense for row or column vectors
+		T &operator()(int i) { return m[C == 1 ? i : 0][C == 1 ? 0 : i]; }
+		const T &operator()(int i) const { return m[C == 1 ? i : 0][C == 1 ? 0 : i]; }
+
+		static Matrix zeros()
+		{
+			Matrix out;
+			GNC_UNROLL
+			for (int r = 0; r < R; r++)
+			{
+				GNC_UNROLL
+				for (int c = 0; c < C; c++)
+					out.m[r][c] = T(0);
+			}
+			return out;
+		}
+
+		static Matrix diagonal(T v)
+		{
+			static_assert(R == C, "diagonal matrix must be square");
+			Matrix out = zeros();
+			GNC_UNROLL
+			for (int i = 0; i < R; i++)
+				out.m[i][i] = v;
+			return out;
+		}
+
+		static Matrix identity() { return diagonal(T(1)); }
+
+		static Matrix from(const T *data)
+		{
+			Matrix out;
+			GNC_UNROLL
+			for (int r = 0; r < R; r++)
+			{
+				GNC_UNROLL
+				for (int c = 0; c < C; c++)
+					out.m[r][c] = data[r * C + c];
+			}
+			return out;
+		}
+
+		void copyTo(T *data) const
+		{
+			GNC_UNROLL
+			for (int r = 0; r < R; r++)
+			{
+				GNC_UNROLL
+				for (int c = 0; c < C; c++)
+					data[r * C + c] = m[r][c];
+			}
+		}
+
+		// R2 x C2 sub-matrix starting at (r0, c0)
+		template <int R2, int C2>
+		Matrix<R2, C2, T> block(int r0, int c0) const
+		{
+			static_assert(R2 <= R && C2 <= C, "block larger than matrix");
+			Matrix<R2, C2, T> out;
+			GNC_UNROLL
+			for (int r = 0; r < R2; r++)
+			{
+				GNC_UNROLL
+				for (int c = 0; c < C2; c++)
+					out.m[r][c] = m[r0 + r][c0 + c];
+			}
+			return out;
+		}
+
+		Matrix<C, R, T> transpose() const
+		{
+			Matrix<C, R, T> out;
+			GNC_UNROLL
+			for (int r = 0; r < R; r++)
+			{
+				GNC_UNROLL
+				for (int c = 0; c < C; c++)
+					out.m[c][r] = m[r][c];
+			}
+			return out;
+		}
+
+		Matrix &operator+=(const Matrix &b)
+		{
+			GNC_UNROLL
+			for (int r = 0; r < R; r++)
+			{
+				GNC_UNROLL
+				for (int c = 0; c < C; c++)
+					m[r][c] += b.m[r][c];
+			}
+			return *this;
+		}
+
+		Matrix &operator-=(const Matrix &b)
+		{
+			GNC_UNROLL
+			for (int r = 0; r < R; r++)
+			{
+				GNC_UNROLL
+				for (int c = 0; c < C; c++)
+					m[r][c] -= b.m[r][c];
+			}
+			return *this;
+		}
+
+		Matrix &operator*=(T s)
+		{
+			GNC_UNROLL
+			for (int r = 0; r < R; r++)
+			{
+				GNC_UNROLL
+				for (int c = 0; c < C; c++)
+					m[r][c] *= s;
+			}
+			return *this;
+		}
+	};
+
+	template <int N, typename T = float>
+	using Vector = Matrix<N, 1, T>;
+
+	typedef Vector<3> Vector3f;
+	typedef Matrix<3, 3> Matrix3f;
+
+	template <typename T>
+	inline Vector<3, T> vec3(T x, T y, T z)
+	{
+		Vector<3, T> v;
+		v.m[0][0] = x;
+		v.m[1][0] = y;
+		v.m[2][0] = z;
+		return v;
+	}
+
+	template <typename T>
+	inline Vector<3, T> vec3(const T v[3])
+	{
+		return vec3(v[0], v[1], v[2]);
+	}
+
+	template <int R, int C, typename T>
+	inline Matrix<R, C, T> operator+(Matrix<R, C, T> a, const Matrix<R, C, T> &b)
+	{
+		return a += b;
+	}
+
+	template <int R, int C, typename T>
+	inline Matrix<R, C, T> operator-(Matrix<R, C, T> a, const Matrix<R, C, T> &b)
+	{
+		return a -= b;
+	}
+
+	template <int R, int C, typename T>
+	inline Matrix<R, C, T> operator*(Matrix<R, C, T> a, T s)
+	{
+		return a *= s;
+	}
+
+	template <int R, int C, typename T>
+	inline Matrix<R, C, T> operator*(T s, Matrix<R, C, T> a)
+	{
+		return a *= s;
+	}
+
+	// a * b
+	template <int R, int K, int C, typename T>
+	inline Matrix<R, C, T> operator*(const Matrix<R, K, T> &a, const Matrix<K, C, T> &b)
+	{
+		Matrix<R, C, T> out;
+		GNC_UNROLL
+		for (int r = 0; r < R; r++)
+		{
+			GNC_UNROLL
+			for (int c = 0; c < C; c++)
+			{
+				T sum = a.m[r][0] * b.m[0][c];
+				GNC_UNROLL
+				for (int k = 1; k < K; k++)
+					sum += a.m[r][k] * b.m[k][c];
+				out.m[r][c] = sum;
+			}
+		}
+		return out;
+	}
+
+	// a * b^T without building the transpose
+	template <int R, int K, int C, typename T>
+	inline Matrix<R, C, T> multABt(const Matrix<R, K, T> &a, const Matrix<C, K, T> &b)
+	{
+		Matrix<R, C, T> out;
+		GNC_UNROLL
+		for (int r = 0; r < R; r++)
+		{
+			GNC_UNROLL
+			for (int c = 0; c < C; c++)
+			{
+				T sum = a.m[r][0] * b.m[c][0];
+				GNC_UNROLL
+				for (int k = 1; k < K; k++)
+					sum += a.m[r][k] * b.m[c][k];
+				out.m[r][c] = sum;
+			}
+		}
+		return out;
+	}
+
+	// a^T * b without building the transpose
+	template <int R, int K, int C, typename T>
+	inline Matrix<R, C, T> multAtB(const Matrix<K, R, T> &a, const Matrix<K, C, T> &b)
+	{
+		Matrix<R, C, T> out;
+		GNC_UNROLL
+		for (int r = 0; r < R; r++)
+		{
+			GNC_UNROLL
+			for (int c = 0; c < C; c++)
+			{
+				T sum = a.m[0][r] * b.m[0][c];
+				GNC_UNROLL
+				for (int k = 1; k < K; k++)
+					sum += a.m[k][r] * b.m[k][c];
+				out.m[r][c] = sum;
+			}
+		}
+		return out;
+	}
+
+	template <int N, typename T>
+	inline T dot(const Vector<N, T> &a, const Vector<N, T> &b)
+	{
+		T sum = a.m[0][0] * b.m[0][0];
+		GNC_UNROLL
+		for (int i = 1; i < N; i++)
+			sum += a.m[i][0] * b.m[i][0];
+		return sum;
+	}
+
+	template <int N, typename T>
+	inline T norm(const Vector<N, T> &a)
+	{
+		return sqrt(dot(a, a));
+	}
+
+	template <typename T>
+	inline Vector<3, T> cross(const Vector<3, T> &a, const Vector<3, T> &b)
+	{
+		return vec3(a(1) * b(2) - a(2) * b(1),
+					a(2) * b(0) - a(0) * b(2),
+					a(0) * b(1) - a(1) * b(0));
+	}
+
+	// [v x], skew(v) * u == cross(v, u)
+	template <typename T>
+	inline Matrix<3, 3, T> skew(const Vector<3, T> &v)
+	{
+		Matrix<3, 3, T> out;
+		out.m[0][0] = T(0);
+		out.m[0][1] = -v(2);
+		out.m[0][2] = v(1);
+		out.m[1][0] = v(2);
+		out.m[1][1] = T(0);
+		out.m[1][2] = -v(0);
+		out.m[2][0] = -v(1);
+		out.m[2][1] = v(0);
+		out.m[2][2] = T(0);
+		return out;
+	}
+
+	// 3x3 inverse by adjugate, false (and out untouched) if near singular
+	template <typename T>
+	inline bool inverse(const Matrix<3, 3, T> &a, Matrix<3, 3, T> &out)
+	{
+		T c00 = a.m[1][1] * a.m[2][2] - a.m[1][2] * a.m[2][1];
+		T c01 = a.m[1][2] * a.m[2][0] - a.m[1][0] * a.m[2][2];
+		T c02 = a.m[1][0] * a.m[2][1] - a.m[1][1] * a.m[2][0];
+		T det = a.m[0][0] * c00 + a.m[0][1] * c01 + a.m[0][2] * c02;
+		if (fabs(det) < T(1e-12))
+			return false;
+		T s = T(1) / det;
+
+		out.m[0][0] = s * c00;
+		out.m[1][0] = s * c01;
+		out.m[2][0] = s * c02;
+		out.m[0][1] = s * (a.m[0][2] * a.m[2][1] - a.m[0][1] * a.m[2][2]);
+		out.m[1][1] = s * (a.m[0][0] * a.m[2][2] - a.m[0][2] * a.m[2][0]);
+		out.m[2][1] = s * (a.m[0][1] * a.m[2][0] - a.m[0][0] * a.m[2][1]);
+		out.m[0][2] = s * (a.m[0][1] * a.m[1][2] - a.m[0][2] * a.m[1][1]);
+		out.m[1][2] = s * (a.m[0][2] * a.m[1][0] - a.m[0][0] * a.m[1][2]);
+		out.m[2][2] = s * (a.m[0][0] * a.m[1][1] - a.m[0][1] * a.m[1][0]);
+		return true;
+	}
+
+	// Symmetric NxN matrix (covariances). Stored in full so it drops in
+	// anywhere a Matrix<N, N> is read, but the operations that produce one
+	// only compute the upper triangle and mirror it, which roughly halves the
+	// work and keeps the result exactly symmetric in float
+	template <int N, typename T = float>
+	struct SymMatrix : Matrix<N, N, T>
+	{
+		using Matrix<N, N, T>::m;
+
+		static SymMatrix zeros()
+		{
+			SymMatrix out;
+			static_cast<Matrix<N, N, T> &>(out) = Matrix<N, N, T>::zeros();
+			return out;
+		}
+
+		static SymMatrix diagonal(T v)
+		{
+			SymMatrix out;
+			static_cast<Matrix<N, N, T> &>(out) = Matrix<N, N, T>::diagonal(v);
+			return out;
+		}
+
+		// takes the upper triangle of a, ignores whatever is below it
+		static SymMatrix fromUpper(const Matrix<N, N, T> &a)
+		{
+			SymMatrix out;
+			GNC_UNROLL
+			for (int r = 0; r < N; r++)
+			{
+				GNC_UNROLL
+				for (int c = r; c < N; c++)
+				{
+					out.m[r][c] = a.m[r][c];
+					out.m[c][r] = a.m[r][c];
+				}
+			}
+			return out;
+		}
+
+		void addDiagonal(T v)
+		{
+			GNC_UNROLL
+			for (int i = 0; i < N; i++)
+				m[i][i] += v;
+		}
+
+		SymMatrix &operator+=(const SymMatrix &b)
+		{
+			Matrix<N, N, T>::operator+=(b);
+			return *this;
+		}
+
+		SymMatrix &operator-=(const SymMatrix &b)
+		{
+			Matrix<N, N, T>::operator-=(b);
+			return *this;
+		}
+	};
+
+	// a * b^T where the caller knows the result is symmetric (e.g. K * (P * H^T)^T)
+	template <int N, int K, typename T>
+	inline SymMatrix<N, T> symmetricABt(const Matrix<N, K, T> &a, const Matrix<N, K, T> &b)
+	{
+		SymMatrix<N, T> out;
+		GNC_UNROLL
+		for (int r = 0; r < N; r++)
+		{
+			GNC_UNROLL
+			for (int c = r; c < N; c++)
+			{
+				T sum = a.m[r][0] * b.m[c][0];
+				GNC_UNROLL
+				for (int k = 1; k < K; k++)
+					sum += a.m[r][k] * b.m[c][k];
+				out.m[r][c] = sum;
+				out.m[c][r] = sum;
+			}
+		}
+		return out;
+	}
+
+	// f * p * f^T, the covariance propagation / projection kernel
+	template <int M, int N, typename T>
+	inline SymMatrix<M, T> sandwich(const Matrix<M, N, T> &f, const SymMatrix<N, T> &p)
+	{
+		Matrix<M, N, T> fp = f * static_cast<const Matrix<N, N, T> &>(p);
+		return symmetricABt(fp, f);
+	}
+
+	// unit quaternion, Hamilton convention, rotates body frame into earth frame
+	template <typename T = float>
+	struct Quat
+	{
+		T w;
+		T x;
+		T y;
+		T z;
+
+		static Quat identity() { return Quat{T(1), T(0), T(0), T(0)}; }
+
+		// exp of a rotation vector (axis * angle)
+		static Quat fromRotationVector(const Vector<3, T> &v)
+		{
+			T angle = norm(v);
+			if (angle < T(1e-9))
+				return Quat{T(1), T(0.5) * v(0), T(0.5) * v(1), T(0.5) * v(2)};
+			T half = T(0.5) * angle;
+			T s = sin(half) / angle;
+			return Quat{cos(half), v(0) * s, v(1) * s, v(2) * s};
+		}
+
+		Quat operator*(const Quat &b) const
+		{
+			return Quat{w * b.w - x * b.x - y * b.y - z * b.z,
+						w * b.x + x * b.w + y * b.z - z * b.y,
+						w * b.y - x * b.z + y * b.w + z * b.x,
+						w * b.z + x * b.y - y * b.x + z * b.w};
+		}
+
+		Quat conjugate() const { return Quat{w, -x, -y, -z}; }
+
+		T norm2() const { return w * w + x * x + y * y + z * z; }
+
+		// false (and reset to identity) if the quaternion has collapsed
+		bool normalize()
+		{
+			T n = sqrt(norm2());
+			if (n < T(1e-12))
+			{
+				*this = identity();
+				return false;
+			}
+			n = T(1) / n;
+			w *= n;
+			x *= n;
+			y *= n;
+			z *= n;
+			return true;
+		}
+
+		// body to earth rotation matrix
+		Matrix<3, 3, T> toRotationMatrix() const
+		{
+			T w2 = w * w, x2 = x * x, y2 = y * y, z2 = z * z;
+			Matrix<3, 3, T> r;
+			r.m[0][0] = w2 + x2 - y2 - z2;
+			r.m[0][1] = T(2) * (x * y - w * z);
+			r.m[0][2] = T(2) * (x * z + w * y);
+			r.m[1][0] = T(2) * (x * y + w * z);
+			r.m[1][1] = w2 - x2 + y2 - z2;
+			r.m[1][2] = T(2) * (y * z - w * x);
+			r.m[2][0] = T(2) * (x * z - w * y);
+			r.m[2][1] = T(2) * (y * z + w * x);
+			r.m[2][2] = w2 - x2 - y2 + z2;
+			return r;
+		}
+
+		// body frame vector into earth frame
+		Vector<3, T> rotate(const Vector<3, T> &v) const
+		{
+			return toRotationMatrix() * v;
+		}
+
+		// earth frame vector into body frame
+		Vector<3, T> rotateInverse(const Vector<3, T> &v) const
+		{
+			return multAtB(toRotationMatrix(), v);
+		}
+	};
+
+	typedef Quat<float> Quatf;
+
+} // namespace gnc
@@ -0,0 +1,134 @@
+/*
+   padbias.cpp: Gyro and accel bias refinement while sitting on the pad
+ */
+
+#include <math.h>
+
+#include "padbias.h"
+
+PadBiasEstimator::PadBiasEstimator(float gravity, float gyro_step, float accel_step)
+	: gravity_(gravity), gyro_quiet_(PADBIAS_WINDOW, gyro_step), accel_quiet_(PADBIAS_WINDOW, accel_step)
+{
+	reset();
+}
+
+void PadBiasEstimator::reset()
+{
+	gyro_quiet_.reset();
+	accel_quiet_.reset();
+	primed_ = false;
+	clearSegment();
+	seg_temp_ = running_stats{};
+	for (int i = 0; i < 3; i++)
+	{
+		seg_gyro_mean_[i] = 0.f;
+		seg_cov_[i] = 0.f;
+	}
+	bias_ = pad_bias{};
+}
+
+void PadBiasEstimator::clearSegment()
+{
+	for (int i = 0; i < 3; i++)
+	{
+		gyro_[i] = running_stats{};
+		accel_[i] = running_stats{};
+	}
+	temp_ = running_stats{};
+}
+
+bool PadBiasEstimator::add(const float gyro[3], const float accel[3], float temp_c)
+{
+	if (!primed_)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			prev_gyro_[i] = gyro[i];
+			prev_accel_[i] = accel[i];
+		}
+		primed_ = true;
+		return false;
+	}
+
+	float dw = 0.f, da = 0.f, a2 = 0.f;
+	for (int i = 0; i < 3; i++)
+	{
+		dw += (gyro[i] - prev_gyro_[i]) * (gyro[i] - prev_gyro_[i]);
+		da += (accel[i] - prev_accel_[i]) * (accel[i] - prev_accel_[i]);
+		a2 += accel[i] * accel[i];
+		prev_gyro_[i] = gyro[i];
+		prev_accel_[i] = accel[i];
+	}
+	// the detector windows start out quiet, so they have to be full as well
+	bool gyro_still = gyro_quiet_.add(sqrtf(dw)) && gyro_quiet_.full();
+	bool accel_still = accel_quiet_.add(sqrtf(da)) && accel_quiet_.full();
+	bool level = fabsf(sqrtf(a2) / gravity_ - 1.f) < PADBIAS_GRAVITY_TOL;
+
+	if (!(gyro_still && accel_still && level))
+	{
+		// moved, keep what the segment had if it's enough
+		if (gyro_[0].n >= PADBIAS_MIN_SEGMENT)
+			closeSegment();
+		clearSegment();
+		return false;
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		gyro_[i].add(gyro[i]);
+		accel_[i].add(accel[i]);
+	}
+	temp_.add(temp_c);
+
+	if (gyro_[0].n >= PADBIAS_SEGMENT)
+	{
+		closeSegment();
+		clearSegment();
+	}
+	return true;
+}
+
+void PadBiasEstimator::closeSegment()
+{
+	uint32_t n = gyro_[0].n;
+	for (int i = 0; i < 3; i++)
+	{
+		bias_.gyro[i] = gyro_[i].mean;
+		bias_.gyro_sigma[i] = sqrtf(gyro_[i].variance() / (float)n);
+	}
+
+	// |mean accel| - g, along the mean accel
+	float m[3] = {accel_[0].mean, accel_[1].mean, accel_[2].mean};
+	float norm = sqrtf(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+	for (int i = 0; i < 3; i++)
+		bias_.accel[i] = (norm - gravity_) * m[i] / norm;
+
+	bias_.temperature = temp_.mean;
+	bias_.samples = n;
+	bias_.segments++;
+	bias_.valid = true;
+
+	// bivariate Welford of the segment means against temperature
+	seg_temp_.n++;
+	float dt = temp_.mean - seg_temp_.mean;
+	seg_temp_.mean += dt / (float)seg_temp_.n;
+	seg_temp_.m2 += dt * (temp_.mean - seg_temp_.mean);
+	for (int i = 0; i < 3; i++)
+	{
+		float db = bias_.gyro[i] - seg_gyro_mean_[i];
+		seg_gyro_mean_[i] += db / (float)seg_temp_.n;
+		seg_cov_[i] += dt * (bias_.gyro[i] - seg_gyro_mean_[i]);
+	}
+
+	// spread is judged on the std dev of the segment temperatures, the
+	// slope is only trusted once they cover a few degrees
+	float span = sqrtf(seg_temp_.variance()) * 2.f;
+	for (int i = 0; i < 3; i++)
+		bias_.temp_coeff[i] = span >= PADBIAS_MIN_TEMP_SPAN ? seg_cov_[i] / seg_temp_.m2 : 0.f;
+}
+
+void PadBiasEstimator::gyroBiasAt(float temp_c, float out[3]) const
+{
+	for (int i = 0; i < 3; i++)
+		out[i] = bias_.gyro[i] + bias_.temp_coeff[i] * (temp_c - bias_.temperature);
+}
@@ -0,0 +1,119 @@
+/*
+   padbias.h: Gyro and accel bias refinement while sitting on the pad
+
+   The NVS calibration is taken once on the bench, but gyro bias moves
+   with temperature and the rocket can sit on the pad for an hour. While
+   the vehicle is still, the mean gyro output is the bias and the mean
+   accel output is gravity plus the bias, so those means are kept up to
+   date here in the background.
+
+   Still is judged on the change between consecutive samples (|dw| and
+   |da| through a gnc::QuietDetector each) plus |a| being close to g,
+   so it doesn't depend on the bias being known. Still samples go into a
+   Welford mean / variance for the current still segment. A segment
+   becomes the bias estimate once it has PADBIAS_SEGMENT samples (then a
+   new one starts, so the estimate follows drift) or, if at least
+   PADBIAS_MIN_SEGMENT, when the vehicle moves. Everything is constant
+   memory and constant time per sample.
+
+   The segment means are also regressed against temperature, so once the
+   temperature has moved by PADBIAS_MIN_TEMP_SPAN the bias can be carried
+   to the temperature at launch instead of the one it was taken at.
+
+   Only the accel bias along gravity is observable from one orientation
+   (a bias across it looks exactly like a small tilt), so that is the only
+   component estimated. On the pad that is the rocket's long axis, the
+   one the vertical channel cares about.
+
+   Biases are in the units of the samples passed in, i.e. whatever is
+   left after the calibration already applied, to be subtracted from it.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "filters.h"
+#include "quiet.h"
+
+// stationarity: largest sample to sample change, and the window it has to
+// hold for (at most 64 samples)
+#define PADBIAS_GYRO_STEP 0.02f	   // rad/s
+#define PADBIAS_ACCEL_STEP 0.25f   // m/s^2
+#define PADBIAS_GRAVITY_TOL 0.05f  // | |a| / g - 1 |
+#define PADBIAS_WINDOW 50
+// still samples per segment, and the fewest worth keeping if it's cut short
+#define PADBIAS_SEGMENT 1000
+#define PADBIAS_MIN_SEGMENT 200
+// temperature spread (deg C) over the segments before the slope is used
+#define PADBIAS_MIN_TEMP_SPAN 2.f
+
+// Welford's running mean and variance
+struct running_stats
+{
+	uint32_t n;
+	float mean;
+	float m2;
+
+	void add(float x)
+	{
+		n++;
+		float d = x - mean;
+		mean += d / (float)n;
+		m2 += d * (x - mean);
+	}
+	float variance() const { return n > 1 ? m2 / (float)(n - 1) : 0.f; }
+};
+
+struct pad_bias
+{
+	float gyro[3];		 // rad/s
+	float accel[3];		 // along gravity only, see above
+	float gyro_sigma[3]; // 1-sigma of the gyro mean
+	float temperature;	 // deg C the bias was taken at
+	float temp_coeff[3]; // gyro bias change per deg C, 0 until there's enough spread
+	uint32_t samples;	 // in the segment the bias came from
+	uint32_t segments;	 // segments taken so far
+	bool valid;
+};
+
+class PadBiasEstimator
+{
+public:
+	// gravity in the units the accel samples come in
+	explicit PadBiasEstimator(float gravity = GRAVITY, float gyro_step = PADBIAS_GYRO_STEP,
+							  float accel_step = PADBIAS_ACCEL_STEP);
+
+	// one IMU sample with the calibration so far applied, and the IMU (or
+	// board) temperature. Returns true if it counted as still
+	bool add(const float gyro[3], const float accel[3], float temp_c);
+
+	const pad_bias &getBias() const { return bias_; }
+	// gyro bias carried from the temperature it was taken at to temp_c
+	void gyroBiasAt(float temp_c, float out[3]) const;
+
+	void reset();
+
+private:
+	float gravity_;
+	gnc::QuietDetector<> gyro_quiet_;
+	gnc::QuietDetector<> accel_quiet_;
+	float prev_gyro_[3];
+	float prev_accel_[3];
+	bool primed_;
+
+	// the still segment being collected
+	running_stats gyro_[3];
+	running_stats accel_[3];
+	running_stats temp_;
+
+	// segment means against temperature, for the slope
+	running_stats seg_temp_;
+	float seg_gyro_mean_[3];
+	float seg_cov_[3]; // co-moment of temperature and gyro bias
+
+	pad_bias bias_;
+
+	void closeSegment();
+	void clearSegment();
+};
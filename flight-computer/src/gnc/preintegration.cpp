@@ -0,0 +1,62 @@
+/*
+   preintegration.cpp: IMU delta-angle / delta-velocity accumulation
+ */
+
+#include "preintegration.h"
+
+using gnc::Vector3f;
+
+ImuPreintegrator::ImuPreintegrator()
+{
+	reset();
+	restart();
+}
+
+void ImuPreintegrator::reset()
+{
+	alpha_ = Vector3f::zeros();
+	beta_ = Vector3f::zeros();
+	vel_ = Vector3f::zeros();
+	scul_ = Vector3f::zeros();
+	dt_ = 0.f;
+	count_ = 0;
+}
+
+void ImuPreintegrator::restart()
+{
+	prev_dtheta_ = Vector3f::zeros();
+	prev_dvel_ = Vector3f::zeros();
+}
+
+void ImuPreintegrator::addSample(const float gyro[3], const float accel[3], float dt)
+{
+	Vector3f dtheta = gnc::vec3(gyro) * dt;
+
+	// (alpha_l-1 + dtheta_l-1 / 6), shared by the coning and sculling terms
+	Vector3f a = alpha_ + prev_dtheta_ * (1.f / 6.f);
+	beta_ += gnc::cross(a, dtheta) * 0.5f;
+
+	if (accel)
+	{
+		Vector3f dvel = gnc::vec3(accel) * dt;
+		Vector3f v = vel_ + prev_dvel_ * (1.f / 6.f);
+		scul_ += (gnc::cross(a, dvel) + gnc::cross(v, dtheta)) * 0.5f;
+		vel_ += dvel;
+		prev_dvel_ = dvel;
+	}
+
+	alpha_ += dtheta;
+	prev_dtheta_ = dtheta;
+	dt_ += dt;
+	count_++;
+}
+
+imu_delta ImuPreintegrator::take()
+{
+	imu_delta out;
+	out.dtheta = alpha_ + beta_;
+	out.dvel = vel_ + gnc::cross(alpha_, vel_) * 0.5f + scul_;
+	out.dt = dt_;
+	reset();
+	return out;
+}
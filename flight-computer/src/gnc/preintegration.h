@@ -0,0 +1,66 @@
+/*
+   preintegration.h: IMU delta-angle / delta-velocity accumulation
+
+   Sums gyro and accel samples at the full IMU rate into one rotation vector
+   and one velocity increment per filter step, so the filter can predict at
+   e.g. 100 Hz without losing what happened between its steps. Rotation that
+   isn't about a fixed axis (coning) and rotation while accelerating
+   (sculling) don't commute, so plain sums drift. Both get the two-sample
+   corrections from Savage, "Strapdown Inertial Navigation Integration
+   Algorithm Design", JGCD 1998:
+
+	 alpha = sum dtheta_l
+	 beta  = sum 1/2 (alpha_l-1 + dtheta_l-1 / 6) x dtheta_l          coning
+	 dv    = sum dv_l + 1/2 alpha x v                                 rotation
+			 + sum 1/2 [(alpha_l-1 + dtheta_l-1 / 6) x dv_l
+						 + (v_l-1 + dv_l-1 / 6) x dtheta_l]            sculling
+
+   dtheta = alpha + beta is the body rotation over the interval, dv is the
+   specific force velocity change resolved in the body frame at its start.
+ */
+
+#pragma once
+
+#include "matrix.h"
+
+struct imu_delta
+{
+	gnc::Vector3f dtheta; // rad, rotation vector
+	gnc::Vector3f dvel;	  // m/s, in the body frame at the start of the interval
+	float dt;			  // s, length of the interval
+};
+
+class ImuPreintegrator
+{
+public:
+	ImuPreintegrator();
+
+	// one IMU sample, rates in rad/s and m/s^2 over dt seconds. accel may be
+	// null when only the attitude is wanted, dvel is then left at zero
+	void addSample(const float gyro[3], const float accel[3], float dt);
+
+	// time accumulated since the last take()
+	float elapsed() const { return dt_; }
+	int samples() const { return count_; }
+
+	// hands over the accumulated increments and starts a new interval. The
+	// last sample stays as the previous one for the next interval's coning
+	// and sculling terms, the samples on either side of it are adjacent
+	imu_delta take();
+
+	// the next sample doesn't follow on from the last one (the channel
+	// restarted after a gap), so the last one is left out of its terms
+	void restart();
+
+private:
+	gnc::Vector3f alpha_; // summed delta angle
+	gnc::Vector3f beta_;  // coning correction
+	gnc::Vector3f vel_;	  // summed delta velocity
+	gnc::Vector3f scul_;  // sculling correction
+	gnc::Vector3f prev_dtheta_;
+	gnc::Vector3f prev_dvel_;
+	float dt_;
+	int count_;
+
+	void reset();
+};
@@ -0,0 +1,192 @@
+/*
+   profile.h: Per-stage time accounting for the GNC loop
+
+   Scoped timers around each stage the estimator runs (attitude predict,
+   the accel and mag updates, vertical accel, euler angles and the
+   vertical filter), so it's known where the time goes, on the board and
+   in the replays. The Estimator's per-channel cpu_stats say how much a
+   sensor sample costs in total, this splits it up.
+
+   Only built with GNC_PROFILE defined. Without it GNC_PROFILE_SCOPE
+   expands to nothing and none of the code below exists.
+
+   Times are in gnc::cycle_count() units, cycles on the ESP32 and ns on
+   the host. Each stage keeps calls, min, max and total, and a log scale
+   histogram for the p99: GNC_PROFILE_SUB_BINS bins per octave from 16 up
+   to GNC_PROFILE_MAX_OCTAVE, so the p99 comes out to within half a bin
+   (about 9%) with no samples kept, no sorting and nothing allocated.
+
+   Not thread safe. Every stage is timed from the one task running the
+   estimator, so take reports from that task too.
+ */
+
+#pragma once
+
+#ifdef GNC_PROFILE
+
+#include <stdint.h>
+
+#include "cycles.h"
+
+// histogram bins per octave (power of two) and the last octave counted, an
+// octave of 2^23 is 35 ms at 240 MHz, anything longer goes in the top bin
+#define GNC_PROFILE_SUB_BINS 4
+#define GNC_PROFILE_MIN_OCTAVE 4
+#define GNC_PROFILE_MAX_OCTAVE 23
+#define GNC_PROFILE_BINS ((GNC_PROFILE_MAX_OCTAVE - GNC_PROFILE_MIN_OCTAVE + 1) * GNC_PROFILE_SUB_BINS)
+
+namespace gnc
+{
+
+	enum class profile_stage : uint8_t
+	{
+		PREDICT,
+		UPDATE_ACCEL,
+		UPDATE_MAG,
+		VERTICAL_ACCEL,
+		ATTITUDE,
+		VERTICAL_FILTER,
+		COUNT
+	};
+
+	inline const char *profile_stage_name(profile_stage stage)
+	{
+		static const char *const names[] = {"predict", "accel", "mag", "vaccel", "euler", "vfilter"};
+		return names[(int)stage];
+	}
+
+	// one stage over a report period, plain data for the log and telemetry
+	struct stage_summary
+	{
+		uint32_t calls;
+		uint32_t min;
+		uint32_t mean;
+		uint32_t max;
+		uint32_t p99;
+	};
+
+	struct profile_report
+	{
+		stage_summary stage[(int)profile_stage::COUNT];
+	};
+
+	// all zeros is the empty state, so a static one needs no constructor
+	struct stage_times
+	{
+		uint32_t calls;
+		uint32_t min;
+		uint32_t max;
+		uint64_t total;
+		uint32_t bins[GNC_PROFILE_BINS];
+
+		void add(uint32_t elapsed)
+		{
+			if (calls == 0 || elapsed < min)
+				min = elapsed;
+			if (elapsed > max)
+				max = elapsed;
+			calls++;
+			total += elapsed;
+			bins[bin(elapsed)]++;
+		}
+
+		stage_summary summary() const
+		{
+			stage_summary s{calls, min, calls ? (uint32_t)(total / calls) : 0, max, 0};
+			if (calls == 0)
+				return s;
+
+			// first bin where the count from the top reaches 1%, rounding the
+			// count up so a handful of samples gives the max bin
+			uint32_t tail = (calls + 99) / 100, above = 0;
+			for (int b = GNC_PROFILE_BINS - 1; b >= 0; b--)
+			{
+				above += bins[b];
+				if (above >= tail)
+				{
+					s.p99 = binMiddle(b);
+					break;
+				}
+			}
+			// the bin middle can be past what was actually seen
+			if (s.p99 > max)
+				s.p99 = max;
+			if (s.p99 < min)
+				s.p99 = min;
+			return s;
+		}
+
+		// bin = octave and the next log2(GNC_PROFILE_SUB_BINS) bits below
+		// the leading one
+		static int bin(uint32_t x)
+		{
+			if (x < (1u << GNC_PROFILE_MIN_OCTAVE))
+				return 0;
+			int octave = 31 - __builtin_clz(x);
+			if (octave > GNC_PROFILE_MAX_OCTAVE)
+				return GNC_PROFILE_BINS - 1;
+			int sub = (int)(x >> (octave - 2)) & (GNC_PROFILE_SUB_BINS - 1);
+			return (octave - GNC_PROFILE_MIN_OCTAVE) * GNC_PROFILE_SUB_BINS + sub;
+		}
+
+		static uint32_t binMiddle(int b)
+		{
+			int octave = b / GNC_PROFILE_SUB_BINS + GNC_PROFILE_MIN_OCTAVE;
+			uint32_t width = 1u << (octave - 2);
+			return (1u << octave) + (uint32_t)(b % GNC_PROFILE_SUB_BINS) * width + width / 2;
+		}
+	};
+	static_assert(GNC_PROFILE_SUB_BINS == 4, "bin() takes two bits below the leading one");
+
+	struct profile_counters
+	{
+		stage_times stages[(int)profile_stage::COUNT];
+
+		stage_times &operator[](profile_stage stage) { return stages[(int)stage]; }
+
+		profile_report report() const
+		{
+			profile_report r;
+			for (int i = 0; i < (int)profile_stage::COUNT; i++)
+				r.stage[i] = stages[i].summary();
+			return r;
+		}
+
+		void reset() { *this = profile_counters{}; }
+	};
+
+	// the one every GNC_PROFILE_SCOPE adds to. Zero initialized and
+	// trivial, so there's no guard or constructor to run on first use
+	inline profile_counters &profiler()
+	{
+		static profile_counters instance;
+		return instance;
+	}
+
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(stage_times &times) : times_(times), start_(cycle_count()) {}
+		~ScopedTimer() { times_.add(cycle_count() - start_); }
+
+		ScopedTimer(const ScopedTimer &) = delete;
+		ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+	private:
+		stage_times &times_;
+		uint32_t start_;
+	};
+
+} // namespace gnc
+
+#define GNC_PROFILE_JOIN_(a, b) a##b
+#define GNC_PROFILE_JOIN(a, b) GNC_PROFILE_JOIN_(a, b)
+// times the rest of the enclosing block as the given profile_stage
+#define GNC_PROFILE_SCOPE(stage) \
+	gnc::ScopedTimer GNC_PROFILE_JOIN(gnc_profile_timer_, __LINE__)(gnc::profiler()[gnc::profile_stage::stage])
+
+#else
+
+#define GNC_PROFILE_SCOPE(stage)
+
+#endif // GNC_PROFILE
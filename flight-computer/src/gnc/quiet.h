@@ -0,0 +1,88 @@
+/*
+   quiet.h: "Quiet for the last N samples" detector
+
+   Keeps one bit per sample in the window (set if |value| > threshold) and a
+   running count of the set bits, so each sample costs O(1) whatever the
+   window length: the bit falling out of the window is subtracted, the new
+   one added. Used for the zero-velocity update, and meant for anything else
+   that waits for a signal to settle, e.g. landing detection on |a| - g.
+
+   A fresh detector counts as quiet, as if it had already seen a full window
+   of zeros, which is what the ZUPT wants on the pad. Check full() when a
+   whole window of real samples is needed first.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+namespace gnc
+{
+
+	template <int MaxWindow = 64>
+	class QuietDetector
+	{
+		static_assert(MaxWindow > 0, "window must hold at least one sample");
+
+	public:
+		explicit QuietDetector(int window = MaxWindow, float threshold = 0.f)
+			: threshold_(threshold)
+		{
+			setWindow(window);
+		}
+
+		// window is clamped to 1..MaxWindow, changing it starts over
+		void setWindow(int window)
+		{
+			window_ = window < 1 ? 1 : (window > MaxWindow ? MaxWindow : window);
+			reset();
+		}
+
+		void setThreshold(float threshold) { threshold_ = threshold; }
+
+		void reset()
+		{
+			for (int i = 0; i < words_; i++)
+				bits_[i] = 0;
+			idx_ = 0;
+			loud_ = 0;
+			seen_ = 0;
+		}
+
+		// adds a sample, returns quiet()
+		bool add(float value)
+		{
+			uint32_t mask = 1u << (idx_ & 31);
+			uint32_t &word = bits_[idx_ >> 5];
+			bool loud = fabsf(value) > threshold_;
+
+			loud_ -= (word & mask) ? 1 : 0;
+			loud_ += loud ? 1 : 0;
+			word = loud ? (word | mask) : (word & ~mask);
+
+			if (++idx_ == window_)
+				idx_ = 0;
+			if (seen_ < window_)
+				seen_++;
+			return loud_ == 0;
+		}
+
+		// no sample in the window was over the threshold
+		bool quiet() const { return loud_ == 0; }
+		// a whole window of samples has been added since the last reset
+		bool full() const { return seen_ == window_; }
+		int loudCount() const { return loud_; }
+		int window() const { return window_; }
+
+	private:
+		static const int words_ = (MaxWindow + 31) / 32;
+		uint32_t bits_[words_];
+		float threshold_;
+		int window_;
+		int idx_;
+		int loud_;
+		int seen_;
+	};
+
+} // namespace gnc
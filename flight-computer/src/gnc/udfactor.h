@@ -0,0 +1,231 @@
+/*
+   udfactor.h: UD factored covariance for the Kalman filters
+
+   P = U * D * U^T with U unit upper triangular and D diagonal, kept as the
+   factors and never formed in the filter. Propagation is Thornton's
+   modified weighted Gram-Schmidt and the measurement update is Bierman's,
+   one scalar component at a time. Neither ever subtracts one covariance
+   from another, which is where P = P - K * H * P loses positive
+   definiteness in float once the filter is confident (P small next to
+   the update), so D stays positive without ever going to double or
+   symmetrizing. No square roots either, unlike a Cholesky square root
+   filter, so the ESP32's single precision FPU does all of it.
+
+   Scalar updates mean a vector measurement has to have a diagonal R, or
+   be decorrelated first. Both sensors the filters use have one.
+
+   Stored in one NxN matrix, D on the diagonal and U above it, the unit
+   diagonal of U and the zeros below it are implied.
+ */
+
+#pragma once
+
+#include "matrix.h"
+
+namespace gnc
+{
+
+	template <int N, typename T = float>
+	struct UDFactor
+	{
+		Matrix<N, N, T> ud;
+
+		// P = v * I
+		static UDFactor diagonal(T v)
+		{
+			return UDFactor{Matrix<N, N, T>::diagonal(v)};
+		}
+
+		// factors a symmetric positive definite P, a pivot that comes out
+		// non-positive (P wasn't) is clamped to min_d
+		static UDFactor factor(const SymMatrix<N, T> &p, T min_d = T(1e-12))
+		{
+			UDFactor out{Matrix<N, N, T>::zeros()};
+			Matrix<N, N, T> &f = out.ud;
+			for (int j = N - 1; j >= 0; j--)
+			{
+				T d = p.m[j][j];
+				for (int k = j + 1; k < N; k++)
+					d -= f.m[k][k] * f.m[j][k] * f.m[j][k];
+				f.m[j][j] = d > min_d ? d : min_d;
+				for (int i = 0; i < j; i++)
+				{
+					T s = p.m[i][j];
+					for (int k = j + 1; k < N; k++)
+						s -= f.m[k][k] * f.m[i][k] * f.m[j][k];
+					f.m[i][j] = s / f.m[j][j];
+				}
+			}
+			return out;
+		}
+
+		// U * D * U^T, for the output and checks, the filters don't need it
+		SymMatrix<N, T> covariance() const
+		{
+			SymMatrix<N, T> p;
+			GNC_UNROLL
+			for (int r = 0; r < N; r++)
+			{
+				GNC_UNROLL
+				for (int c = r; c < N; c++)
+				{
+					// U(r, k) * D(k) * U(c, k) over k >= c, U(c, c) = 1
+					T sum = (r == c ? T(1) : ud.m[r][c]) * ud.m[c][c];
+					GNC_UNROLL
+					for (int k = c + 1; k < N; k++)
+						sum += ud.m[r][k] * ud.m[k][k] * ud.m[c][k];
+					p.m[r][c] = sum;
+					p.m[c][r] = sum;
+				}
+			}
+			return p;
+		}
+
+		T d(int i) const { return ud.m[i][i]; }
+
+		// H * P * H^T straight from the factors, (H * U) * D * (H * U)^T, so
+		// an update can be gated before any of it touches U or D
+		template <int M>
+		SymMatrix<M, T> project(const Matrix<M, N, T> &h) const
+		{
+			// H * U with the implied unit diagonal of U
+			T g[M][N];
+			GNC_UNROLL
+			for (int r = 0; r < M; r++)
+			{
+				GNC_UNROLL
+				for (int c = 0; c < N; c++)
+				{
+					T sum = h.m[r][c];
+					GNC_UNROLL
+					for (int k = 0; k < c; k++)
+						sum += h.m[r][k] * ud.m[k][c];
+					g[r][c] = sum;
+				}
+			}
+
+			SymMatrix<M, T> out;
+			GNC_UNROLL
+			for (int r = 0; r < M; r++)
+			{
+				GNC_UNROLL
+				for (int c = r; c < M; c++)
+				{
+					T sum = T(0);
+					GNC_UNROLL
+					for (int k = 0; k < N; k++)
+						sum += g[r][k] * ud.m[k][k] * g[c][k];
+					out.m[r][c] = sum;
+					out.m[c][r] = sum;
+				}
+			}
+			return out;
+		}
+
+		// P = F * P * F^T + q * I, Thornton's MWGS: the rows of
+		// W = [F * U | I] are orthogonalized against each other, last
+		// first, under the weights diag(D, q). What's left of each row's
+		// weighted norm is the new D, the projections are the new U
+		void propagate(const Matrix<N, N, T> &f, T q)
+		{
+			// W = [F * U | I], F * U with the implied unit diagonal of U
+			T w[N][2 * N];
+			GNC_UNROLL
+			for (int r = 0; r < N; r++)
+			{
+				GNC_UNROLL
+				for (int c = 0; c < N; c++)
+				{
+					T sum = f.m[r][c];
+					GNC_UNROLL
+					for (int k = 0; k < c; k++)
+						sum += f.m[r][k] * ud.m[k][c];
+					w[r][c] = sum;
+					w[r][N + c] = r == c ? T(1) : T(0);
+				}
+			}
+
+			T d_new[N];
+			for (int j = N - 1; j >= 0; j--)
+			{
+				// weighted copy of row j
+				T dw[2 * N];
+				T dj = T(0);
+				GNC_UNROLL
+				for (int k = 0; k < N; k++)
+				{
+					dw[k] = ud.m[k][k] * w[j][k];
+					dw[N + k] = q * w[j][N + k];
+					dj += w[j][k] * dw[k] + w[j][N + k] * dw[N + k];
+				}
+
+				// new D, only zero if the state stopped being random at all
+				T inv = dj > T(0) ? T(1) / dj : T(0);
+				for (int i = 0; i < j; i++)
+				{
+					T s = T(0);
+					GNC_UNROLL
+					for (int k = 0; k < 2 * N; k++)
+						s += w[i][k] * dw[k];
+					s *= inv;
+					GNC_UNROLL
+					for (int k = 0; k < 2 * N; k++)
+						w[i][k] -= s * w[j][k];
+					ud.m[i][j] = s;
+				}
+				d_new[j] = dj;
+			}
+			GNC_UNROLL
+			for (int j = 0; j < N; j++)
+				ud.m[j][j] = d_new[j];
+		}
+
+		// Bierman update for the scalar measurement z = h^T x + v, var(v) = r.
+		// Leaves the gain in k (x += k * (z - h^T x)) and returns the
+		// innovation variance h^T P h + r
+		T update(const Vector<N, T> &h, T r, Vector<N, T> &k)
+		{
+			// f = U^T h, v = D f
+			T f[N], v[N];
+			GNC_UNROLL
+			for (int j = 0; j < N; j++)
+			{
+				T sum = h.m[j][0];
+				GNC_UNROLL
+				for (int i = 0; i < j; i++)
+					sum += ud.m[i][j] * h.m[i][0];
+				f[j] = sum;
+				v[j] = ud.m[j][j] * sum;
+			}
+
+			// alpha accumulates h^T P h + r one state at a time, k holds the
+			// gain unscaled until the end
+			T alpha = r + f[0] * v[0];
+			ud.m[0][0] *= r / alpha;
+			k.m[0][0] = v[0];
+			GNC_UNROLL
+			for (int j = 1; j < N; j++)
+			{
+				T beta = alpha;
+				alpha += f[j] * v[j];
+				T lambda = -f[j] / beta;
+				ud.m[j][j] *= beta / alpha;
+				GNC_UNROLL
+				for (int i = 0; i < j; i++)
+				{
+					T u = ud.m[i][j];
+					ud.m[i][j] = u + k.m[i][0] * lambda;
+					k.m[i][0] += u * v[j];
+				}
+				k.m[j][0] = v[j];
+			}
+
+			T inv = T(1) / alpha;
+			GNC_UNROLL
+			for (int j = 0; j < N; j++)
+				k.m[j][0] *= inv;
+			return alpha;
+		}
+	};
+
+} // namespace gnc
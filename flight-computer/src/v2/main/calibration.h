@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+// sensor calibration kept in NVS, see read_nvs_startup_data() in system.h
+struct startup_vals
+{
+    int32_t access_count;
+    float G_offset[3];
+    float A_B[3];
+    float A_Ainv[3][3];
+    float M_B[3];
+    float M_Ainv[3][3];
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+// Warm restart after a reset mid-flight (brownout, watchdog, panic).
+//
+// The flight state is copied into RTC slow memory every
+// CONFIG_CHECKPOINT_PERIOD_MS. RTC_NOINIT memory isn't cleared by a system
+// reset, so on the next boot checkpoint_find() can hand it back and the
+// StateDeterminer picks up where it was instead of sitting in LAUNCH_READY
+// with an identity attitude. The NVS calibration and the baro pad reference
+// go along with it, so the restart skips reading NVS and the 300 sample baro
+// average (which would take the current altitude as the pad).
+//
+// There are two slots written alternately, so a reset in the middle of a
+// write still leaves the previous one intact. Whether RTC memory survives a
+// brownout depends on how far the supply dropped, hence the magic and CRC
+// rather than trusting whatever is there.
+
+#include <stddef.h>
+#include <sys/time.h>
+
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "calibration.h"
+#include "StateDetermination.h"
+#include "crc32.h"
+
+#define CHECKPOINT_MAGIC 0x43484B50 // "CHKP"
+
+struct rtc_checkpoint
+{
+    uint32_t magic;
+    uint32_t sequence;        // the higher of the two slots is the newer one
+    int64_t saved_us;         // gettimeofday() time, keeps counting through a reset
+    bool calibrated;          // the two below are only there if this is set
+    startup_vals calibration; // what read_nvs_startup_data() returned
+    float baro_offset;        // BMP581 pad reference
+    flight_checkpoint flight;
+    uint32_t crc; // over everything above
+};
+
+RTC_NOINIT_ATTR static rtc_checkpoint rtc_slots[2];
+
+static const startup_vals *checkpoint_calibration;
+static float checkpoint_baro_offset;
+static uint32_t checkpoint_sequence;
+static uint32_t checkpoint_last_ms;
+
+static int64_t checkpoint_clock_us()
+{
+    // the system time is kept by the RTC timer, which unlike esp_timer (and
+    // MILLIS()) doesn't start over at 0 after a reset
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static uint32_t checkpoint_crc(const rtc_checkpoint &cp)
+{
+    return gnc::crc32(&cp, offsetof(rtc_checkpoint, crc));
+}
+
+// only these states are worth coming back to, on the pad a normal boot is
+// fine and after landing there's nothing left to do
+static bool checkpoint_in_flight(rocket_state state)
+{
+    return state >= rocket_state::POWERED_FLIGHT_PHASE && state <= rocket_state::MAIN_DEPLOYED;
+}
+
+// Newest valid checkpoint if this boot is a reset mid-flight, nullptr if it's
+// a normal power on or nothing usable is there. Call before anything else
+// writes the slots
+const rtc_checkpoint *checkpoint_find(void)
+{
+    const rtc_checkpoint *best = nullptr;
+    for (int i = 0; i < 2; i++)
+    {
+        const rtc_checkpoint &slot = rtc_slots[i];
+        if (slot.magic != CHECKPOINT_MAGIC || slot.crc != checkpoint_crc(slot))
+            continue;
+        if (!best || (int32_t)(slot.sequence - best->sequence) > 0)
+            best = &slot;
+    }
+    if (!best)
+        return nullptr;
+    // carry on numbering from there even if it isn't used, so a stale
+    // checkpoint left over in the other slot never looks newer than ours
+    checkpoint_sequence = best->sequence;
+
+    esp_reset_reason_t reason = esp_reset_reason();
+    if (reason == ESP_RST_POWERON || reason == ESP_RST_DEEPSLEEP)
+        return nullptr;
+
+    int64_t age_us = checkpoint_clock_us() - best->saved_us;
+    if (!checkpoint_in_flight(best->flight.state) || age_us < 0 ||
+        age_us > (int64_t)CONFIG_CHECKPOINT_MAX_AGE_MS * 1000LL)
+        return nullptr;
+
+    ESP_LOGW("checkpoint", "reset (reason %d) in flight state %d, checkpoint is %lld ms old",
+             (int)reason, (int)best->flight.state, (long long)(age_us / 1000));
+    return best;
+}
+
+// picks the flight back up, now_ms is the StateDeterminer's clock (MILLIS()).
+// Call after SYS_INIT, right before the first determineState(), so the time
+// the init took is part of the gap the estimator coasts over
+void checkpoint_resume(StateDeterminer &state, const rtc_checkpoint &cp, uint32_t now_ms)
+{
+    float gap_s = (float)(checkpoint_clock_us() - cp.saved_us) * 1e-6f;
+    state.restoreCheckpoint(cp.flight, now_ms, gap_s);
+}
+
+// the calibration in use, saved along with every checkpoint. It is read at
+// each save, so later changes to it (pad mag calibration) go along
+void checkpoint_set_calibration(const startup_vals *calibration, float baro_offset)
+{
+    checkpoint_calibration = calibration;
+    checkpoint_baro_offset = baro_offset;
+}
+
+// call after each determineState(), saves once every CONFIG_CHECKPOINT_PERIOD_MS.
+// Returns true if it saved
+bool checkpoint_tick(const StateDeterminer &state, uint32_t now_ms)
+{
+    if (now_ms - checkpoint_last_ms < CONFIG_CHECKPOINT_PERIOD_MS)
+        return false;
+    checkpoint_last_ms = now_ms;
+
+    // the slot that doesn't hold the newest checkpoint
+    rtc_checkpoint &slot = rtc_slots[(checkpoint_sequence + 1) & 1];
+    slot.magic = 0; // invalid until the crc is in
+    slot.sequence = ++checkpoint_sequence;
+    slot.saved_us = checkpoint_clock_us();
+    // SYS_INIT can give up before it has a calibration, the slot then says
+    // so rather than carrying whatever was in it before
+    slot.calibrated = checkpoint_calibration != nullptr;
+    if (slot.calibrated)
+    {
+        slot.calibration = *checkpoint_calibration;
+        slot.baro_offset = checkpoint_baro_offset;
+    }
+    slot.flight = state.getCheckpoint(now_ms);
+    slot.magic = CHECKPOINT_MAGIC;
+    slot.crc = checkpoint_crc(slot);
+    return true;
+}
@@ -0,0 +1,560 @@
+#pragma once
+
+// Streaming flight log on the SD card.
+//
+// Any task hands a record to FlightLogger::log(), which copies it into a
+// lock-free multi-producer ring and returns; it never takes a lock, waits
+// on the card or allocates, and when the ring is full the record is dropped
+// and counted instead. Everything past that runs in two tasks of the
+// logger's own:
+//
+//   drain  empties the ring every CONFIG_LOG_DRAIN_PERIOD_MS into one of
+//          two CONFIG_LOG_BLOCK_SIZE buffers and hands the buffer over when
+//          it's full
+//   write  owns the one open file, writes each buffer it is handed in one
+//          go and fsyncs every CONFIG_LOG_FSYNC_PERIOD_MS
+//
+// so the ring keeps filling while a block is on its way to the card, and a
+// slow write (the card doing its own housekeeping can take 100+ ms) only
+// costs ring space. The block size matches the FAT allocation unit
+// (SdCardManager mounts with 16 KB), and blocks are kept aligned to it in
+// the file: when a partial block goes out for an fsync, the next one is cut
+// short at the following boundary. Aligned whole-sector writes go from the
+// buffer straight to the card, FATFS doesn't copy them through its sector
+// window.
+//
+// Each buffer goes out as one block of the flight log format (flightlog.h
+// in gnc): a header with its CRC, whole records, and zero padding where a
+// record didn't fit before the block boundary. The CRC is done by the write
+// task, off the drain path. Every start() begins with a schema block.
+//
+// A reboot (see checkpoint.h) carries on after what's already in the file.
+// The file can be longer than the log in it: SdCardManager::preallocate()
+// reserves a contiguous erased extent up front so no write has to wait on
+// FATFS allocating a cluster, and start() finds where the log ends in it.
+// finish() cuts the file back to the log on landing.
+//
+// Raw mode (start(RawLogRegion &)) does without the file: the write task
+// puts each block on the card's sectors with one multi-block write, and
+// updating the region's superblock takes the place of fsync, so there's no
+// FAT or directory entry to rewrite either. Blocks are whole sectors in
+// both modes.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <fcntl.h>
+#include <sys/unistd.h>
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "flightlog.h"
+#include "sd_manager.h"
+
+// largest record log() takes, a ring slot is this plus 8 bytes
+#define LOG_MAX_RECORD 56
+
+// blocks are whole sectors, a raw region takes nothing less and FATFS
+// hands whole aligned sectors to the card without copying them
+#define LOG_SECTOR FLIGHTLOG_RAW_SECTOR
+
+// bytes left before a block boundary that aren't worth a block of their
+// own, a partial block is padded up to the boundary instead
+#define LOG_MIN_BLOCK (sizeof(flightlog_block) + LOG_MAX_RECORD)
+
+// tries at getting a block onto the card before giving up on it
+#define LOG_WRITE_TRIES 3
+
+struct logger_stats
+{
+    uint32_t records;       // taken into the ring
+    uint32_t dropped;       // turned away, ring full or record too long
+    uint32_t ring_high;     // most slots in use at once
+    uint32_t blocks;        // blocks written, partial ones included
+    uint64_t bytes_written; // this boot, on top of what the file already had
+    uint32_t fsyncs;
+    uint32_t write_errors;  // blocks given up on
+    uint32_t max_write_us; // slowest write() of a block
+    uint32_t max_fsync_us;
+};
+
+class FlightLogger
+{
+public:
+    FlightLogger()
+        : fd_(-1), raw_(nullptr), fill_(nullptr), fill_len_(0), fill_limit_(0), file_pos_(0), block_seq_(0),
+          free_q_(nullptr), full_q_(nullptr), drain_task_(nullptr), write_task_(nullptr),
+          flush_requested_(false), finish_requested_(false), stats_{}
+    {
+        for (uint32_t i = 0; i < CONFIG_LOG_RING_SLOTS; i++)
+            ring_[i].seq.store(i, std::memory_order_relaxed);
+        for (int i = 0; i < FLIGHTLOG_STREAM_IDS; i++)
+            stream_seq_[i].store(0, std::memory_order_relaxed);
+        head_.store(0, std::memory_order_relaxed);
+        tail_ = 0;
+    }
+
+    // opens (or creates) path on the mounted card, carrying on after the log
+    // already in it, and starts the two tasks. The card has to be mounted
+    // (and the file preallocated, if it is) first
+    esp_err_t start(const char *path)
+    {
+        if (fd_ >= 0)
+            return ESP_ERR_INVALID_STATE;
+
+        fd_ = open(path, O_RDWR | O_CREAT, 0666);
+        if (fd_ < 0)
+        {
+            ESP_LOGE((const char *)"logger", "Failed to open '%s'.", path);
+            return ESP_FAIL;
+        }
+
+        // A reset can have left the log ending anywhere, part way into a
+        // block even. Each boot starts on a block boundary, zero filled up
+        // to it, which the decoders skip like any other gap
+        off_t size = lseek(fd_, 0, SEEK_END);
+        file_pos_ = findEnd(size > 0 ? (uint64_t)size : 0);
+        lseek(fd_, (off_t)file_pos_, SEEK_SET);
+        uint32_t gap = (CONFIG_LOG_BLOCK_SIZE - (uint32_t)(file_pos_ % CONFIG_LOG_BLOCK_SIZE)) % CONFIG_LOG_BLOCK_SIZE;
+        if (gap > 0)
+        {
+            memset(buffers_[0], 0, gap);
+            if (write(fd_, buffers_[0], gap) != (ssize_t)gap)
+                ESP_LOGE((const char *)"logger", "Couldn't pad the log to a block boundary.");
+            file_pos_ += gap;
+        }
+
+        ESP_LOGI((const char *)"logger", "Logging to '%s' from %llu bytes in (file is %llu).", path,
+                 (unsigned long long)file_pos_, (unsigned long long)(size > 0 ? size : 0));
+        begin();
+        return ESP_OK;
+    }
+
+    // Raw mode, see RawLogRegion: blocks go straight to the card's sectors
+    // from where the log in the region ends. The region has to be set up by
+    // SdCardManager::openRaw() first
+    esp_err_t start(RawLogRegion &raw)
+    {
+        if (fd_ >= 0 || raw_)
+            return ESP_ERR_INVALID_STATE;
+
+        // the gap to the block boundary is left erased rather than written
+        raw_ = &raw;
+        file_pos_ = raw.logEnd();
+        uint32_t gap = (CONFIG_LOG_BLOCK_SIZE - (uint32_t)(file_pos_ % CONFIG_LOG_BLOCK_SIZE)) % CONFIG_LOG_BLOCK_SIZE;
+        raw.skip(gap);
+        file_pos_ += gap;
+
+        ESP_LOGI((const char *)"logger", "Logging raw from %llu bytes into the region.", (unsigned long long)file_pos_);
+        begin();
+        return ESP_OK;
+    }
+
+    // Any task, never blocks. Copies len bytes into the ring, false if the
+    // record was dropped (ring full or len > LOG_MAX_RECORD).
+    //
+    // Vyukov's bounded queue: a producer claims a slot by moving head_ on
+    // with a CAS, fills it, and publishes it by setting the slot's sequence
+    // to position + 1, which is what the drain task waits for. A slot the
+    // drain task hasn't emptied yet still has a sequence from the last lap,
+    // which is how a full ring shows up
+    bool log(const void *data, size_t len)
+    {
+        if (len > LOG_MAX_RECORD)
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        uint32_t pos = head_.load(std::memory_order_relaxed);
+        slot *s;
+        for (;;)
+        {
+            s = &ring_[pos & (CONFIG_LOG_RING_SLOTS - 1)];
+            uint32_t seq = s->seq.load(std::memory_order_acquire);
+            int32_t diff = (int32_t)(seq - pos);
+            if (diff == 0)
+            {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+                pos = head_.load(std::memory_order_relaxed);
+        }
+
+        s->len = (uint16_t)len;
+        memcpy(s->data, data, len);
+        s->seq.store(pos + 1, std::memory_order_release);
+        records_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // a flightlog.h record (flightlog_imu, ...), stamped with its stream,
+    // size, per-stream sequence number and t_us before it goes to log().
+    // The sequence number is used up even if the record is dropped, so the
+    // decoder sees the gap
+    template <class Record>
+    bool logRecord(Record &r, uint32_t t_us)
+    {
+        static_assert(sizeof(Record) <= LOG_MAX_RECORD, "record too long for a ring slot");
+        const int id = (int)Record::stream;
+        r.header.size = (uint8_t)sizeof(Record);
+        r.header.stream = (uint8_t)id;
+        r.header.seq = (uint16_t)stream_seq_[id].fetch_add(1, std::memory_order_relaxed);
+        r.header.t_us = t_us;
+        return log(&r, sizeof(Record));
+    }
+
+    // writes out and fsyncs whatever has been logged so far at the next
+    // drain. Doesn't wait for it
+    void flush() { flush_requested_.store(true, std::memory_order_relaxed); }
+
+    // On landing: flush(), then cut the file down to the end of the log,
+    // giving back what's left of a preallocated extent. The records dropped
+    // so far go in the log first as a LOG_DROPS event, and the slowest block
+    // write and fsync as LOG_LATENCY events, which is how preallocation on
+    // and off compare from one flight to the next. Logging carries on
+    // after, the file grows from there
+    void finish()
+    {
+        logger_stats s = getStats();
+        flightlog_event e = {};
+        e.event = (uint16_t)flightlog_event_kind::LOG_DROPS;
+        e.value = (float)s.dropped;
+        logRecord(e, (uint32_t)esp_timer_get_time());
+        e.event = (uint16_t)flightlog_event_kind::LOG_LATENCY;
+        e.value = (float)s.max_write_us;
+        logRecord(e, (uint32_t)esp_timer_get_time());
+        e.arg = 1;
+        e.value = (float)s.max_fsync_us;
+        logRecord(e, (uint32_t)esp_timer_get_time());
+        finish_requested_.store(true, std::memory_order_relaxed);
+    }
+
+    logger_stats getStats()
+    {
+        portENTER_CRITICAL(&stats_lock_);
+        logger_stats s = stats_;
+        portEXIT_CRITICAL(&stats_lock_);
+        s.records = records_.load(std::memory_order_relaxed);
+        s.dropped = dropped_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    struct slot
+    {
+        std::atomic<uint32_t> seq;
+        uint16_t len;
+        uint8_t data[LOG_MAX_RECORD];
+    };
+    static_assert((CONFIG_LOG_RING_SLOTS & (CONFIG_LOG_RING_SLOTS - 1)) == 0,
+                  "LOG_RING_SLOTS has to be a power of two");
+    static_assert(sizeof(FLIGHTLOG_SCHEMA) - 1 + sizeof(flightlog_block) <= CONFIG_LOG_BLOCK_SIZE,
+                  "the schema has to fit in one block");
+    static_assert(CONFIG_LOG_BLOCK_SIZE % LOG_SECTOR == 0, "LOG_BLOCK_SIZE has to be whole sectors");
+
+    // a buffer going between the two tasks
+    struct block
+    {
+        uint8_t *data;
+        uint32_t len;
+        bool sync;
+        bool truncate; // cut the file off after this one
+    };
+
+    slot ring_[CONFIG_LOG_RING_SLOTS];
+    std::atomic<uint32_t> head_; // next slot a producer claims
+    uint32_t tail_;              // next slot the drain task empties
+    std::atomic<uint32_t> stream_seq_[FLIGHTLOG_STREAM_IDS];
+    std::atomic<uint32_t> records_{0};
+    std::atomic<uint32_t> dropped_{0};
+
+    // word aligned, FATFS only hands aligned buffers straight to the driver
+    uint8_t buffers_[2][CONFIG_LOG_BLOCK_SIZE] __attribute__((aligned(4)));
+
+    int fd_;
+    RawLogRegion *raw_; // raw mode instead of fd_
+    uint8_t *fill_;       // buffer the drain task is filling, nullptr if none
+    uint32_t fill_len_;   // bytes in it
+    uint32_t fill_limit_; // bytes it takes before the next block boundary
+    uint64_t file_pos_;   // end of the log once everything handed over is written
+    uint64_t write_pos_;  // end of the log on the card, the write task's
+    uint32_t block_seq_;  // blocks started since start()
+    QueueHandle_t free_q_;
+    QueueHandle_t full_q_;
+    TaskHandle_t drain_task_;
+    TaskHandle_t write_task_;
+    std::atomic<bool> flush_requested_;
+    std::atomic<bool> finish_requested_;
+    logger_stats stats_; // written by the two tasks only, under stats_lock_
+    portMUX_TYPE stats_lock_ = portMUX_INITIALIZER_UNLOCKED;
+
+    // both modes from here, the write position set up: the queues, the
+    // schema block and the two tasks
+    void begin()
+    {
+        free_q_ = xQueueCreate(2, sizeof(block));
+        full_q_ = xQueueCreate(2, sizeof(block));
+        for (int i = 0; i < 2; i++)
+        {
+            block b = {buffers_[i], 0, false, false};
+            xQueueSend(free_q_, &b, 0);
+        }
+        write_pos_ = file_pos_;
+
+        // what the rest of this boot's blocks hold, written with the first
+        takeBuffer(FLIGHTLOG_BLOCK_SCHEMA);
+        memcpy(fill_ + fill_len_, FLIGHTLOG_SCHEMA, sizeof(FLIGHTLOG_SCHEMA) - 1);
+        fill_len_ += sizeof(FLIGHTLOG_SCHEMA) - 1;
+        handOver(true);
+
+        xTaskCreatePinnedToCore(drainTask, "log_drain", 4096, this, CONFIG_LOG_TASK_PRIORITY, &drain_task_,
+                                CONFIG_DATA_CORE);
+        xTaskCreatePinnedToCore(writeTask, "log_write", 4096, this, CONFIG_LOG_TASK_PRIORITY, &write_task_,
+                                CONFIG_DATA_CORE);
+    }
+
+    static void drainTask(void *arg)
+    {
+        FlightLogger *self = (FlightLogger *)arg;
+        TickType_t wake = xTaskGetTickCount();
+        int64_t last_flush_us = esp_timer_get_time();
+        for (;;)
+        {
+            vTaskDelayUntil(&wake, pdMS_TO_TICKS(CONFIG_LOG_DRAIN_PERIOD_MS));
+            self->drain();
+
+            // a partial block goes out on the fsync cadence (or when asked),
+            // so a quiet pad doesn't leave minutes of data sitting in RAM
+            int64_t now = esp_timer_get_time();
+            bool due = now - last_flush_us >= CONFIG_LOG_FSYNC_PERIOD_MS * 1000LL;
+            if ((due || self->flush_requested_.exchange(false)) && self->fill_)
+            {
+                self->handOver(true);
+                last_flush_us = now;
+            }
+
+            // the truncate goes with a block, an empty one if everything is
+            // out already. Waits for a buffer if both are with the writer
+            if (self->finish_requested_.load(std::memory_order_relaxed) &&
+                (self->fill_ || self->takeBuffer(FLIGHTLOG_BLOCK_RECORDS)))
+            {
+                self->handOver(true, true);
+                self->finish_requested_.store(false, std::memory_order_relaxed);
+                last_flush_us = now;
+            }
+        }
+    }
+
+    // moves published slots into the fill buffer, stops at the first slot
+    // still being written or when there's no buffer to fill
+    void drain()
+    {
+        uint32_t in_use = head_.load(std::memory_order_relaxed) - tail_;
+        portENTER_CRITICAL(&stats_lock_);
+        if (in_use > stats_.ring_high)
+            stats_.ring_high = in_use;
+        portEXIT_CRITICAL(&stats_lock_);
+
+        for (;;)
+        {
+            slot &s = ring_[tail_ & (CONFIG_LOG_RING_SLOTS - 1)];
+            if (s.seq.load(std::memory_order_acquire) != tail_ + 1)
+                return;
+
+            // records don't straddle blocks, one that doesn't fit closes it
+            if (fill_ && fill_len_ + s.len > fill_limit_)
+                handOver(false);
+            // both buffers with the writer, the ring holds on
+            if (!fill_ && !takeBuffer(FLIGHTLOG_BLOCK_RECORDS))
+                return;
+            memcpy(fill_ + fill_len_, s.data, s.len);
+            fill_len_ += s.len;
+
+            // free the slot for the producer one lap on
+            s.seq.store(tail_ + CONFIG_LOG_RING_SLOTS, std::memory_order_release);
+            tail_++;
+        }
+    }
+
+    // starts a block of the given kind in a free buffer, room left for the
+    // header, up to the next block boundary
+    bool takeBuffer(uint16_t kind)
+    {
+        block b;
+        if (xQueueReceive(free_q_, &b, 0) != pdTRUE)
+            return false;
+        fill_ = b.data;
+        fill_len_ = sizeof(flightlog_block);
+        fill_limit_ = CONFIG_LOG_BLOCK_SIZE - (uint32_t)(file_pos_ % CONFIG_LOG_BLOCK_SIZE);
+
+        flightlog_block *h = (flightlog_block *)fill_;
+        h->magic = FLIGHTLOG_BLOCK_MAGIC;
+        h->version = FLIGHTLOG_VERSION;
+        h->kind = kind;
+        h->seq = block_seq_++;
+        return true;
+    }
+
+    // closes the block and passes it to the writer, sync has it fsync
+    // straight after, truncate cut the file off after it as well. The block
+    // ends at the sector its contents end in unless that would leave less
+    // than LOG_MIN_BLOCK to the boundary, then it's padded up to the
+    // boundary so the next one starts aligned
+    void handOver(bool sync, bool truncate = false)
+    {
+        uint32_t size = (fill_len_ + LOG_SECTOR - 1) / LOG_SECTOR * LOG_SECTOR;
+        if (fill_limit_ - size < LOG_MIN_BLOCK)
+            size = fill_limit_;
+        memset(fill_ + fill_len_, 0, size - fill_len_);
+        flightlog_block *h = (flightlog_block *)fill_;
+        h->size = size;
+        h->used = fill_len_;
+
+        block b = {fill_, size, sync || truncate, truncate};
+        file_pos_ += size;
+        fill_ = nullptr;
+        fill_len_ = 0;
+        xQueueSend(full_q_, &b, portMAX_DELAY); // never full, there are two
+    }
+
+    static void writeTask(void *arg)
+    {
+        FlightLogger *self = (FlightLogger *)arg;
+        int64_t last_sync_us = esp_timer_get_time();
+        for (;;)
+        {
+            block b;
+            xQueueReceive(self->full_q_, &b, portMAX_DELAY);
+
+            flightlog_block *h = (flightlog_block *)b.data;
+            h->crc = flightlog_block_crc(h);
+
+            // The drain task has already laid out what follows from where
+            // this block ends, so it goes at write_pos_ and nowhere else. A
+            // failed or short write is tried again from there, a block that
+            // still doesn't make it has its space left as it is and the
+            // write position moved past it, and the decoders drop what's
+            // there by its CRC
+            int64_t t0 = esp_timer_get_time();
+            ssize_t n = -1;
+            for (int tries = 0; n != (ssize_t)b.len && tries < LOG_WRITE_TRIES; tries++)
+            {
+                if (self->raw_)
+                    n = self->raw_->write(b.data, b.len) == ESP_OK ? (ssize_t)b.len : -1;
+                else
+                {
+                    if (tries > 0)
+                        lseek(self->fd_, (off_t)self->write_pos_, SEEK_SET);
+                    n = write(self->fd_, b.data, b.len);
+                }
+            }
+            int64_t t1 = esp_timer_get_time();
+            if (n != (ssize_t)b.len)
+            {
+                ESP_LOGE((const char *)"logger", "Block write failed (%d of %lu bytes), skipping it.", (int)n,
+                         (unsigned long)b.len);
+                if (self->raw_)
+                    self->raw_->skip(b.len);
+                else
+                    lseek(self->fd_, (off_t)(self->write_pos_ + b.len), SEEK_SET);
+            }
+            self->write_pos_ += b.len;
+
+            portENTER_CRITICAL(&self->stats_lock_);
+            if (n == (ssize_t)b.len)
+                self->stats_.bytes_written += b.len;
+            else
+                self->stats_.write_errors++;
+            self->stats_.blocks++;
+            if (t1 - t0 > self->stats_.max_write_us)
+                self->stats_.max_write_us = (uint32_t)(t1 - t0);
+            portEXIT_CRITICAL(&self->stats_lock_);
+
+            // fsync flushes the FAT and directory entry too, so the size is
+            // on the card and a reset loses at most one period. In raw mode
+            // it's the superblock
+            if (b.sync || t1 - last_sync_us >= CONFIG_LOG_FSYNC_PERIOD_MS * 1000LL)
+            {
+                if (self->raw_)
+                    self->raw_->sync();
+                else
+                    fsync(self->fd_);
+                int64_t t2 = esp_timer_get_time();
+                portENTER_CRITICAL(&self->stats_lock_);
+                self->stats_.fsyncs++;
+                if (t2 - t1 > self->stats_.max_fsync_us)
+                    self->stats_.max_fsync_us = (uint32_t)(t2 - t1);
+                portEXIT_CRITICAL(&self->stats_lock_);
+                last_sync_us = t2;
+            }
+
+            // nothing to give back in a raw region
+            if (b.truncate && !self->raw_)
+            {
+                if (ftruncate(self->fd_, (off_t)self->write_pos_) != 0 || fsync(self->fd_) != 0)
+                    ESP_LOGE((const char *)"logger", "Couldn't truncate the log at %llu bytes.",
+                             (unsigned long long)self->write_pos_);
+                else
+                    ESP_LOGI((const char *)"logger", "Log closed at %llu bytes, slowest write %lu us, fsync %lu us.",
+                             (unsigned long long)self->write_pos_, (unsigned long)self->stats_.max_write_us,
+                             (unsigned long)self->stats_.max_fsync_us);
+            }
+
+            b.len = 0;
+            xQueueSend(self->free_q_, &b, portMAX_DELAY);
+        }
+    }
+
+    // whether a block header starts at pos
+    bool headerAt(uint64_t pos)
+    {
+        flightlog_block h;
+        return pread(fd_, &h, sizeof h, (off_t)pos) == (ssize_t)sizeof h && h.magic == FLIGHTLOG_BLOCK_MAGIC &&
+               h.version == FLIGHTLOG_VERSION;
+    }
+
+    // Where the log in a file of size bytes ends. Up to there a block
+    // starts at every block boundary (start() pads to one, blocks are cut
+    // at them), past it is the erased rest of a preallocated extent or the
+    // end of the file, so the last boundary with a header on it is found by
+    // bisection: a dozen sector reads into a big file rather than walking
+    // it. From there the blocks are followed, CRCs checked, to where they
+    // stop, which drops a block torn by the reset. A file that doesn't start
+    // with a block has no log in it and is written over
+    uint64_t findEnd(uint64_t size)
+    {
+        if (!headerAt(0))
+            return 0;
+        uint64_t lo = 0, hi = (size + CONFIG_LOG_BLOCK_SIZE - 1) / CONFIG_LOG_BLOCK_SIZE;
+        while (hi - lo > 1)
+        {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (headerAt(mid * CONFIG_LOG_BLOCK_SIZE))
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        uint64_t base = lo * CONFIG_LOG_BLOCK_SIZE;
+        uint32_t avail = (uint32_t)(size - base < CONFIG_LOG_BLOCK_SIZE ? size - base : CONFIG_LOG_BLOCK_SIZE);
+        ssize_t n = pread(fd_, buffers_[0], avail, (off_t)base);
+        uint32_t pos = 0;
+        while (n == (ssize_t)avail && flightlog_block_valid(buffers_[0] + pos, avail - pos))
+            pos += ((flightlog_block *)(buffers_[0] + pos))->size;
+        return base + pos;
+    }
+};
@@ -21,10 +21,77 @@
 
 extern "C" void app_main()
 {
-    ApoAggregator apo;
-    SdCardManager sd;
+    // sensor tasks write into it for the whole run
+    static ApoAggregator apo;
+    // the flight logger writes to the card from its own tasks long after
+    // app_main is done, so the mount has to outlive it
+    static SdCardManager sd;
     EspHal *hal = EspHal(CONFIG_SPI_CLK, CONFIG_SPI_MISO, CONFIG_SPI_MOSI);
     RFM96 radio = Module(hal, CONFIG_RFM96_CHIP_SELECT, 5, CONFIG_RFM69_HARDWARE_RESET, RADIOLIB_NC);
 
-    SYS_INIT(apo, sd, radio);
+    // a reset mid-flight picks the flight state back up. The checkpoint is
+    // looked for before anything else, but only restored once SYS_INIT is
+    // done so the time it took counts toward the gap
+    static StateDeterminer state_determiner;
+    const rtc_checkpoint *resume = checkpoint_find();
+
+    SYS_INIT(apo, sd, radio, resume);
+    if (resume)
+        checkpoint_resume(state_determiner, *resume, MILLIS());
+
+    // the flight loop, runs the StateDeterminer on the latest sensor data
+    // every CONFIG_FLIGHT_LOOP_PERIOD_MS for as long as we're powered
+    TickType_t wake = xTaskGetTickCount();
+    bool landed = false;
+    while (true)
+    {
+        complete_sensor_data_snapshot snap = apo.generateCompleteSnapshot();
+        uint32_t now = (uint32_t)MILLIS();
+
+        float accel_g[3] = {snap.imu_accel_x, snap.imu_accel_y, snap.imu_accel_z};
+        float gyro[3] = {snap.imu_gyro_x, snap.imu_gyro_y, snap.imu_gyro_z};
+        float raw_mag[3] = {snap.imu_mag_x, snap.imu_mag_y, snap.imu_mag_z};
+
+        // the snapshot mag is uncorrected, which is what the pad fit wants,
+        // and the estimator gets it with the calibration (and any fit just
+        // made) applied
+        pad_mag_calibration(raw_mag, state_determiner.getState());
+        float mag[3];
+        apply_mag_calibration(raw_mag, mag);
+        // TMP1075 board temperature, the ICM20948 die temp isn't read yet
+        if (flight_imu)
+            pad_bias_update(*flight_imu, gyro, accel_g, snap.temp_temp_c, state_determiner.getState());
+
+        // the ICM20948 gives g, the estimator wants m/s^2
+        float accel[3] = {accel_g[0] * GRAVITY, accel_g[1] * GRAVITY, accel_g[2] * GRAVITY};
+        rocket_state before = state_determiner.getState();
+        filter_estimates est = state_determiner.determineState(accel, gyro, mag, (float)snap.baro_altitude, now);
+        checkpoint_tick(state_determiner, now);
+        log_flight_loop(snap, mag, state_determiner, est, (uint32_t)esp_timer_get_time());
+
+        rocket_state state = state_determiner.getState();
+        if (state != before)
+        {
+            flightlog_event e = {};
+            e.event = (uint16_t)flightlog_event_kind::STATE;
+            e.arg = (uint16_t)state;
+            flight_logger.logRecord(e, (uint32_t)esp_timer_get_time());
+        }
+
+        // RECOVERY is only low, still under the main. Once it's lying still on
+        // the ground the log file is cut back to what's in it
+        if (!landed && state_determiner.hasLanded())
+        {
+            landed = true;
+            flightlog_event e = {};
+            e.event = (uint16_t)flightlog_event_kind::LANDED;
+            e.arg = (uint16_t)state;
+            flight_logger.logRecord(e, (uint32_t)esp_timer_get_time());
+            flight_logger.finish();
+        }
+
+        profile_tick(radio, now);
+
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(CONFIG_FLIGHT_LOOP_PERIOD_MS));
+    }
 }
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+// Per-stage GNC timing report, see gnc/profile.h. Only does anything with
+// CONFIG_GNC_PROFILE set, which is what builds the timers in.
+//
+// Every CONFIG_GNC_PROFILE_PERIOD_MS, profile_tick() takes the stage times
+// since the last report, logs a line per stage and sends them as a
+// telemetry packet, then starts the next period from zero. While the last
+// packet is still on air the period just runs on. Cycle counts go out as
+// they are, divide by the CPU clock (240 MHz) on the ground.
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+#include <RadioLib.h>
+
+#include "profile.h"
+
+#ifdef GNC_PROFILE
+
+#define PROFILE_PACKET_TYPE 0x50 // 'P'
+
+struct __attribute__((packed)) profile_packet
+{
+    uint8_t type;
+    uint8_t stages;
+    uint32_t period_ms;
+    struct __attribute__((packed))
+    {
+        uint16_t calls; // saturates
+        uint32_t mean;
+        uint32_t p99;
+        uint32_t max;
+    } stage[(int)gnc::profile_stage::COUNT];
+};
+
+// 6 bytes of header and 14 per stage, 90 with the 6 stages there are now
+static_assert(sizeof(profile_packet) == 6 + 14 * (int)gnc::profile_stage::COUNT,
+              "profile_packet has to stay packed");
+
+// call from the task running the StateDeterminer, after determineState(),
+// which is the one that owns the radio. Returns true when a report went out.
+// Inline, so the statics are the same ones in every file that includes this
+inline bool profile_tick(RFM96 &radio, uint32_t now_ms)
+{
+    static uint32_t last_ms;
+    // the radio sends from this after startTransmit returns, so it can't be a local
+    static profile_packet tx;
+    // startTransmit() went out and finishTransmit() hasn't been called on it
+    static bool sending;
+
+    uint32_t period = now_ms - last_ms;
+    if (period < CONFIG_GNC_PROFILE_PERIOD_MS)
+        return false;
+
+    // the last report still on air, tx can't be touched yet. Try again on
+    // the next loop
+    if (sending && !(radio.getIRQFlags() & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_TX_DONE))
+        return false;
+    if (sending)
+    {
+        radio.finishTransmit();
+        sending = false;
+    }
+    last_ms = now_ms;
+
+    gnc::profile_report report = gnc::profiler().report();
+    gnc::profiler().reset();
+
+    tx.type = PROFILE_PACKET_TYPE;
+    tx.stages = (uint8_t)gnc::profile_stage::COUNT;
+    tx.period_ms = period;
+    for (int i = 0; i < (int)gnc::profile_stage::COUNT; i++)
+    {
+        const gnc::stage_summary &s = report.stage[i];
+        ESP_LOGI((const char *)"gnc_profile", "%-8s %6lu calls, cycles min %lu mean %lu p99 %lu max %lu",
+                 gnc::profile_stage_name((gnc::profile_stage)i), (unsigned long)s.calls, (unsigned long)s.min,
+                 (unsigned long)s.mean, (unsigned long)s.p99, (unsigned long)s.max);
+        tx.stage[i].calls = s.calls > 0xFFFF ? 0xFFFF : (uint16_t)s.calls;
+        tx.stage[i].mean = s.mean;
+        tx.stage[i].p99 = s.p99;
+        tx.stage[i].max = s.max;
+    }
+
+    // non-blocking, a LoRa packet this size is tens of ms on air
+    int state = radio.startTransmit((uint8_t *)&tx, sizeof(tx));
+    if (state == RADIOLIB_ERR_NONE)
+        sending = true;
+    else
+        ESP_LOGW((const char *)"gnc_profile", "telemetry send failed, code %d", state);
+    return true;
+}
+
+#else
+
+inline bool profile_tick(RFM96 &, uint32_t) { return false; }
+
+#endif // GNC_PROFILE
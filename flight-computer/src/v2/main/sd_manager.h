@@ -1,15 +1,93 @@
+#pragma once
+
 #include <cstdio>
 #include <cstring>
 #include <sys/unistd.h>
 #include <sys/stat.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_vfs_fat.h"
+#include "diskio_sdmmc.h"
+#include "ff.h"
 #include "sdmmc_cmd.h"
 #include "sd_test_io.h"
 #if SOC_SDMMC_IO_POWER_EXTERNAL
 #include "sd_pwr_ctrl_by_on_chip_ldo.h"
 #endif
 
+#include "flightlog.h"
+
+// A flight log written straight to the card's sectors ("raw region" in
+// flightlog.h), no FATFS on the way: every write is one multi-block write
+// to the next sectors of a region that's all the log's. Set up by
+// SdCardManager::openRaw(), after that only FlightLogger's write task uses
+// it. Outlives the SdCardManager that set it up, it keeps the card handle
+class RawLogRegion
+{
+public:
+    RawLogRegion()
+        : card_(nullptr), start_(0), sectors_(0), pos_(0), sb_{}
+    {
+    }
+
+    // bytes of log in the region so far, this boot's carries on from there
+    uint64_t logEnd() const
+    {
+        return (uint64_t)(pos_ - FLIGHTLOG_RAW_LOG_START) * FLIGHTLOG_RAW_SECTOR;
+    }
+
+    // len bytes of whole blocks, a whole number of sectors. From a DMA
+    // capable, word aligned buffer, or the driver copies it a sector at a
+    // time
+    esp_err_t write(const void *data, size_t len)
+    {
+        size_t count = len / FLIGHTLOG_RAW_SECTOR;
+        if (pos_ + count > sectors_)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        esp_err_t ret = sdmmc_write_sectors(card_, data, start_ + pos_, count);
+        if (ret == ESP_OK)
+        {
+            pos_ += count;
+        }
+        return ret;
+    }
+
+    // leaves len bytes (whole sectors) erased, to start this boot's log on
+    // a block boundary
+    void skip(size_t len)
+    {
+        pos_ += len / FLIGHTLOG_RAW_SECTOR;
+        flightlog_raw_extent &e = sb_.extents[sb_.extent_count - 1];
+        if (e.sectors == 0)
+        {
+            e.first = pos_;
+        }
+    }
+
+    // records in the superblock how far the log goes, the raw mode's fsync.
+    // The two copies take turns, a reset mid-write leaves the other one
+    esp_err_t sync()
+    {
+        flightlog_raw_extent &e = sb_.extents[sb_.extent_count - 1];
+        e.sectors = pos_ - e.first;
+        sb_.seq++;
+        sb_.copy = sb_.seq & 1;
+        sb_.crc = flightlog_raw_crc(&sb_);
+        return sdmmc_write_sectors(card_, &sb_, start_ + sb_.copy, 1);
+    }
+
+private:
+    friend class SdCardManager;
+
+    sdmmc_card_t *card_;
+    uint32_t start_;   // card sector of the region
+    uint32_t sectors_; // in the region
+    uint32_t pos_;     // next sector the log goes in, relative to start_
+    flightlog_raw_superblock sb_ __attribute__((aligned(4)));
+};
+
 class SdCardManager
 {
 public:
@@ -129,6 +207,9 @@ public:
         is_mounted_ = false;
     }
 
+    // appends data to path, for the occasional line of text (init status).
+    // Opens and closes the file each time, anything at a rate goes through
+    // FlightLogger (logger.h)
     esp_err_t writeFile(const char *path, const char *data)
     {
         if (!is_mounted_)
@@ -136,13 +217,220 @@ public:
             return ESP_ERR_INVALID_STATE;
         }
 
-        FILE *f = fopen(path, "w");
+        FILE *f = fopen(path, "a");
         if (!f)
         {
             ESP_LOGE((const char *)"sdcard_init", "Failed to open file '%s' for writing.", path);
             return ESP_FAIL;
         }
-        fclose(f);
+        bool ok = fputs(data, f) >= 0;
+        if (fclose(f) != 0 || !ok)
+        {
+            ESP_LOGE((const char *)"sdcard_init", "Failed to write file '%s'.", path);
+            return ESP_FAIL;
+        }
+        return ESP_OK;
+    }
+
+    // Reserves bytes for the file at path as one contiguous extent and
+    // erases it. A file written into that has all its clusters already,
+    // where otherwise every write crossing into a new one has FATFS find a
+    // free cluster and update the FAT first, a stall of several ms at no
+    // particular time. The file's size is the whole extent from here on;
+    // FlightLogger finds where its log ends (the erased part has no block
+    // headers in it) and truncates the file on landing.
+    //
+    // A file at least bytes long still has its extent and is left as it is.
+    // A shorter one is a log that was finished (or never had an extent), and
+    // f_expand only takes an empty file, so it's renamed to the first free
+    // <name>.001 ... <name>.999 next to it and a new one is started
+    esp_err_t preallocate(const char *path, uint64_t bytes)
+    {
+        if (!is_mounted_)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        char ff_path[64];
+        if (!ffPath(path, ff_path, sizeof(ff_path)))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        FIL f;
+        FRESULT fr = f_open(&f, ff_path, FA_WRITE | FA_OPEN_ALWAYS);
+        if (fr != FR_OK)
+        {
+            ESP_LOGE((const char *)"sdcard_init", "Failed to open file '%s' (%d).", path, (int)fr);
+            return ESP_FAIL;
+        }
+        if (f_size(&f) >= bytes)
+        {
+            f_close(&f);
+            ESP_LOGI((const char *)"sdcard_init", "'%s' still has its extent, carrying on in it.", path);
+            return ESP_OK;
+        }
+        if (f_size(&f) != 0)
+        {
+            f_close(&f);
+            char old_path[64];
+            fr = setAside(ff_path, old_path, sizeof(old_path));
+            if (fr != FR_OK)
+            {
+                ESP_LOGW((const char *)"sdcard_init", "Couldn't move the log in '%s' aside (%d), not preallocating.",
+                         path, (int)fr);
+                return ESP_FAIL;
+            }
+            ESP_LOGI((const char *)"sdcard_init", "Moved the last log in '%s' to '%s%s'.", path, mount_point_,
+                     strchr(old_path, ':') + 1);
+
+            fr = f_open(&f, ff_path, FA_WRITE | FA_CREATE_NEW);
+            if (fr != FR_OK)
+            {
+                ESP_LOGE((const char *)"sdcard_init", "Failed to create file '%s' (%d).", path, (int)fr);
+                return ESP_FAIL;
+            }
+        }
+
+        int64_t t0 = esp_timer_get_time();
+        fr = f_expand(&f, bytes, 1);
+        if (fr != FR_OK)
+        {
+            f_close(&f);
+            ESP_LOGW((const char *)"sdcard_init", "No %llu contiguous bytes free for '%s' (%d), it will grow as it's written.",
+                     (unsigned long long)bytes, path, (int)fr);
+            return ESP_FAIL;
+        }
+
+        LBA_t first = firstSector(f);
+        size_t count = (bytes + card_->csd.sector_size - 1) / card_->csd.sector_size;
+        f_close(&f);
+
+        // whatever an earlier file left in those sectors would otherwise
+        // read back as log blocks past the end of this one
+        esp_err_t ret = sdmmc_erase_sectors(card_, first, count, SDMMC_ERASE_ARG);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGW((const char *)"sdcard_init", "Couldn't erase the extent of '%s' (%s).", path,
+                     esp_err_to_name(ret));
+        }
+        ESP_LOGI((const char *)"sdcard_init", "Preallocated %llu bytes for '%s' from sector %lu in %lld ms.",
+                 (unsigned long long)bytes, path, (unsigned long)first, (esp_timer_get_time() - t0) / 1000);
+        return ESP_OK;
+    }
+
+    // Raw mode: the log goes straight to the sectors of the file at path,
+    // preallocated to bytes if it isn't there yet, with the superblock
+    // (flightlog.h) at its start. The region is taken up where the log in
+    // it ends, past the last recorded extent and any blocks written after
+    // the superblock's last update, and this boot gets the next extent.
+    // Only a contiguous file will do, and one that's already there without
+    // a superblock is left alone
+    esp_err_t openRaw(const char *path, uint64_t bytes, RawLogRegion &raw)
+    {
+        esp_err_t ret = preallocate(path, bytes);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+
+        bool contiguous = false;
+        char ff_path[64];
+        ffPath(path, ff_path, sizeof(ff_path));
+        ret = esp_vfs_fat_test_contiguous_file(mount_point_, path, &contiguous);
+        if (ret != ESP_OK || !contiguous)
+        {
+            ESP_LOGE((const char *)"sdcard_init", "'%s' isn't contiguous, no raw logging to it.", path);
+            return ESP_FAIL;
+        }
+        FIL f;
+        if (f_open(&f, ff_path, FA_READ) != FR_OK)
+        {
+            return ESP_FAIL;
+        }
+        uint32_t start = (uint32_t)firstSector(f);
+        uint32_t sectors = (uint32_t)(f_size(&f) / FLIGHTLOG_RAW_SECTOR);
+        f_close(&f);
+        if (sectors <= FLIGHTLOG_RAW_LOG_START)
+        {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        // the newer intact superblock, or a new one if the region is still
+        // erased (just preallocated)
+        static uint8_t sector[FLIGHTLOG_RAW_SECTOR] __attribute__((aligned(4)));
+        flightlog_raw_superblock &sb = raw.sb_;
+        bool found = false;
+        for (uint32_t copy = 0; copy < 2; copy++)
+        {
+            if (sdmmc_read_sectors(card_, sector, start + copy, 1) != ESP_OK || !flightlog_raw_valid(sector))
+            {
+                continue;
+            }
+            const flightlog_raw_superblock *s = (const flightlog_raw_superblock *)sector;
+            if (s->region_start == start && s->region_sectors == sectors && (!found || s->seq > sb.seq))
+            {
+                memcpy(&sb, sector, sizeof(sb));
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            sdmmc_read_sectors(card_, sector, start, 1);
+            for (size_t i = 0; i < sizeof(sector); i++)
+            {
+                if (sector[i] != sector[0] || (sector[0] != 0x00 && sector[0] != 0xFF))
+                {
+                    ESP_LOGE((const char *)"sdcard_init", "'%s' holds something else, no raw logging to it.", path);
+                    return ESP_FAIL;
+                }
+            }
+            memset(&sb, 0, sizeof(sb));
+            sb.magic = FLIGHTLOG_RAW_MAGIC;
+            sb.version = FLIGHTLOG_RAW_VERSION;
+            sb.region_start = start;
+            sb.region_sectors = sectors;
+        }
+
+        // past the recorded end, blocks are followed as long as headers are
+        // there, what the last boot wrote after its last superblock update
+        uint32_t pos = FLIGHTLOG_RAW_LOG_START;
+        if (sb.extent_count > 0)
+        {
+            const flightlog_raw_extent &last = sb.extents[sb.extent_count - 1];
+            pos = last.first + last.sectors;
+        }
+        while (pos < sectors && sdmmc_read_sectors(card_, sector, start + pos, 1) == ESP_OK)
+        {
+            const flightlog_block *b = (const flightlog_block *)sector;
+            if (b->magic != FLIGHTLOG_BLOCK_MAGIC || b->version != FLIGHTLOG_VERSION || b->size == 0 ||
+                b->size % FLIGHTLOG_RAW_SECTOR != 0 || b->used > b->size)
+            {
+                break;
+            }
+            pos += b->size / FLIGHTLOG_RAW_SECTOR;
+        }
+
+        // this boot's extent, or more of the last one once the list is full
+        if (sb.extent_count < FLIGHTLOG_RAW_EXTENTS)
+        {
+            sb.extents[sb.extent_count].first = pos;
+            sb.extents[sb.extent_count].sectors = 0;
+            sb.extent_count++;
+        }
+        raw.card_ = card_;
+        raw.start_ = start;
+        raw.sectors_ = sectors;
+        raw.pos_ = pos;
+        ret = raw.sync();
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE((const char *)"sdcard_init", "Failed to write the raw log superblock (%s).", esp_err_to_name(ret));
+            return ret;
+        }
+        ESP_LOGI((const char *)"sdcard_init", "Raw log in '%s', sectors %lu to %lu, extent %lu from sector %lu.", path,
+                 (unsigned long)start, (unsigned long)(start + sectors), (unsigned long)sb.extent_count,
+                 (unsigned long)pos);
         return ESP_OK;
     }
 
@@ -194,6 +482,51 @@ public:
     }
 
 private:
+    // the same file by its FATFS name, "0:/flight.bin" for "/sdcard/flight.bin"
+    bool ffPath(const char *path, char *out, size_t size)
+    {
+        size_t mount_len = strlen(mount_point_);
+        if (strncmp(path, mount_point_, mount_len) != 0)
+        {
+            return false;
+        }
+        snprintf(out, size, "%u:%s", (unsigned)ff_diskio_get_pdrv_card(card_), path + mount_len);
+        return true;
+    }
+
+    // renames the file at ff_path (a FATFS path) to the first of
+    // <name>.001 ... <name>.999 that isn't taken, name being ff_path without
+    // its extension. out gets the new path
+    FRESULT setAside(const char *ff_path, char *out, size_t size)
+    {
+        const char *dot = strrchr(ff_path, '.');
+        const char *slash = strrchr(ff_path, '/');
+        int stem = (dot && (!slash || dot > slash)) ? (int)(dot - ff_path) : (int)strlen(ff_path);
+        for (unsigned i = 1; i < 1000; i++)
+        {
+            snprintf(out, size, "%.*s.%03u", stem, ff_path, i);
+            FILINFO info;
+            FRESULT fr = f_stat(out, &info);
+            if (fr == FR_NO_FILE)
+            {
+                return f_rename(ff_path, out);
+            }
+            if (fr != FR_OK)
+            {
+                return fr;
+            }
+        }
+        return FR_EXIST;
+    }
+
+    // card sector an open file's first cluster starts at, data clusters are
+    // numbered from 2
+    LBA_t firstSector(const FIL &f)
+    {
+        FATFS *fs = f.obj.fs;
+        return fs->database + (LBA_t)(f.obj.sclust - 2) * fs->csize;
+    }
+
     sdmmc_card_t *card_;
     bool is_mounted_;
     sdmmc_host_t host_;
@@ -1,5 +1,5 @@
 #include "sensor_interface.h"
-#include "gnc/StateDetermination.h"
+#include "StateDetermination.h"
 
 #define MAX_SENSORS 8
 
@@ -54,6 +54,8 @@ BMP581::BMP581(i2c_port_num_t port, i2c_addr_bit_len_t addr_len,
                uint16_t bmp581_address, uint32_t scl_clk_speed)
 {
     this->bmp581_dev_handle_ = i2c_create_device(port, addr_len, bmp581_address, scl_clk_speed);
+    baro_offset_ = 0;
+    offset_known_ = false;
 }
 
 BMP581::~BMP581()
@@ -94,7 +96,8 @@ void BMP581::configure()
     reg_and_data[1] = curr_config[0];
     i2c_write(bmp581_dev_handle_, reg_and_data, sizeof(reg_and_data));
 
-    calcBaroOffset();
+    if (!offset_known_)
+        calcBaroOffset();
 
     // TODO: change this to use a macro
     vTaskDelay(pdMS_TO_TICKS(RECONFIG_DELAY_MS));
@@ -190,6 +193,12 @@ void BMP581::calcBaroOffset()
     baro_offset_ = sum / sample_count;
 }
 
+void BMP581::setBaroOffset(float offset)
+{
+    baro_offset_ = offset;
+    offset_known_ = true;
+}
+
 sensor_status BMP581::initialize()
 {
     sensor_status ret;
@@ -17,8 +17,15 @@ public:
     sensor_type getType() const override;
     uint8_t getDevID() override;
 
+    // pad reference altitude. Setting it before initialize() (warm restart
+    // mid-flight) skips the averaging in configure(), the rocket isn't on
+    // the pad anymore
+    void setBaroOffset(float offset);
+    float getBaroOffset() const { return baro_offset_; }
+
 private:
     float baro_offset_;
+    bool offset_known_;
     i2c_master_dev_handle_t bmp581_dev_handle_;
 
     void configure() override;
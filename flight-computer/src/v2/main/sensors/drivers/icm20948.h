@@ -62,6 +62,8 @@ public:
     void setCalibrationFactors(const float G_offset[3],
                                const float A_B[3], const float A_Ainv[3][3],
                                const float M_B[3], const float M_Ainv[3][3]);
+    // gyro output per unit of G_offset, for turning an output bias back into one
+    float getGyroScale() const { return g_scale_; }
 
 private:
     ICM20948Config config_;
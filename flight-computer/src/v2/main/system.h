@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdio.h>
+#include <string.h>
 #include <memory>
 
 #include "sdkconfig.h"
@@ -17,17 +18,30 @@
 #include "sensors/drivers/tmp1075.h"
 
 #include "apo_aggregator.h"
+#include "calibration.h"
+#include "checkpoint.h"
+#include "logger.h"
+#include "profiling.h"
 #include "sd_manager.h"
+#include "magcal.h"
+#include "padbias.h"
 
-struct startup_vals
-{
-    int32_t access_count;
-    float G_offset[3];
-    float A_B[3];
-    float A_Ainv[3][3];
-    float M_B[3];
-    float M_Ainv[3][3];
-};
+// the flight log, everything logged at rate goes through it. With its
+// buffers and record ring it's 64 KB, so not on a stack
+static FlightLogger flight_logger;
+
+#if CONFIG_LOG_RAW
+// the card region the flight log goes to in raw mode, kept for the run
+static RawLogRegion raw_log;
+#endif
+
+// calibration in use. ICM20948 keeps pointers into it, so it lives for the
+// whole run and updates (pad mag calibration) take effect straight away
+static startup_vals sensor_calibration;
+
+// the ICM20948 SYS_INIT set up, for the pad bias update in the flight loop.
+// nullptr if SYS_INIT didn't get that far
+static const ICM20948 *flight_imu;
 
 startup_vals read_nvs_startup_data(void)
 {
@@ -72,7 +86,7 @@ startup_vals read_nvs_startup_data(void)
     }
 
     size = sizeof(fin.M_Ainv);
-    ESP_ERROR_CHECK_WITHOUT_ABORT(nvs_get_blob(h, CONFIG_KEY_M_Ainv, fin.M_Ainv, &size));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(nvs_get_blob(h, CONFIG_KEY_M_AInv, fin.M_Ainv, &size));
     printf("magnetometer correction matrix:\n");
     for (int i = 0; i < 3; i++)
     {
@@ -86,7 +100,217 @@ startup_vals read_nvs_startup_data(void)
     return fin;
 }
 
-void init_sensors(ApoAggregator apo, SdCardManager sd)
+// stores a new mag calibration over the one read at startup
+void write_nvs_mag_calibration(const startup_vals &fin)
+{
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE((const char *)"magcal", "Couldn't open NVS: %s", esp_err_to_name(ret));
+        return;
+    }
+
+    ESP_ERROR_CHECK_WITHOUT_ABORT(nvs_set_blob(h, CONFIG_KEY_M_B, fin.M_B, sizeof(fin.M_B)));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(nvs_set_blob(h, CONFIG_KEY_M_AInv, fin.M_Ainv, sizeof(fin.M_Ainv)));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(nvs_commit(h));
+    nvs_close(h);
+}
+
+// the ICM20948 fills the mag with zeros when it hasn't read one (it doesn't
+// read the AK09916 at all yet), never a real field
+static bool mag_was_read(const float raw_mag[3])
+{
+    return raw_mag[0] != 0.f || raw_mag[1] != 0.f || raw_mag[2] != 0.f;
+}
+
+// M_B / M_Ainv applied to the raw mag out of the snapshot, the ICM20948
+// doesn't do it itself. Reads sensor_calibration each time, so a pad fit is
+// in use from the next sample. A mag that wasn't read stays zero, which the
+// estimator skips, rather than turning into -M_Ainv * M_B
+void apply_mag_calibration(const float raw_mag[3], float mag[3])
+{
+    if (!mag_was_read(raw_mag))
+    {
+        mag[0] = mag[1] = mag[2] = 0.f;
+        return;
+    }
+    const startup_vals &c = sensor_calibration;
+    imu_calibration cal = imu_calibration::from(1.f, c.G_offset, c.A_B, c.A_Ainv, c.M_B, c.M_Ainv);
+    cal.mag(gnc::vec3(raw_mag)).copyTo(mag);
+}
+
+// Hard/soft-iron fit on the pad, called from the flight loop with the raw
+// (uncorrected) mag. Only learns while in LAUNCH_READY, as the airframe is
+// carried out and set up, and only from samples the ICM20948 actually read.
+// Once MagCalibrator says the fit is good it replaces M_B / M_Ainv and is
+// written back to NVS, once per boot
+void pad_mag_calibration(const float raw_mag[3], rocket_state state)
+{
+    static MagCalibrator calibrator;
+    static bool done = false;
+    static float last[3];
+    if (done || state != rocket_state::LAUNCH_READY || !mag_was_read(raw_mag))
+        return;
+
+    // the flight loop outruns the mag, the same reading again isn't a new sample
+    if (memcmp(raw_mag, last, sizeof(last)) == 0)
+        return;
+    memcpy(last, raw_mag, sizeof(last));
+
+    calibrator.add(raw_mag);
+    if (!calibrator.converged())
+        return;
+
+    const mag_calibration &cal = calibrator.getCalibration();
+    memcpy(sensor_calibration.M_B, cal.bias, sizeof(sensor_calibration.M_B));
+    memcpy(sensor_calibration.M_Ainv, cal.soft_iron, sizeof(sensor_calibration.M_Ainv));
+    write_nvs_mag_calibration(sensor_calibration);
+    done = true;
+
+    ESP_LOGI((const char *)"magcal", "mag calibration from %lu samples, bias %.2f %.2f %.2f, residual %.3f",
+             (unsigned long)cal.samples, cal.bias[0], cal.bias[1], cal.bias[2], cal.residual);
+}
+
+// What the flight loop saw this pass, into the flight log. The sensor tasks
+// only leave their latest sample in the ApoAggregator, so a sensor's record
+// goes in when its sample changed since the last pass, which is the sensor's
+// own rate as long as that's below the loop's. The estimator goes in every
+// pass. mag is the calibrated one
+void log_flight_loop(const complete_sensor_data_snapshot &snap, const float mag[3],
+                     const StateDeterminer &state, const filter_estimates &est, uint32_t t_us)
+{
+    flightlog_imu imu = {};
+    imu.accel_x = snap.imu_accel_x;
+    imu.accel_y = snap.imu_accel_y;
+    imu.accel_z = snap.imu_accel_z;
+    imu.gyro_x = snap.imu_gyro_x;
+    imu.gyro_y = snap.imu_gyro_y;
+    imu.gyro_z = snap.imu_gyro_z;
+    imu.mag_x = mag[0];
+    imu.mag_y = mag[1];
+    imu.mag_z = mag[2];
+    imu.temp = snap.temp_temp_c;
+    static flightlog_imu last_imu;
+    if (memcmp(&imu.accel_x, &last_imu.accel_x, sizeof(imu) - sizeof(imu.header)) != 0)
+    {
+        last_imu = imu;
+        flight_logger.logRecord(imu, t_us);
+    }
+
+    flightlog_highg highg = {};
+    highg.accel_x = snap.hg_accel_x;
+    highg.accel_y = snap.hg_accel_y;
+    highg.accel_z = snap.hg_accel_z;
+    static flightlog_highg last_highg;
+    if (memcmp(&highg.accel_x, &last_highg.accel_x, sizeof(highg) - sizeof(highg.header)) != 0)
+    {
+        last_highg = highg;
+        flight_logger.logRecord(highg, t_us);
+    }
+
+    flightlog_baro baro = {};
+    baro.pressure = snap.baro_pressure;
+    baro.temp = snap.baro_temp;
+    baro.altitude = (float)snap.baro_altitude;
+    static flightlog_baro last_baro;
+    if (memcmp(&baro.pressure, &last_baro.pressure, sizeof(baro) - sizeof(baro.header)) != 0)
+    {
+        last_baro = baro;
+        flight_logger.logRecord(baro, t_us);
+    }
+
+    flightlog_gps gps = {};
+    gps.lat = snap.gps_lat;
+    gps.lon = snap.gps_lon;
+    gps.alt = (float)snap.gps_alt;
+    gps.speed = snap.gps_speed;
+    gps.cog = snap.gps_cog;
+    gps.mag_vari = snap.gps_mag_vari;
+    gps.year = (uint16_t)snap.gps_year;
+    gps.month = (uint8_t)snap.gps_month;
+    gps.day = (uint8_t)snap.gps_day;
+    gps.hour = (uint8_t)snap.gps_hour;
+    gps.minute = (uint8_t)snap.gps_minute;
+    gps.second = (uint8_t)snap.gps_second;
+    gps.num_sats = (uint8_t)snap.gps_num_sats;
+    gps.fix_status = (uint8_t)snap.gps_fix_status;
+    gps.fix_valid = snap.gps_fix_valid ? 1 : 0;
+    static flightlog_gps last_gps;
+    if (memcmp(&gps.lat, &last_gps.lat, sizeof(gps) - sizeof(gps.header)) != 0)
+    {
+        last_gps = gps;
+        flight_logger.logRecord(gps, t_us);
+    }
+
+    flightlog_estimator e = {};
+    const State &q = state.getAttitude();
+    e.q_w = q.w;
+    e.q_x = q.x;
+    e.q_y = q.y;
+    e.q_z = q.z;
+    e.altitude = est.cf_results.altitude;
+    e.vertical_velocity = est.cf_results.vertical_velocity;
+    e.vertical_accel = est.vertical_accel;
+    e.state = (uint8_t)state.getState();
+    flight_logger.logRecord(e, t_us);
+}
+
+// Gyro / accel bias refinement on the pad, called from the flight loop with
+// the IMU sample as it comes out of the ICM20948 (calibration applied, rad/s
+// and g) and the IMU temperature. Learns while in LAUNCH_READY. On the first sample after
+// that (launch detected) the latest bias, carried to the current
+// temperature, is folded into G_offset / A_B, which the ICM20948 reads
+// through its pointers into sensor_calibration
+void pad_bias_update(const ICM20948 &icm, const float gyro[3], const float accel[3], float temp_c,
+                     rocket_state state)
+{
+    // the ICM20948 accel comes out in g
+    static PadBiasEstimator estimator(1.f, PADBIAS_GYRO_STEP, PADBIAS_ACCEL_STEP / GRAVITY);
+    static bool applied = false;
+    if (applied)
+        return;
+
+    if (state == rocket_state::LAUNCH_READY)
+    {
+        // the flight loop outruns the ICM20948 task, the same reading again
+        // isn't a new sample and would count double in the stillness windows
+        static float last[6];
+        float sample[6] = {gyro[0], gyro[1], gyro[2], accel[0], accel[1], accel[2]};
+        if (memcmp(sample, last, sizeof(last)) == 0)
+            return;
+        memcpy(last, sample, sizeof(last));
+
+        estimator.add(gyro, accel, temp_c);
+        return;
+    }
+
+    applied = true;
+    const pad_bias &bias = estimator.getBias();
+    if (!bias.valid)
+        return;
+
+    // output = g_scale * (raw - G_offset), so an output bias b moves G_offset by b / g_scale
+    float gyro_bias[3];
+    estimator.gyroBiasAt(temp_c, gyro_bias);
+    for (int i = 0; i < 3; i++)
+        sensor_calibration.G_offset[i] += gyro_bias[i] / icm.getGyroScale();
+
+    // output = A_Ainv * (raw - A_B), so A_B moves by A_Ainv^-1 * b
+    gnc::Matrix<3, 3> A_inv = gnc::Matrix<3, 3>::from(&sensor_calibration.A_Ainv[0][0]), A;
+    if (gnc::inverse(A_inv, A))
+    {
+        gnc::Vector3f db = A * gnc::vec3(bias.accel);
+        for (int i = 0; i < 3; i++)
+            sensor_calibration.A_B[i] += db(i);
+    }
+
+    ESP_LOGI((const char *)"padbias", "gyro bias %.5f %.5f %.5f rad/s at %.1f C, accel %.4f %.4f %.4f g, %lu segments",
+             gyro_bias[0], gyro_bias[1], gyro_bias[2], temp_c, bias.accel[0], bias.accel[1], bias.accel[2],
+             (unsigned long)bias.segments);
+}
+
+void init_sensors(ApoAggregator &apo, SdCardManager &sd)
 {
     uint8_t count = apo.getNumSensors();
     char *sensor_stats[count] = apo.initializeSensors();
@@ -100,7 +324,11 @@ void init_sensors(ApoAggregator apo, SdCardManager sd)
     }
 }
 
-void SYS_INIT(ApoAggregator apo, SdCardManager sd, RFM96 radio)
+// resume is the checkpoint from checkpoint_find() when this boot is a warm
+// restart mid-flight, nullptr otherwise. The calibration and pad reference
+// are then taken from it instead of NVS and a fresh baro average, if it has
+// them
+void SYS_INIT(ApoAggregator &apo, SdCardManager &sd, RFM96 &radio, const rtc_checkpoint *resume)
 {
     esp_err_t ret = sd.mount();
     if (ret != ESP_OK)
@@ -109,7 +337,34 @@ void SYS_INIT(ApoAggregator apo, SdCardManager sd, RFM96 radio)
         return;
     }
 
-    startup_vals fin = read_nvs_startup_data();
+    // raw mode falls back to the log file if the region can't be had
+    esp_err_t log_ret = ESP_FAIL;
+#if CONFIG_LOG_RAW
+    if (sd.openRaw(CONFIG_LOG_RAW_FILE, (uint64_t)CONFIG_LOG_RAW_MB << 20, raw_log) == ESP_OK)
+        log_ret = flight_logger.start(raw_log);
+#endif
+    if (log_ret != ESP_OK)
+    {
+#if CONFIG_LOG_PREALLOCATE_MB > 0
+        // a warm restart carries on in the file as it is, whatever it holds
+        if (!resume)
+            sd.preallocate(CONFIG_LOG_FILE, (uint64_t)CONFIG_LOG_PREALLOCATE_MB << 20);
+#endif
+        log_ret = flight_logger.start(CONFIG_LOG_FILE);
+    }
+    if (log_ret != ESP_OK)
+        ESP_LOGE((const char *)"apo_init", "Flight log not started, nothing will be logged");
+
+    // why this boot happened, first thing in its part of the log
+    flightlog_event boot = {};
+    boot.event = (uint16_t)flightlog_event_kind::BOOT;
+    boot.arg = (uint16_t)esp_reset_reason();
+    boot.value = resume ? 1.f : 0.f;
+    flight_logger.logRecord(boot, (uint32_t)esp_timer_get_time());
+
+    bool resume_calibration = resume && resume->calibrated;
+    sensor_calibration = resume_calibration ? resume->calibration : read_nvs_startup_data();
+    startup_vals &fin = sensor_calibration;
     i2c_bus_init();
 
     // create all the sensor objects and throw them into the apoaggregator
@@ -122,7 +377,11 @@ void SYS_INIT(ApoAggregator apo, SdCardManager sd, RFM96 radio)
     GpsNmeaConfig cfg = GpsNmeaConfigDefault();
     static GpsSensor gps(cfg);
 
-    icm.setCalibrationFactors(fin.G_offset, fin.A_B, fin.A_Ainv, fin.M_B, fin.M_B);
+    icm.setCalibrationFactors(fin.G_offset, fin.A_B, fin.A_Ainv, fin.M_B, fin.M_Ainv);
+    flight_imu = &icm;
+
+    if (resume_calibration)
+        bmp.setBaroOffset(resume->baro_offset);
 
     apo.addSensor(&adxl);
     apo.addSensor(&icm);
@@ -131,6 +390,7 @@ void SYS_INIT(ApoAggregator apo, SdCardManager sd, RFM96 radio)
     apo.addSensor(&gps);
 
     init_sensors(apo, sd);
+    checkpoint_set_calibration(&sensor_calibration, bmp.getBaroOffset());
 
     sd.writeFile(CONFIG_INIT_FILE, "[RFM96] Initializing ... ");
     // ESP_LOGI(TAG, "[RFM96] Initializing ... ");